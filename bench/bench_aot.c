@@ -0,0 +1,170 @@
+// Ahead-of-time translation benchmark
+// Every bundled ROM is translated to C at build time (chip8-aot, see
+// CMakeLists.txt) and linked in here. Each one runs on its translation and
+// on its own interpreter side by side, with the same keypad input, and the
+// whole machine is compared after every frame. Halfway through, a byte of
+// the code about to run is written over on both, so the translated side
+// has to notice and fall back to the interpreter. Then both are timed on
+// their own, unless it was run with --check (as ctest does).
+//
+// Build: cmake --build build --target bench_aot
+// Usage: ./bench_aot [--check] [frames]
+#define _POSIX_C_SOURCE 200809L  // clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "chip8.h"
+
+#define CYCLES_PER_FRAME (CHIP8_DEFAULT_CPU_HZ / CHIP8_TIMER_HZ)
+
+extern const Chip8AotProgram aot_pong1, aot_pong, aot_tetris, aot_invaders, aot_nim;
+
+static const Chip8AotProgram *programs[] = {
+    &aot_pong1, &aot_pong, &aot_tetris, &aot_invaders, &aot_nim,
+};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Keys held in `frame`: one key at a time, changing every half second
+static void set_keys(Chip8 *chip8, long frame) {
+    for (int key = 0; key < 16; key++) {
+        chip8->keypad[key] = key == (frame / 30) % 16 && (frame / 7) % 3 != 0;
+    }
+}
+
+// A fresh machine with the program's ROM and quirks
+static int start(Chip8 *chip8, const Chip8AotProgram *program) {
+    chip8_init(chip8);
+    chip8_seed(chip8, 1);
+    return chip8_set_quirks(chip8, (Chip8Quirks)program->quirks) &&
+           chip8_load_rom_buffer(chip8, program->rom, program->rom_size);
+}
+
+// One frame on `engine` (NULL: chip8_cycle)
+static void run_frame(Chip8 *chip8, Chip8RunFn engine, void *context, long frame) {
+    set_keys(chip8, frame);
+    if (engine) {
+        engine(context, chip8, CYCLES_PER_FRAME);
+    }
+    else {
+        for (int c = 0; c < CYCLES_PER_FRAME; c++) {
+            chip8_cycle(chip8);
+        }
+    }
+    chip8_tick_timers(chip8);
+}
+
+// Run `program` both ways for `frames` frames. Returns 0 on a difference.
+static int check(const Chip8AotProgram *program, long frames) {
+    static Chip8 reference, translated;
+    if (!start(&reference, program)) {
+        return 0;
+    }
+    chip8_fork(&translated, &reference);
+    Chip8RunFn interpret = chip8_machine_engine(&reference);
+    Chip8Aot *aot = chip8_aot_create(program);
+    if (!aot) {
+        return 0;
+    }
+
+    Chip8AotStats patched = { 0 };
+    int ok = 1;
+    for (long f = 0; f < frames && ok; f++) {
+        if (f == frames / 2) {
+            // Write over the code about to run, as a ROM that modifies
+            // itself would (through FX33/FX55 the translation would see it
+            // by itself; from out here it has to be told)
+            uint16_t addr = (reference.pc + 1) % CHIP8_MEMORY_SIZE;
+            uint8_t value = chip8_mem_read(&reference, addr) ^ 0x01;
+            chip8_mem_write(&reference, addr, value);
+            chip8_mem_write(&translated, addr, value);
+            chip8_aot_invalidate(aot, addr, 1);
+            chip8_aot_get_stats(aot, &patched);
+        }
+        run_frame(&reference, interpret, NULL, f);
+        run_frame(&translated, chip8_aot_run, aot, f);
+        if (chip8_state_hash(&reference) != chip8_state_hash(&translated)) {
+            printf("FAIL: %s differs from the interpreter in frame %ld\n", program->name, f);
+            printf("-- interpreter --\n");
+            chip8_dump_state(&reference, stdout);
+            printf("-- translated --\n");
+            chip8_dump_state(&translated, stdout);
+            ok = 0;
+        }
+    }
+
+    Chip8AotStats stats;
+    chip8_aot_get_stats(aot, &stats);
+    if (ok && stats.interpreted_cycles == patched.interpreted_cycles) {
+        printf("FAIL: %s never fell back to the interpreter after its code was written over\n", program->name);
+        ok = 0;
+    }
+    if (ok) {
+        printf("%-40s %10llu %10llu %10llu\n", program->name, (unsigned long long)patched.native_cycles,
+               (unsigned long long)patched.interpreted_cycles,
+               (unsigned long long)(stats.interpreted_cycles - patched.interpreted_cycles));
+    }
+    chip8_aot_destroy(aot);
+    chip8_free(&reference);
+    chip8_free(&translated);
+    return ok;
+}
+
+// Instructions/second for `program` on `engine` over `frames` frames
+static double rate(const Chip8AotProgram *program, Chip8RunFn engine, void *context, long frames) {
+    static Chip8 chip8;
+    start(&chip8, program);
+    double begin = now_seconds();
+    for (long f = 0; f < frames; f++) {
+        run_frame(&chip8, engine, context, f);
+    }
+    double seconds = now_seconds() - begin;
+    chip8_free(&chip8);
+    return frames * (double)CYCLES_PER_FRAME / seconds;
+}
+
+int main(int argc, char *argv[]) {
+    int check_only = argc > 1 && strcmp(argv[1], "--check") == 0;
+    if (check_only) {
+        argv++;
+        argc--;
+    }
+    long frames = argc > 1 ? atol(argv[1]) : check_only ? 2000 : 20000;
+    int count = (int)(sizeof(programs) / sizeof(programs[0]));
+
+    printf("%ld frames each, code written over after frame %ld\n", frames, frames / 2);
+    printf("%-40s %10s %10s %10s\n", "ROM", "native", "interp", "after");
+    for (int i = 0; i < count; i++) {
+        if (!check(programs[i], frames)) {
+            return 1;
+        }
+    }
+    printf("Every translation matches its interpreter frame for frame\n\n");
+    if (check_only) {
+        return 0;
+    }
+
+    printf("%-40s %14s %14s %8s\n", "ROM", "interp ips", "aot ips", "speedup");
+    for (int i = 0; i < count; i++) {
+        Chip8 probe;
+        start(&probe, programs[i]);
+        Chip8RunFn interpret = chip8_machine_engine(&probe);
+        chip8_free(&probe);
+        Chip8Aot *aot = chip8_aot_create(programs[i]);
+        if (!aot) {
+            return 1;
+        }
+        double interpreted = rate(programs[i], interpret, NULL, frames * 10);
+        double translated = rate(programs[i], chip8_aot_run, aot, frames * 10);
+        printf("%-40s %14.0f %14.0f %7.2fx\n", programs[i]->name, interpreted, translated, translated / interpreted);
+        chip8_aot_destroy(aot);
+    }
+    return 0;
+}
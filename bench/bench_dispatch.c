@@ -0,0 +1,428 @@
+// Dispatch microbenchmark
+// Runs the bundled ROMs through the old if/else decoder, the table-driven
+// chip8_execute and the pre-decoded instruction cache and prints
+// instructions/second for each. Before timing anything it also checks that
+// the decoders agree on all 65536 opcodes, and afterwards that every ROM
+// ends in the same state whichever way it was run. With --check it only
+// does the checks, on a short run, and prints no timings (ctest runs it
+// this way).
+//
+// Build: cmake --build build --target bench_dispatch
+// Usage: ./bench_dispatch [--check] [cycles] [rom ...]
+#define _POSIX_C_SOURCE 200809L  // clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "chip8.h"
+
+// Where the bundled ROMs live (set by CMake to the source directory)
+#ifndef CHIP8_ROM_DIR
+#define CHIP8_ROM_DIR "."
+#endif
+
+// The original decoder, kept as the reference to compare against. The only
+// changes are that CXNN now draws from the per-instance generator, and DXYN
+// still goes pixel by pixel but on the packed display, reading VX/VY before
+// VF is cleared (DXYN with X or Y = F used to see its own collision flag).
+static void chip8_execute_chain(Chip8 *chip8, uint16_t opcode) {
+    if (opcode == 0x00E0) {
+        memset(chip8->display, 0, sizeof(chip8->display));
+    }
+    else if ((opcode & 0xF000) == 0x6000) {
+        uint8_t x = (opcode & 0x0F00) >> 8;
+        uint8_t nn = opcode & 0x00FF;
+        chip8->V[x] = nn; 
+    }
+    else if ((opcode & 0xF000) == 0x7000) {
+        uint8_t x = (opcode & 0x0F00) >> 8;
+        uint8_t nn = opcode & 0x00FF;
+        chip8->V[x] += nn;
+    }
+    else if ((opcode & 0xF000) == 0x1000) {
+        uint16_t nnn = opcode & 0x0FFF;
+        chip8->pc = nnn; //we incremented pc by 2 in fetch, so we jump by setting nnn.
+    }
+    else if ((opcode & 0xF000) == 0x2000) { // to jump to subroutine
+        uint16_t nnn = opcode & 0x0FFF;
+        chip8->stack[chip8->sp & 0xF] = chip8->pc;
+        chip8->sp++;
+        chip8->pc = nnn;
+    }
+    else if (opcode == 0x00EE) {
+        chip8->sp--;
+        chip8->pc = chip8->stack[chip8->sp & 0xF];
+    }
+    else if ((opcode & 0xF000) == 0x3000) { //skipping
+        uint8_t x = (opcode & 0x0F00) >> 8;
+        uint8_t nn = opcode & 0x00FF;
+        if (chip8->V[x]  == nn) {
+            chip8->pc += 2;             
+        }
+    }
+    else if ((opcode & 0xF000) == 0x4000) {
+        uint8_t x = (opcode & 0x0F00) >> 8;
+        uint8_t nn = opcode & 0x00FF;
+        if (chip8->V[x] != nn) {
+            chip8->pc += 2;             
+        }
+    }
+    else if ((opcode & 0xF00F) == 0x5000) {
+        uint8_t x = (opcode & 0x0F00) >> 8;
+        uint8_t y = (opcode & 0x00F0) >> 4;
+        if (chip8->V[x] == chip8->V[y]) {
+            chip8->pc += 2;             
+        }
+    }
+    else if ((opcode & 0xF00F) == 0x9000) {
+        uint8_t x = (opcode & 0x0F00) >> 8;
+        uint8_t y = (opcode & 0x00F0) >> 4;
+        if (chip8->V[x] != chip8->V[y]) {
+            chip8->pc += 2;             
+        }
+    }
+    else if((opcode & 0xF000) == 0x8000) {
+        uint8_t x = (opcode & 0x0F00) >> 8;
+        uint8_t y = (opcode & 0x00F0) >> 4;
+        uint8_t z = opcode & 0x000F;
+        
+        switch (z) {
+            case 0:
+                chip8->V[x] = chip8->V[y];
+            break;
+            case 1:
+                chip8->V[x] = (chip8->V[x]) | (chip8->V[y]);
+            break;
+            case 2:
+                chip8->V[x] = (chip8->V[x]) & (chip8->V[y]);
+            break;
+            case 3:
+                chip8->V[x] = (chip8->V[x]) ^ (chip8->V[y]);
+            break;
+            case 4:
+                uint16_t sum = chip8->V[x] + chip8->V[y];  
+                chip8->V[0xF] = (sum > 255) ? 1 : 0;      
+                chip8->V[x] = sum & 0xFF; 
+            break;
+            case 5:
+            /*uint8_t sub;    
+            if(chip8->V[x] < chip8->V[y]){
+                    sub = chip8->V[x] - chip8->V[y] + 0xFF;
+                    chip8->V[0xF] = 0x0;
+                }
+            else if(chip8->V[x] > chip8->V[y]){
+                    sub = chip8->V[x] - chip8->V[y];
+                    chip8->V[0xF] = 0x1;
+            } */
+            chip8->V[0xF] = (chip8->V[x] >= chip8->V[y]) ? 1 : 0;
+            chip8->V[x] = chip8->V[x] - chip8->V[y];
+            break;
+            case 6:
+                chip8->V[0xF] = chip8->V[x] & 0x01;
+                chip8->V[x] = chip8->V[x]>>1;
+            break;
+            case 7:
+            /*uint8_t sub;    
+            if(chip8->V[y] < chip8->V[x]){
+                    sub = chip8->V[y] - chip8->V[x] + 0xFF;
+                    chip8->V[0xF] = 0x0;
+                }
+            else if(chip8->V[y] > chip8->V[x]){
+                    sub = chip8->V[y] - chip8->V[x];
+                    chip8->V[0xF] = 0x1;
+            } */   
+            chip8->V[0xF] = (chip8->V[y] >= chip8->V[x]) ? 1 : 0;  
+            chip8->V[x] = chip8->V[y] - chip8->V[x];
+            break;
+        }
+    }
+    else if((opcode & 0xF000) == 0xA000) {
+        uint16_t nnn = opcode & 0x0FFF;
+        chip8->I = nnn;
+    }
+    else if((opcode & 0xF000) == 0xB000) {
+        uint16_t nnn = opcode & 0x0FFF;
+        chip8->pc = nnn + chip8->V[0];
+    }
+    else if((opcode & 0xF000) == 0xC000) {
+        uint8_t nn = opcode & 0x00FF;
+        uint8_t x = (opcode & 0x0F00) >> 8;
+        chip8->V[x] = chip8_random_byte(chip8) & nn;
+    }
+    else if((opcode & 0xF000) == 0xF000) {
+        uint8_t nn = opcode & 0x00FF;
+        uint8_t x = (opcode & 0x0F00) >> 8;
+        int i;
+        switch(nn) {
+            case 0x7:
+                chip8->V[x] = chip8->delay_timer;
+                break;
+            case 0x15:
+                chip8->delay_timer = chip8->V[x];
+                break;
+            case 0x18:
+                chip8->sound_timer = chip8->V[x];
+                break;
+            case 0x1E:
+                chip8->I += chip8->V[x];
+                break;
+            case 0x29:
+                chip8->I = chip8->V[x] * 5; //cuz character is 5 bytes tall
+                break;
+            case 0x33:
+                chip8_mem_write(chip8, chip8->I, chip8->V[x]/100);
+                chip8_mem_write(chip8, chip8->I +1, (chip8->V[x]/10)%10);
+                chip8_mem_write(chip8, chip8->I +2, chip8->V[x]%10);
+                break;
+            case 0x55:
+                i = 0;
+                while(i<=x){
+                    chip8_mem_write(chip8, chip8->I + i, chip8->V[i]);
+                    i++;
+                }
+                break;
+            case 0x65:
+                i = 0;
+                while(i<=x){
+                    chip8->V[i] = chip8_mem_read(chip8, chip8->I + i);
+                    i++;
+                }
+                break;
+            case 0x0A: {
+                // Check if any key is pressed
+                int key_pressed = -1;  // -1 means no key pressed yet
+                for (i = 0; i < 16; i++) {
+                    if (chip8->keypad[i]) {
+                        key_pressed = i;
+                        break;
+                    }
+                }
+
+                if (key_pressed != -1) {
+                    // A key was pressed! Store it and continue
+                    chip8->V[x] = key_pressed;
+                } else {
+                    // No key pressed yet - repeat this instruction
+                    chip8->pc -= 2;  // Go back 2 bytes to re-execute this opcode
+                }
+                break;
+            }
+        }
+
+    }
+    else if ((opcode & 0xF0FF) == 0xE09E) {
+        uint8_t x = (opcode & 0x0F00) >> 8;
+        uint8_t key = chip8->V[x] & 0xF;
+        if (chip8->keypad[key]) {
+            chip8->pc += 2; //skip next instruction
+        }
+    }
+    else if ((opcode & 0xF0FF) == 0xE0A1) {
+        uint8_t x = (opcode & 0x0F00) >> 8;
+        uint8_t key = chip8->V[x] & 0xF;
+        if (!chip8->keypad[key]) {
+            chip8->pc += 2; //skip next instruction
+        }
+    }
+    else if ((opcode & 0xF000) == 0xD000){
+        uint8_t x = (opcode & 0x0F00) >> 8;
+        uint8_t y = (opcode & 0x00F0) >> 4;
+        uint8_t n = (opcode & 0x000F);
+        uint8_t vx = chip8->V[x];
+        uint8_t vy = chip8->V[y];
+        chip8->V[0xF] = 0;
+        int i,sprite_byte;
+        for(i=0;i < n; i++){
+            sprite_byte = chip8_mem_read(chip8, chip8->I + i);
+            for(int j=0; j < 8; j++){
+                if (sprite_byte & (0x80 >> j)){
+                    uint8_t x_pos = (vx + j) % 64;
+                    uint8_t y_pos = (vy + i) % 32;
+
+                    uint64_t pixel_bit = 1ULL << (63 - x_pos);
+
+                    if (chip8->display[y_pos] & pixel_bit) {
+                        chip8->V[0xF] = 1;  // Collision detected!
+                    }
+
+                    chip8->display[y_pos] ^= pixel_bit;
+                }
+            }
+        } 
+    }
+
+}
+
+// Fill in a random but sane machine state
+static void random_state(Chip8 *chip8, unsigned seed) {
+    uint8_t memory[CHIP8_MEMORY_SIZE];
+    srand(seed);
+    chip8_free(chip8);
+    memset(chip8, 0, sizeof(*chip8));
+    chip8_mem_init(chip8);
+    for (size_t i = 0; i < sizeof(memory); i++) {
+        memory[i] = rand() & 0xFF;
+    }
+    chip8_mem_write_block(chip8, 0, memory, sizeof(memory));
+    for (int i = 0; i < 16; i++) {
+        chip8->V[i] = rand() & 0xFF;
+        chip8->stack[i] = rand() & 0xFFF;
+        chip8->keypad[i] = rand() & 1;
+    }
+    for (int y = 0; y < CHIP8_DISPLAY_HEIGHT; y++) {
+        for (int x = 0; x < CHIP8_DISPLAY_WIDTH; x++) {
+            chip8->display[y] = (chip8->display[y] << 1) | (rand() & 1);
+        }
+    }
+    chip8->I = rand() % 0xF00;       // room for FX55/DXYN to read 16 bytes
+    chip8->pc = 0x200 + (rand() % 0xD00);
+    chip8->sp = 1 + rand() % 14;     // room to call and return
+    chip8->delay_timer = rand() & 0xFF;
+    chip8->sound_timer = rand() & 0xFF;
+    chip8->rng_state = rand() | 1;
+}
+
+// Same registers, display and memory? Pages that are still shared
+// are equal without looking at them.
+static int same_state(const Chip8 *a, const Chip8 *b) {
+    Chip8 x = *a, y = *b;
+    memset(x.pages, 0, sizeof(x.pages));
+    memset(y.pages, 0, sizeof(y.pages));
+    if (memcmp(&x, &y, sizeof(Chip8)) != 0) {
+        return 0;
+    }
+    for (int p = 0; p < CHIP8_PAGE_COUNT; p++) {
+        if (a->pages[p] != b->pages[p] &&
+            memcmp(a->pages[p], b->pages[p], CHIP8_PAGE_SIZE) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Run every opcode through both decoders from a few random states
+static int check_all_opcodes(void) {
+    static Chip8 start, a, b;
+    int mismatches = 0;
+
+    for (unsigned seed = 1; seed <= 8; seed++) {
+        random_state(&start, seed);
+        for (uint32_t opcode = 0; opcode <= 0xFFFF; opcode++) {
+            chip8_fork(&a, &start);
+            chip8_fork(&b, &start);
+            chip8_execute_chain(&a, opcode);
+            chip8_execute(&b, opcode);
+            // The reference decoder knows nothing about dirty rows
+            a.dirty_rows = b.dirty_rows;
+            if (!same_state(&a, &b)) {
+                if (mismatches < 10) {
+                    printf("Mismatch: opcode 0x%04X (seed %u)\n", opcode, seed);
+                }
+                mismatches++;
+            }
+            chip8_free(&a);
+            chip8_free(&b);
+        }
+    }
+    chip8_free(&start);
+    return mismatches;
+}
+
+// chip8_cycle with the old decoder, as a scheduler engine
+static uint64_t run_chain(void *context, Chip8 *chip8, uint64_t cycles) {
+    (void)context;
+    for (uint64_t i = 0; i < cycles; i++) {
+        uint16_t opcode = chip8_fetch(chip8);
+        chip8_execute_chain(chip8, opcode);
+    }
+    return cycles;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Time one ROM on one engine (NULL = chip8_cycle), returns instructions/second
+static double bench_rom(const char *rom, Chip8RunFn engine, void *context, long cycles, Chip8 *out) {
+    chip8_init(out);
+    chip8_seed(out, 1);
+    if (!chip8_load_rom(out, rom)) {
+        return 0;
+    }
+    Chip8Scheduler sched;
+    chip8_sched_init(&sched, CHIP8_DEFAULT_CPU_HZ);
+    chip8_sched_set_engine(&sched, engine, context);
+
+    double start = now_seconds();
+    chip8_sched_run_cycles(&sched, out, cycles);
+    double elapsed = now_seconds() - start;
+    return cycles / elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    const char *default_roms[] = {
+        CHIP8_ROM_DIR "/Pong [Paul Vervalin, 1990].ch8",
+        CHIP8_ROM_DIR "/Tetris [Fran Dachille, 1991].ch8",
+        CHIP8_ROM_DIR "/Space Invaders [David Winter] (alt).ch8"
+    };
+    long cycles = 20000000;
+    const char **roms = default_roms;
+    int rom_count = 3;
+    int check_only = 0;
+
+    if (argc > 1 && strcmp(argv[1], "--check") == 0) {
+        check_only = 1;
+        cycles = 300000;
+        argv++;
+        argc--;
+    }
+    if (argc > 1) {
+        cycles = atol(argv[1]);
+    }
+    if (argc > 2) {
+        roms = (const char **)&argv[2];
+        rom_count = argc - 2;
+    }
+
+    int mismatches = check_all_opcodes();
+    if (mismatches) {
+        printf("FAIL: %d opcode mismatches between decoders\n", mismatches);
+        return 1;
+    }
+    printf("All 65536 opcodes match the reference decoder\n\n");
+
+    static Chip8DecodeCache cache;
+    if (!check_only) {
+        printf("%-42s %14s %14s %14s %8s\n", "ROM", "chain ips", "table ips", "cached ips", "speedup");
+    }
+    for (int r = 0; r < rom_count; r++) {
+        Chip8 chain, table, cached;
+        double chain_ips = bench_rom(roms[r], run_chain, NULL, cycles, &chain);
+        double table_ips = bench_rom(roms[r], NULL, NULL, cycles, &table);
+        chip8_decode_cache_clear(&cache);
+        double cached_ips = bench_rom(roms[r], chip8_decode_cache_run, &cache, cycles, &cached);
+        if (chain_ips == 0 || table_ips == 0 || cached_ips == 0) {
+            return 1;
+        }
+        uint64_t table_hash = chip8_state_hash(&table);
+        if (chip8_state_hash(&chain) != table_hash || chip8_state_hash(&cached) != table_hash) {
+            printf("FAIL: %s ends in a different state\n", roms[r]);
+            return 1;
+        }
+        chip8_free(&chain);
+        chip8_free(&table);
+        chip8_free(&cached);
+        const char *name = strrchr(roms[r], '/') ? strrchr(roms[r], '/') + 1 : roms[r];
+        if (check_only) {
+            printf("%s ends in the same state on every decoder\n", name);
+        }
+        else {
+            printf("%-42s %14.0f %14.0f %14.0f %7.2fx\n", name, chain_ips, table_ips, cached_ips, cached_ips / chain_ips);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,230 @@
+// State exploration benchmark
+// Explores what a ROM can do under every keypad input, breadth first: each
+// state is run one frame further with no key down and with each of the 16
+// keys held, and only states no thread has seen before (by chip8_state_key
+// in a shared Chip8VisitedSet) go on to the next frame. Runs the search on
+// 1 thread and on `threads`, checks both find the same number of states,
+// and prints states/second. Before that it checks chip8_state_key against
+// machines built up a different way, and times it next to chip8_state_hash.
+//
+// Build: cmake --build build --target bench_explore
+// Usage: ./bench_explore [frames] [threads] [rom]
+#define _POSIX_C_SOURCE 200809L  // clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "chip8.h"
+
+#ifndef CHIP8_ROM_DIR
+#define CHIP8_ROM_DIR "."
+#endif
+
+#define CYCLES_PER_FRAME (CHIP8_DEFAULT_CPU_HZ / CHIP8_TIMER_HZ)
+#define BRANCHES 17                 // no key, or one of the 16 held
+#define MAX_STATES 2000000          // visited set size, and the most a frame may hold
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Keep the compiler from dropping work whose result is never read
+static volatile uint64_t sink;
+
+// One frame of the search, shared by the worker threads
+typedef struct {
+    Chip8 *current;
+    long current_count;
+    _Atomic long next_current;      // next state in `current` to expand
+    Chip8 *next;
+    _Atomic long next_count;
+    Chip8VisitedSet *visited;
+    _Atomic long overflow;          // new states that didn't fit in `next`
+} Frontier;
+
+static void *expand(void *arg) {
+    Frontier *f = arg;
+    long i;
+    while ((i = atomic_fetch_add(&f->next_current, 1)) < f->current_count) {
+        for (int branch = 0; branch < BRANCHES; branch++) {
+            Chip8 child;
+            chip8_fork(&child, &f->current[i]);
+            memset(child.keypad, 0, sizeof(child.keypad));
+            if (branch > 0) {
+                child.keypad[branch - 1] = 1;
+            }
+            for (int c = 0; c < CYCLES_PER_FRAME; c++) {
+                chip8_cycle(&child);
+            }
+            chip8_tick_timers(&child);
+
+            if (chip8_visited_insert(f->visited, chip8_state_key(&child)) != 1) {
+                chip8_free(&child);
+                continue;
+            }
+            long slot = atomic_fetch_add(&f->next_count, 1);
+            if (slot >= MAX_STATES) {
+                atomic_fetch_add(&f->overflow, 1);
+                chip8_free(&child);
+                continue;
+            }
+            f->next[slot] = child;  // its pages move over
+        }
+        chip8_free(&f->current[i]);
+    }
+    return NULL;
+}
+
+// Explore `frames` frames from `start` on `threads` threads. Returns the
+// number of distinct states found, or -1 if the search ran out of room.
+static long explore(const Chip8 *start, int frames, int threads, double *seconds) {
+    static Frontier f;
+    f.current = malloc(MAX_STATES * sizeof(Chip8));
+    f.next = malloc(MAX_STATES * sizeof(Chip8));
+    f.visited = chip8_visited_create(MAX_STATES);
+    if (!f.current || !f.next || !f.visited) {
+        printf("Error: Out of memory for the search\n");
+        exit(1);
+    }
+    chip8_fork(&f.current[0], start);
+    f.current_count = 1;
+    chip8_visited_insert(f.visited, chip8_state_key(start));
+    atomic_store(&f.overflow, 0);
+
+    double begin = now_seconds();
+    for (int frame = 0; frame < frames && f.current_count > 0; frame++) {
+        atomic_store(&f.next_current, 0);
+        atomic_store(&f.next_count, 0);
+        pthread_t workers[64];
+        for (int t = 0; t < threads; t++) {
+            pthread_create(&workers[t], NULL, expand, &f);
+        }
+        for (int t = 0; t < threads; t++) {
+            pthread_join(workers[t], NULL);
+        }
+        long count = atomic_load(&f.next_count);
+        Chip8 *swap = f.current;
+        f.current = f.next;
+        f.next = swap;
+        f.current_count = count < MAX_STATES ? count : MAX_STATES;
+    }
+    *seconds = now_seconds() - begin;
+
+    for (long i = 0; i < f.current_count; i++) {
+        chip8_free(&f.current[i]);
+    }
+    long found = atomic_load(&f.overflow) ? -1 : (long)chip8_visited_count(f.visited);
+    chip8_visited_destroy(f.visited);
+    free(f.current);
+    free(f.next);
+    return found;
+}
+
+// chip8_state_key has to agree with itself however a machine got to its
+// state, and to notice any change
+static int check_keys(Chip8 *chip8) {
+    static uint8_t buffer[CHIP8_STATE_SIZE];
+    static Chip8 restored, forked;
+    uint64_t key = chip8_state_key(chip8);
+
+    // A saved and loaded copy writes all of its memory in one go
+    size_t size = chip8_save_state(chip8, buffer, sizeof(buffer));
+    chip8_init(&restored);
+    if (!chip8_load_state(&restored, buffer, size) || chip8_state_key(&restored) != key) {
+        printf("FAIL: a saved and loaded copy has a different key\n");
+        return 0;
+    }
+    chip8_fork(&forked, chip8);
+    chip8_mem_write(&forked, 0x300, chip8_mem_read(chip8, 0x300) ^ 1);
+    if (chip8_state_key(&forked) == key) {
+        printf("FAIL: changing one byte of memory didn't change the key\n");
+        return 0;
+    }
+    chip8_mem_write(&forked, 0x300, chip8_mem_read(chip8, 0x300));
+    if (chip8_state_key(&forked) != key) {
+        printf("FAIL: putting the byte back didn't give the old key back\n");
+        return 0;
+    }
+    forked.display[7] ^= 1;
+    if (chip8_state_key(&forked) == key) {
+        printf("FAIL: changing a pixel didn't change the key\n");
+        return 0;
+    }
+    chip8_free(&forked);
+    chip8_free(&restored);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    int frames = 12;
+    int threads = 4;
+    const char *rom = CHIP8_ROM_DIR "/Tetris [Fran Dachille, 1991].ch8";
+    if (argc > 1) {
+        frames = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        threads = atoi(argv[2]);
+    }
+    if (argc > 3) {
+        rom = argv[3];
+    }
+    if (threads < 1 || threads > 64) {
+        printf("Error: threads must be 1 to 64\n");
+        return 1;
+    }
+
+    // Start a little way into the game, after a few stores to memory
+    static Chip8 chip8;
+    chip8_init(&chip8);
+    chip8_seed(&chip8, 1);
+    if (!chip8_load_rom(&chip8, rom)) {
+        return 1;
+    }
+    chip8_run_headless(&chip8, NULL, 20000, 0);
+    if (!check_keys(&chip8)) {
+        return 1;
+    }
+    printf("State keys agree with saved and loaded copies\n\n");
+
+    long iterations = 1000000;
+    double start = now_seconds();
+    for (long i = 0; i < iterations; i++) {
+        chip8.V[0] = (uint8_t)i;
+        sink = chip8_state_key(&chip8);
+    }
+    double key_ns = (now_seconds() - start) * 1e9 / iterations;
+    start = now_seconds();
+    for (long i = 0; i < iterations / 10; i++) {
+        chip8.V[0] = (uint8_t)i;
+        sink = chip8_state_hash(&chip8);
+    }
+    double hash_ns = (now_seconds() - start) * 1e9 / (iterations / 10);
+    printf("%-24s %10s\n", "operation", "ns/call");
+    printf("%-24s %10.1f\n", "chip8_state_key", key_ns);
+    printf("%-24s %10.1f\n\n", "chip8_state_hash", hash_ns);
+
+    double one_seconds, many_seconds;
+    long one = explore(&chip8, frames, 1, &one_seconds);
+    long many = explore(&chip8, frames, threads, &many_seconds);
+    chip8_free(&chip8);
+    if (one < 0 || many < 0) {
+        printf("FAIL: more than %d new states in one frame; try fewer frames\n", MAX_STATES);
+        return 1;
+    }
+    printf("%d frames, %d inputs per state\n", frames, BRANCHES);
+    printf("%-24s %10s %14s\n", "threads", "states", "states/s");
+    printf("%-24d %10ld %14.0f\n", 1, one, one / one_seconds);
+    printf("%-24d %10ld %14.0f\n", threads, many, many / many_seconds);
+    if (one != many) {
+        printf("FAIL: %d threads found %ld states, 1 thread %ld\n", threads, many, one);
+        return 1;
+    }
+    printf("\nSame states found on 1 and %d threads\n", threads);
+    return 0;
+}
@@ -0,0 +1,142 @@
+// Save state benchmark
+// Times chip8_save_state / chip8_load_state into and out of a memory
+// buffer, a fork, and a rewind snapshot and step back, and prints
+// nanoseconds per call and what a fork costs in memory. Before timing it checks that a state survives the round trip and
+// that a corrupt header is refused. With --check it stops after the checks
+// (ctest runs it this way).
+//
+// Build: cmake --build build --target bench_state
+// Usage: ./bench_state [--check] [iterations] [rom]
+#define _POSIX_C_SOURCE 200809L  // clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "chip8.h"
+
+#ifndef CHIP8_ROM_DIR
+#define CHIP8_ROM_DIR "."
+#endif
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Keep the compiler from dropping work whose result is never read
+static volatile uint8_t sink;
+
+int main(int argc, char *argv[]) {
+    long iterations = 1000000;
+    const char *rom = CHIP8_ROM_DIR "/Tetris [Fran Dachille, 1991].ch8";
+    int check_only = 0;
+    if (argc > 1 && strcmp(argv[1], "--check") == 0) {
+        check_only = 1;
+        argv++;
+        argc--;
+    }
+    if (argc > 1) {
+        iterations = atol(argv[1]);
+    }
+    if (argc > 2) {
+        rom = argv[2];
+    }
+
+    // Get the machine into an interesting state first
+    static Chip8 chip8, restored;
+    chip8_init(&chip8);
+    chip8_seed(&chip8, 1);
+    if (!chip8_load_rom(&chip8, rom)) {
+        return 1;
+    }
+    chip8_run_headless(&chip8, NULL, 100000, 0);
+    chip8.keypad[5] = 1;
+
+    static uint8_t buffer[CHIP8_STATE_SIZE];
+    if (chip8_save_state(&chip8, buffer, sizeof(buffer) - 1) != 0) {
+        printf("FAIL: saved into a buffer that is too small\n");
+        return 1;
+    }
+    size_t size = chip8_save_state(&chip8, buffer, sizeof(buffer));
+    chip8_init(&restored);
+    if (size != CHIP8_STATE_SIZE || !chip8_load_state(&restored, buffer, size) ||
+        chip8_state_hash(&restored) != chip8_state_hash(&chip8)) {
+        printf("FAIL: state changed on the way through save and load\n");
+        return 1;
+    }
+    buffer[0] ^= 0xFF;
+    if (chip8_load_state(&restored, buffer, size)) {
+        printf("FAIL: loaded a state with a bad header\n");
+        return 1;
+    }
+    buffer[0] ^= 0xFF;
+
+    Chip8Rewind rewind;
+    if (!chip8_rewind_init(&rewind, 64)) {
+        return 1;
+    }
+    chip8_rewind_push(&rewind, &chip8);
+    if (!chip8_rewind_pop(&rewind, &restored) || chip8_state_hash(&restored) != chip8_state_hash(&chip8) ||
+        chip8_rewind_pop(&rewind, &restored)) {
+        printf("FAIL: rewind didn't give back the snapshot\n");
+        return 1;
+    }
+    printf("Save state round trip OK (%d bytes)\n\n", CHIP8_STATE_SIZE);
+    if (check_only) {
+        chip8_rewind_free(&rewind);
+        chip8_free(&restored);
+        chip8_free(&chip8);
+        return 0;
+    }
+
+    double start = now_seconds();
+    for (long i = 0; i < iterations; i++) {
+        chip8.V[0] = (uint8_t)i;
+        chip8_save_state(&chip8, buffer, sizeof(buffer));
+        sink = buffer[4096];
+    }
+    double save_ns = (now_seconds() - start) * 1e9 / iterations;
+
+    start = now_seconds();
+    for (long i = 0; i < iterations; i++) {
+        buffer[4096] = (uint8_t)i;
+        chip8_load_state(&restored, buffer, sizeof(buffer));
+        sink = restored.V[0];
+    }
+    double load_ns = (now_seconds() - start) * 1e9 / iterations;
+
+    static Chip8 forked;
+    start = now_seconds();
+    for (long i = 0; i < iterations; i++) {
+        chip8_fork(&forked, &chip8);
+        sink = forked.V[0];
+        chip8_free(&forked);
+    }
+    double fork_ns = (now_seconds() - start) * 1e9 / iterations;
+
+    start = now_seconds();
+    for (long i = 0; i < iterations; i++) {
+        chip8.V[0] = (uint8_t)i;
+        chip8_rewind_push(&rewind, &chip8);
+        chip8_rewind_pop(&rewind, &restored);
+        sink = restored.V[0];
+    }
+    double rewind_ns = (now_seconds() - start) * 1e9 / iterations;
+    chip8_rewind_free(&rewind);
+
+    printf("%-24s %10s\n", "operation", "ns/call");
+    printf("%-24s %10.1f\n", "chip8_save_state", save_ns);
+    printf("%-24s %10.1f\n", "chip8_load_state", load_ns);
+    printf("%-24s %10.1f\n", "chip8_fork + chip8_free", fork_ns);
+    printf("%-24s %10.1f\n", "rewind push + pop", rewind_ns);
+    // Once nothing else shares them, the pages the ROM and the game wrote
+    // to are the machine's own; the rest are the static font and zero pages
+    chip8_free(&restored);
+    printf("\nChip8 is %zu bytes; the machine above owns %d of its %d pages of %d bytes\n",
+           sizeof(Chip8), chip8_mem_private_pages(&chip8), CHIP8_PAGE_COUNT, CHIP8_PAGE_SIZE);
+    chip8_free(&chip8);
+    return 0;
+}
@@ -0,0 +1,608 @@
+// Benchmark suite
+// Runs every bundled ROM headless for a fixed number of cycles with the
+// same scripted keypad input each time, and reports instructions/second,
+// ns/instruction, emulated frames/second and peak RSS. Each ROM runs
+// `--repeat` times and the fastest run counts, which irons out most of the
+// noise from other processes.
+//
+// Two checks, kept apart because only one of them travels between machines:
+// - --states FILE: every ROM has to end in the state recorded in FILE (a
+//   change in behaviour, or a workload that isn't reproducible). Final
+//   states don't depend on the host or the engine, so this file is checked
+//   in (bench/states.json, written with --write-states).
+// - --baseline FILE: any ROM that got more than `--tolerance` percent
+//   slower than FILE fails the run. Speeds only compare on the machine that
+//   recorded them, so if FILE doesn't exist yet this run is saved as the
+//   baseline instead. --json FILE writes the results in the same form.
+//
+// Then a scaling run: the same ROMs as a batch of jobs through
+// chip8_batch_run on 1, 2, 4, ... up to `--scaling` threads (default: the
+// CPUs online), reporting instructions/second and the speedup over one
+// thread, and checking every thread count ends each job in the same state.
+// Speedups only mean anything up to the number of cores, so these aren't
+// compared against the baseline. --scaling 0 skips it.
+//
+// Build and run: cmake --build build --target bench
+// Usage: ./bench_suite [--cycles N] [--hz N] [--repeat N] [--engine interp|cache|jit]
+//                      [--json FILE] [--baseline FILE] [--tolerance PERCENT]
+//                      [--states FILE] [--write-states FILE] [--scaling THREADS] [rom ...]
+#define _POSIX_C_SOURCE 200809L  // clock_gettime, sysconf
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "chip8.h"
+
+#ifndef CHIP8_ROM_DIR
+#define CHIP8_ROM_DIR "."
+#endif
+
+#define MAX_ROMS 64
+
+// Keypad script: every KEY_PERIOD cycles the next key in a fixed shuffle
+// goes down, and comes up half a period later. Enough to get past title
+// screens and keep the games that wait on FX0A moving.
+#define KEY_PERIOD 600
+
+// Scaling run: each ROM goes in the batch as SCALING_JOBS_PER_THREAD jobs
+// per thread of the largest count (with different seeds), each running
+// 1/SCALING_CYCLES_DIVISOR of --cycles. The batch is the same for every
+// thread count, with enough jobs that work stealing can even them out.
+#define SCALING_JOBS_PER_THREAD 4
+#define SCALING_CYCLES_DIVISOR 20
+#define MAX_SCALING_RUNS 16
+
+typedef struct {
+    const char *rom;
+    long cycles;
+    double seconds;                 // fastest run
+    double ips;
+    double ns_per_instruction;
+    double fps;                     // emulated 60 Hz frames per host second
+    long peak_rss_kb;
+    uint64_t state_hash;
+} Result;
+
+typedef struct {
+    int threads;
+    double seconds;                 // fastest run
+    double ips;                     // over all the jobs
+    double speedup;                 // over one thread
+} ScalingResult;
+
+typedef struct {
+    char rom[256];
+    long cycles;
+    double ips;                     // 0 in a states file
+    uint64_t state_hash;
+} BaselineEntry;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long peak_rss_kb(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return usage.ru_maxrss;  // kilobytes on Linux
+}
+
+static const char *base_name(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+// Read the ROM once up front, so the runs don't interleave "Loaded ROM"
+// lines with the table
+static size_t read_rom(const char *filename, uint8_t *rom) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        printf("Error: Could not open file %s\n", filename);
+        return 0;
+    }
+    size_t size = fread(rom, 1, CHIP8_MAX_ROM_SIZE + 1, file);
+    fclose(file);
+    if (size == 0 || size > CHIP8_MAX_ROM_SIZE) {
+        printf("Error: %s is empty or too large\n", filename);
+        return 0;
+    }
+    return size;
+}
+
+// The same keypad script for every ROM
+static int make_script(Chip8InputScript *script, long cycles) {
+    int presses = (int)(cycles / KEY_PERIOD);
+    script->events = malloc((2 * presses + 1) * sizeof(Chip8InputEvent));
+    script->count = 0;
+    if (!script->events) {
+        printf("Error: Out of memory for the input script\n");
+        return 0;
+    }
+    for (int i = 0; i < presses; i++) {
+        uint8_t key = (i * 7 + 5) % 16;
+        script->events[script->count++] = (Chip8InputEvent){ (long)i * KEY_PERIOD, key, 1 };
+        script->events[script->count++] = (Chip8InputEvent){ (long)i * KEY_PERIOD + KEY_PERIOD / 2, key, 0 };
+    }
+    return 1;
+}
+
+// Run `rom` once and keep the run in `result` if it was the fastest yet
+static int bench_rom(const char *rom, const char *engine, long cycles, uint64_t cpu_hz,
+                     const Chip8InputScript *script, Result *result) {
+    static Chip8DecodeCache cache;
+    uint8_t rom_data[CHIP8_MAX_ROM_SIZE + 1];
+    size_t rom_size = read_rom(rom, rom_data);
+    if (rom_size == 0) {
+        return 0;
+    }
+
+    Chip8 chip8;
+    chip8_init(&chip8);
+    chip8_seed(&chip8, 1);
+    if (!chip8_load_rom_buffer(&chip8, rom_data, rom_size)) {
+        chip8_free(&chip8);
+        return 0;
+    }
+
+    Chip8HeadlessRun run;
+    chip8_headless_begin(&run, script, cpu_hz);
+    Chip8Jit *jit = NULL;
+    if (strcmp(engine, "cache") == 0) {
+        chip8_decode_cache_clear(&cache);
+        chip8_sched_set_engine(&run.sched, chip8_decode_cache_run, &cache);
+    }
+    else if (strcmp(engine, "jit") == 0) {
+        jit = chip8_jit_create();
+        if (!jit) {
+            printf("Error: JIT not available on this host\n");
+            chip8_free(&chip8);
+            return 0;
+        }
+        chip8_sched_set_engine(&run.sched, chip8_jit_run, jit);
+    }
+
+    double start = now_seconds();
+    chip8_headless_step(&chip8, &run, cycles);
+    double elapsed = now_seconds() - start;
+
+    uint64_t state_hash = chip8_state_hash(&chip8);
+    chip8_jit_destroy(jit);
+    chip8_free(&chip8);
+    if (result->seconds != 0 && state_hash != result->state_hash) {
+        printf("Error: %s ended in a different state on the same input\n", rom);
+        return 0;
+    }
+
+    if (result->seconds == 0 || elapsed < result->seconds) {
+        result->rom = rom;
+        result->cycles = cycles;
+        result->seconds = elapsed;
+        result->ips = cycles / elapsed;
+        result->ns_per_instruction = elapsed * 1e9 / cycles;
+        result->fps = run.sched.timer_ticks / elapsed;
+    }
+    result->state_hash = state_hash;
+    result->peak_rss_kb = peak_rss_kb();
+    return 1;
+}
+
+static int cpu_count(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+// Run the scaling batch on 1, 2, 4, ... `max_threads` threads (and
+// `max_threads` itself), `repeat` times each. Fills in `scaling` and returns
+// how many thread counts ran, or 0 on an error.
+static int bench_scaling(const char **roms, int rom_count, long cycles, uint64_t cpu_hz,
+                         const Chip8InputScript *script, int max_threads, int repeat, ScalingResult *scaling) {
+    int jobs_per_rom = SCALING_JOBS_PER_THREAD * max_threads;
+    int job_count = rom_count * jobs_per_rom;
+    long job_cycles = cycles / SCALING_CYCLES_DIVISOR > 0 ? cycles / SCALING_CYCLES_DIVISOR : 1;
+    uint8_t (*rom_data)[CHIP8_MAX_ROM_SIZE + 1] = malloc(rom_count * sizeof(*rom_data));
+    Chip8BatchJob *jobs = calloc(job_count, sizeof(Chip8BatchJob));
+    Chip8BatchResult *first = calloc(job_count, sizeof(Chip8BatchResult));
+    Chip8BatchResult *results = calloc(job_count, sizeof(Chip8BatchResult));
+    int runs = 0;
+    if (!rom_data || !jobs || !first || !results) {
+        printf("Error: Out of memory for the scaling run\n");
+        goto done;
+    }
+    for (int i = 0; i < rom_count; i++) {
+        size_t rom_size = read_rom(roms[i], rom_data[i]);
+        if (rom_size == 0) {
+            goto done;
+        }
+        for (int j = 0; j < jobs_per_rom; j++) {
+            Chip8BatchJob *job = &jobs[i * jobs_per_rom + j];
+            job->rom = rom_data[i];
+            job->rom_size = rom_size;
+            job->script = script;
+            job->cycles = job_cycles;
+            job->cpu_hz = cpu_hz;
+            job->seed = (unsigned int)j + 1;
+        }
+    }
+
+    int online = cpu_count();
+    printf("\nBatch scaling: %d jobs of %ld cycles through chip8_batch_run, best of %d (%d CPU%s online)\n\n",
+           job_count, job_cycles, repeat, online, online == 1 ? "" : "s");
+    printf("%-8s %10s %14s %8s %11s\n", "threads", "seconds", "ips", "speedup", "efficiency");
+    for (int threads = 1; runs < MAX_SCALING_RUNS; threads = threads * 2 < max_threads ? threads * 2 : max_threads) {
+        ScalingResult *result = &scaling[runs];
+        result->threads = threads;
+        result->seconds = 0;
+        for (int r = 0; r < repeat; r++) {
+            double start = now_seconds();
+            int ok = chip8_batch_run(jobs, results, job_count, threads, 0);
+            double elapsed = now_seconds() - start;
+            if (!ok) {
+                goto done;
+            }
+            // Every job has to end in the same state on every thread count
+            Chip8BatchResult *expected = runs == 0 && r == 0 ? NULL : first;
+            long total_cycles = 0;
+            for (int j = 0; j < job_count; j++) {
+                if (!results[j].ok || (expected && results[j].state_hash != expected[j].state_hash)) {
+                    printf("Error: job %d (%s) ended differently on %d threads\n", j,
+                           base_name(roms[j / jobs_per_rom]), threads);
+                    runs = 0;
+                    goto done;
+                }
+                total_cycles += results[j].cycles;
+            }
+            if (!expected) {
+                memcpy(first, results, job_count * sizeof(Chip8BatchResult));
+            }
+            if (result->seconds == 0 || elapsed < result->seconds) {
+                result->seconds = elapsed;
+                result->ips = total_cycles / elapsed;
+            }
+        }
+        result->speedup = scaling[0].seconds / result->seconds;
+        printf("%-8d %10.3f %14.0f %7.2fx %10.0f%%%s\n", threads, result->seconds, result->ips, result->speedup,
+               100 * result->speedup / threads, threads > online ? "  (more threads than CPUs)" : "");
+        runs++;
+        if (threads == max_threads) {
+            break;
+        }
+    }
+
+done:
+    free(rom_data);
+    free(jobs);
+    free(first);
+    free(results);
+    return runs;
+}
+
+// Write the results, or with `engine` NULL only what a states file needs
+// (no timings, which would only be true of this machine)
+static int write_json(const char *filename, const Result *results, int count, const char *engine, uint64_t cpu_hz,
+                      const ScalingResult *scaling, int scaling_count) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        printf("Error: Could not open %s for writing\n", filename);
+        return 0;
+    }
+    fprintf(file, "{\n");
+    if (engine) {
+        fprintf(file, "  \"engine\": \"%s\",\n", engine);
+    }
+    fprintf(file, "  \"cpu_hz\": %llu,\n", (unsigned long long)cpu_hz);
+    fprintf(file, "  \"results\": [\n");
+    for (int i = 0; i < count; i++) {
+        const Result *r = &results[i];
+        // One ROM per line, which is what read_baseline expects
+        if (engine) {
+            fprintf(file, "    { \"rom\": \"%s\", \"cycles\": %ld, \"seconds\": %.6f, \"ips\": %.0f, "
+                    "\"ns_per_instruction\": %.3f, \"fps\": %.0f, \"peak_rss_kb\": %ld, \"state_hash\": \"0x%016llX\" }%s\n",
+                    base_name(r->rom), r->cycles, r->seconds, r->ips, r->ns_per_instruction, r->fps, r->peak_rss_kb,
+                    (unsigned long long)r->state_hash, i + 1 < count ? "," : "");
+        }
+        else {
+            fprintf(file, "    { \"rom\": \"%s\", \"cycles\": %ld, \"state_hash\": \"0x%016llX\" }%s\n",
+                    base_name(r->rom), r->cycles, (unsigned long long)r->state_hash, i + 1 < count ? "," : "");
+        }
+    }
+    fprintf(file, "  ]%s\n", engine && scaling_count > 0 ? "," : "");
+    if (engine && scaling_count > 0) {
+        fprintf(file, "  \"scaling\": [\n");
+        for (int i = 0; i < scaling_count; i++) {
+            const ScalingResult *r = &scaling[i];
+            fprintf(file, "    { \"threads\": %d, \"seconds\": %.6f, \"ips\": %.0f, \"speedup\": %.3f }%s\n",
+                    r->threads, r->seconds, r->ips, r->speedup, i + 1 < scaling_count ? "," : "");
+        }
+        fprintf(file, "  ]\n");
+    }
+    fprintf(file, "}\n");
+    int ok = fclose(file) == 0;
+    if (!ok) {
+        printf("Error: Could not write %s\n", filename);
+    }
+    return ok;
+}
+
+// Read back a file written by write_json. Only numbers from the same
+// workload (CPU speed, and engine for timings) mean anything, so anything
+// else is an error. Returns -1 on an error, or -2 if the file isn't there.
+static int read_baseline(const char *filename, const char *engine, uint64_t cpu_hz, BaselineEntry *entries,
+                         int max_entries) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        return -2;
+    }
+    int count = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), file) && count < max_entries) {
+        char baseline_engine[16];
+        unsigned long long baseline_hz;
+        if (engine && sscanf(line, " \"engine\": \"%15[^\"]", baseline_engine) == 1 &&
+            strcmp(baseline_engine, engine) != 0) {
+            printf("Error: Baseline %s is for the %s engine, not %s\n", filename, baseline_engine, engine);
+            fclose(file);
+            return -1;
+        }
+        if (sscanf(line, " \"cpu_hz\": %llu", &baseline_hz) == 1 && baseline_hz != cpu_hz) {
+            printf("Error: Baseline %s is at %llu Hz, not %llu\n", filename, baseline_hz, (unsigned long long)cpu_hz);
+            fclose(file);
+            return -1;
+        }
+
+        // One ROM per line
+        const char *rom = strstr(line, "\"rom\": \"");
+        const char *cycles = strstr(line, "\"cycles\": ");
+        const char *ips = strstr(line, "\"ips\": ");
+        const char *hash = strstr(line, "\"state_hash\": \"");
+        if (!rom || !cycles || !hash) {
+            continue;
+        }
+        BaselineEntry *entry = &entries[count];
+        unsigned long long state_hash;
+        entry->ips = 0;
+        if (sscanf(rom + 8, "%255[^\"]", entry->rom) != 1 || sscanf(cycles + 10, "%ld", &entry->cycles) != 1 ||
+            (ips && sscanf(ips + 7, "%lf", &entry->ips) != 1) || sscanf(hash + 15, "%llx", &state_hash) != 1) {
+            continue;
+        }
+        entry->state_hash = state_hash;
+        count++;
+    }
+    fclose(file);
+    return count;
+}
+
+// ROMs whose final state is checked but not their speed. Nim plays one
+// game and then halts on a jump to itself, which the scheduler skips as
+// idle whatever the keys do: nearly all of its run takes no time, so its
+// speed means nothing, but where it ends up still checks the idle skip.
+static const char *state_only_roms[] = {
+    "Nim [Carmelo Cortez, 1978].ch8",
+};
+
+static int state_only(const char *rom) {
+    for (size_t i = 0; i < sizeof(state_only_roms) / sizeof(state_only_roms[0]); i++) {
+        if (strcmp(base_name(rom), state_only_roms[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// The entry for `result`'s ROM and cycle count, if there is one
+static const BaselineEntry *find_entry(const Result *result, const BaselineEntry *entries, int count) {
+    for (int b = 0; b < count; b++) {
+        if (strcmp(entries[b].rom, base_name(result->rom)) == 0 && entries[b].cycles == result->cycles) {
+            return &entries[b];
+        }
+    }
+    return NULL;
+}
+
+// Check the final states. Returns the number of ROMs that ended elsewhere.
+static int compare_states(const Result *results, int count, const BaselineEntry *states, int states_count) {
+    int failures = 0;
+    for (int i = 0; i < count; i++) {
+        const BaselineEntry *entry = find_entry(&results[i], states, states_count);
+        if (!entry) {
+            printf("%-42s no recorded state\n", base_name(results[i].rom));
+        }
+        else if (results[i].state_hash != entry->state_hash) {
+            printf("%-42s FAIL: ends in a different state\n", base_name(results[i].rom));
+            failures++;
+        }
+    }
+    return failures;
+}
+
+// Compare speeds against a baseline from this machine. Returns the number
+// of ROMs that got slower.
+static int compare_baseline(const Result *results, int count, const BaselineEntry *baseline, int baseline_count,
+                            double tolerance) {
+    int failures = 0;
+    printf("\n%-42s %14s %14s %8s\n", "ROM", "baseline ips", "ips", "change");
+    for (int i = 0; i < count; i++) {
+        const BaselineEntry *entry = find_entry(&results[i], baseline, baseline_count);
+        if (state_only(results[i].rom)) {
+            printf("%-42s %14s %14.0f %8s\n", base_name(results[i].rom), "-", results[i].ips, "skipped");
+            continue;
+        }
+        if (!entry || entry->ips <= 0) {
+            // Nothing to compare against
+            printf("%-42s %14s %14.0f %8s\n", base_name(results[i].rom), "-", results[i].ips, "new");
+            continue;
+        }
+
+        double change = (results[i].ips / entry->ips - 1) * 100;
+        const char *verdict = "";
+        if (change < -tolerance) {
+            verdict = "  FAIL: slower";
+            failures++;
+        }
+        printf("%-42s %14.0f %14.0f %+7.1f%%%s\n", base_name(results[i].rom), entry->ips, results[i].ips, change,
+               verdict);
+    }
+    return failures;
+}
+
+int main(int argc, char *argv[]) {
+    const char *default_roms[] = {
+        CHIP8_ROM_DIR "/Nim [Carmelo Cortez, 1978].ch8",
+        CHIP8_ROM_DIR "/Pong [Paul Vervalin, 1990].ch8",
+        CHIP8_ROM_DIR "/Pong1.ch8",
+        CHIP8_ROM_DIR "/Tetris [Fran Dachille, 1991].ch8",
+        CHIP8_ROM_DIR "/Space Invaders [David Winter] (alt).ch8"
+    };
+    const char *roms[MAX_ROMS];
+    int rom_count = 0;
+    long cycles = 20000000;
+    uint64_t cpu_hz = CHIP8_DEFAULT_CPU_HZ;
+    int repeat = 5;
+    const char *engine = "cache";
+    const char *json_file = NULL;
+    const char *baseline_file = NULL;
+    const char *states_file = NULL;
+    const char *write_states_file = NULL;
+    double tolerance = 15;
+    int scaling_threads = cpu_count();
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+            cycles = atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--hz") == 0 && i + 1 < argc) {
+            cpu_hz = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            engine = argv[++i];
+        }
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--states") == 0 && i + 1 < argc) {
+            states_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--write-states") == 0 && i + 1 < argc) {
+            write_states_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--scaling") == 0 && i + 1 < argc) {
+            scaling_threads = atoi(argv[++i]);
+        }
+        else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            printf("Usage: %s [--cycles N] [--hz N] [--repeat N] [--engine interp|cache|jit]\n"
+                   "       [--json FILE] [--baseline FILE] [--tolerance PERCENT]\n"
+                   "       [--states FILE] [--write-states FILE] [--scaling THREADS] [rom ...]\n", argv[0]);
+            return 1;
+        }
+        else if (rom_count < MAX_ROMS) {
+            roms[rom_count++] = argv[i];
+        }
+    }
+    if (rom_count == 0) {
+        rom_count = sizeof(default_roms) / sizeof(default_roms[0]);
+        memcpy(roms, default_roms, sizeof(default_roms));
+    }
+    if (cycles <= 0 || repeat <= 0 || scaling_threads < 0 || (strcmp(engine, "interp") != 0 && strcmp(engine, "cache") != 0 &&
+                                       strcmp(engine, "jit") != 0)) {
+        printf("Error: need --cycles > 0, --repeat > 0, --scaling >= 0 and --engine interp, cache or jit\n");
+        return 1;
+    }
+
+    Chip8InputScript script;
+    if (!make_script(&script, cycles)) {
+        return 1;
+    }
+
+    printf("%ld cycles per ROM at %llu Hz, %s engine, best of %d\n\n", cycles, (unsigned long long)cpu_hz, engine,
+           repeat);
+    printf("%-42s %14s %10s %12s %10s\n", "ROM", "ips", "ns/instr", "frames/s", "peak RSS");
+    // Take turns between the ROMs rather than running each one `repeat`
+    // times in a row, so a slow patch on the host doesn't land on one ROM's
+    // every run
+    static Result results[MAX_ROMS];
+    for (int r = 0; r < repeat; r++) {
+        for (int i = 0; i < rom_count; i++) {
+            if (!bench_rom(roms[i], engine, cycles, cpu_hz, &script, &results[i])) {
+                chip8_free_input_script(&script);
+                return 1;
+            }
+        }
+    }
+    for (int i = 0; i < rom_count; i++) {
+        printf("%-42s %14.0f %10.2f %12.0f %7ld KB\n", base_name(roms[i]), results[i].ips,
+               results[i].ns_per_instruction, results[i].fps, results[i].peak_rss_kb);
+    }
+
+    // The batch runner always uses the decode cache, whatever --engine says
+    static ScalingResult scaling[MAX_SCALING_RUNS];
+    int scaling_count = 0;
+    if (scaling_threads > 0) {
+        scaling_count = bench_scaling(roms, rom_count, cycles, cpu_hz, &script, scaling_threads, repeat, scaling);
+        if (scaling_count == 0) {
+            chip8_free_input_script(&script);
+            return 1;
+        }
+    }
+    chip8_free_input_script(&script);
+
+    if (json_file && !write_json(json_file, results, rom_count, engine, cpu_hz, scaling, scaling_count)) {
+        return 1;
+    }
+    if (write_states_file && !write_json(write_states_file, results, rom_count, NULL, cpu_hz, NULL, 0)) {
+        return 1;
+    }
+    if (states_file) {
+        static BaselineEntry states[MAX_ROMS];
+        int states_count = read_baseline(states_file, NULL, cpu_hz, states, MAX_ROMS);
+        if (states_count == -2) {
+            printf("Error: Could not open %s\n", states_file);
+        }
+        if (states_count < 0) {
+            return 1;
+        }
+        int failures = compare_states(results, rom_count, states, states_count);
+        if (failures) {
+            printf("\nFAIL: %d of %d ROMs ended in a different state than in %s\n", failures, rom_count, states_file);
+            return 1;
+        }
+        printf("\nEvery ROM ended in the state recorded in %s\n", states_file);
+    }
+    if (baseline_file) {
+        static BaselineEntry baseline[MAX_ROMS];
+        int baseline_count = read_baseline(baseline_file, engine, cpu_hz, baseline, MAX_ROMS);
+        if (baseline_count == -2) {
+            // First run on this machine: nothing to compare yet
+            if (!write_json(baseline_file, results, rom_count, engine, cpu_hz, scaling, scaling_count)) {
+                return 1;
+            }
+            printf("\nNo baseline yet; saved this run to %s to compare later runs against\n", baseline_file);
+            return 0;
+        }
+        if (baseline_count < 0) {
+            return 1;
+        }
+        int failures = compare_baseline(results, rom_count, baseline, baseline_count, tolerance);
+        if (failures) {
+            printf("\nFAIL: %d of %d ROMs regressed (tolerance %.0f%%)\n", failures, rom_count, tolerance);
+            return 1;
+        }
+        printf("\nNo regressions against %s (tolerance %.0f%%)\n", baseline_file, tolerance);
+    }
+    return 0;
+}
@@ -0,0 +1,165 @@
+// Frame triple buffer benchmark
+// Hands frames from a writer thread to a reader thread through
+// chip8_triple_back / publish / take, the way the SDL frontend's emulation
+// thread passes frames to its render loop, but with no SDL or machine in
+// the way. Every frame the writer publishes is stamped with its number in
+// `cycle` and in every word of the display and both planes, so the reader
+// can tell if it got a frame the writer was still filling in (torn), an
+// older frame than the last one it took, or never got the last one. Then
+// prints frames published per second and how many the reader saw. With
+// --check it runs fewer frames and skips the timings (ctest runs it this
+// way).
+//
+// Build: cmake --build build --target bench_triple_buffer
+// Usage: ./bench_triple_buffer [--check] [frames]
+#define _POSIX_C_SOURCE 200809L  // clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "chip8.h"
+
+typedef struct {
+    Chip8TripleBuffer *frames;
+    uint64_t count;                 // frames to publish, numbered 1..count
+} Writer;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *writer_main(void *arg) {
+    Writer *writer = arg;
+    for (uint64_t seq = 1; seq <= writer->count; seq++) {
+        Chip8Frame *frame = chip8_triple_back(writer->frames);
+        for (int y = 0; y < CHIP8_DISPLAY_HEIGHT; y++) {
+            frame->display[y] = seq;
+        }
+        for (int plane = 0; plane < 2; plane++) {
+            for (int y = 0; y < CHIP8_HIRES_HEIGHT; y++) {
+                for (int w = 0; w < CHIP8_HIRES_WORDS; w++) {
+                    frame->screen[plane][y][w] = seq;
+                }
+            }
+        }
+        frame->plane_count = (int)(seq & 1);
+        frame->cycle = seq;
+        chip8_triple_publish(writer->frames);
+    }
+    return NULL;
+}
+
+// 1 if every word of `frame` carries the number in its `cycle`
+static int frame_whole(const Chip8Frame *frame) {
+    uint64_t seq = frame->cycle;
+    if (frame->plane_count != (int)(seq & 1)) {
+        return 0;
+    }
+    for (int y = 0; y < CHIP8_DISPLAY_HEIGHT; y++) {
+        if (frame->display[y] != seq) {
+            return 0;
+        }
+    }
+    for (int plane = 0; plane < 2; plane++) {
+        for (int y = 0; y < CHIP8_HIRES_HEIGHT; y++) {
+            for (int w = 0; w < CHIP8_HIRES_WORDS; w++) {
+                if (frame->screen[plane][y][w] != seq) {
+                    return 0;
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t count = 2000000;
+    int check_only = 0;
+    if (argc > 1 && strcmp(argv[1], "--check") == 0) {
+        check_only = 1;
+        count = 200000;
+        argv++;
+        argc--;
+    }
+    if (argc > 1) {
+        count = strtoull(argv[1], NULL, 10);
+    }
+    if (count == 0) {
+        printf("Error: frames must be at least 1\n");
+        return 1;
+    }
+
+    Writer writer = { chip8_triple_create(), count };
+    if (!writer.frames) {
+        return 1;
+    }
+    if (chip8_triple_take(writer.frames)) {
+        printf("FAIL: took a frame before any was published\n");
+        return 1;
+    }
+
+    double start = now_seconds();
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, writer_main, &writer) != 0) {
+        printf("Error: Couldn't start the writer thread\n");
+        return 1;
+    }
+    // Take frames until the last one turns up. Published frames the reader
+    // was too slow for are skipped, but never the newest: it stays parked
+    // until taken.
+    uint64_t last = 0, taken = 0, empty = 0;
+    int failed = 0;
+    while (last < count) {
+        const Chip8Frame *frame = chip8_triple_take(writer.frames);
+        if (!frame) {
+            empty++;
+            sched_yield();
+            continue;
+        }
+        taken++;
+        if (!frame_whole(frame)) {
+            printf("FAIL: frame %llu was torn\n", (unsigned long long)frame->cycle);
+            failed = 1;
+            break;
+        }
+        if (frame->cycle <= last) {
+            printf("FAIL: took frame %llu after frame %llu\n", (unsigned long long)frame->cycle,
+                   (unsigned long long)last);
+            failed = 1;
+            break;
+        }
+        last = frame->cycle;
+    }
+    pthread_join(thread, NULL);
+    double seconds = now_seconds() - start;
+
+    // The writer is done, so there is nothing new to take
+    if (!failed && chip8_triple_take(writer.frames)) {
+        printf("FAIL: took a frame after the last one\n");
+        failed = 1;
+    }
+    chip8_triple_destroy(writer.frames);
+    if (failed) {
+        return 1;
+    }
+    printf("Triple buffer handoff OK (%llu frames, reader took %llu, none torn or out of order)\n",
+           (unsigned long long)count, (unsigned long long)taken);
+    if (check_only) {
+        return 0;
+    }
+
+    printf("\n%-24s %12s\n", "", "per second");
+    printf("%-24s %12.0f\n", "frames published", count / seconds);
+    printf("%-24s %12.0f\n", "frames taken", taken / seconds);
+    printf("%-24s %12.0f\n", "takes with nothing new", empty / seconds);
+    printf("\n%.1f%% of published frames reached the reader (%.0f ns per publish)\n",
+           100.0 * taken / count, seconds * 1e9 / count);
+    return 0;
+}
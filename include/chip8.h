@@ -0,0 +1,683 @@
+// libchip8 - public interface of the CHIP-8 core
+//
+// The core has no global state: every machine lives in its own Chip8 struct,
+// so you can run as many as you like in one process. Nothing in here
+// depends on SDL.
+#ifndef CHIP8_H
+#define CHIP8_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// CHIP-8 has a 64x32 monochrome display
+#define CHIP8_DISPLAY_WIDTH 64
+#define CHIP8_DISPLAY_HEIGHT 32
+
+// Programs load at 0x200 and can fill the rest of the 4KB
+#define CHIP8_MAX_ROM_SIZE (CHIP8_MEMORY_SIZE - 0x200)
+
+// The delay and sound timers always count down at 60 Hz. The CPU clock is
+// separate and configurable; 600 instructions/second is the default.
+#define CHIP8_TIMER_HZ 60
+#define CHIP8_DEFAULT_CPU_HZ 600
+
+// How far behind real time the scheduler will try to catch up (100 ms)
+#define CHIP8_DEFAULT_MAX_CATCHUP_NS 100000000ULL
+
+// Memory is 4KB in 16 pages of 256 bytes, shared copy-on-write between
+// forked machines (see src/memory.c)
+#define CHIP8_MEMORY_SIZE 4096
+#define CHIP8_PAGE_SIZE 256
+#define CHIP8_PAGE_COUNT (CHIP8_MEMORY_SIZE / CHIP8_PAGE_SIZE)
+
+// SUPER-CHIP and XO-CHIP add a 128x64 mode. The screen is kept at that
+// size whatever the mode, as rows of two 64-bit words (the leftmost pixel
+// is the top bit of the first word); in 64x32 mode every pixel is drawn as
+// a 2x2 block.
+#define CHIP8_HIRES_WIDTH 128
+#define CHIP8_HIRES_HEIGHT 64
+#define CHIP8_HIRES_WORDS (CHIP8_HIRES_WIDTH / 64)
+
+// XO-CHIP has 64KB of memory; the 60KB past the first 4KB is in Chip8Ext
+#define CHIP8_XO_MEMORY_SIZE 65536
+#define CHIP8_XO_MAX_ROM_SIZE (CHIP8_XO_MEMORY_SIZE - 0x200)
+
+// SUPER-CHIP's 8x10 font (FX30) sits right after the 4x5 one
+#define CHIP8_BIG_FONT_ADDR 0x50
+
+// Instruction sets. Each one past plain CHIP-8 runs on its own core (see
+// src/core_template.h), so CHIP-8 programs never pay for the extensions.
+typedef enum {
+    CHIP8_VARIANT_CHIP8,            // the original: 64x32, 4KB
+    CHIP8_VARIANT_SCHIP,            // SUPER-CHIP 1.1: 128x64 mode, scrolling, big font, flag registers
+    CHIP8_VARIANT_XOCHIP,           // XO-CHIP: SUPER-CHIP plus two bit planes and 64KB
+    CHIP8_VARIANT_COUNT
+} Chip8Variant;
+
+// Quirk profiles: which of the incompatible readings of a few CHIP-8
+// instructions a CHIP-8 machine follows (8XY6/8XYE shifting VY or VX,
+// FX55/FX65 moving I, BNNN adding V0 or VX, DXYN clipping or wrapping,
+// 8XY1-3 clearing VF). Each profile but the default runs on its own core
+// built from src/core_template.h, so the choice costs nothing per
+// instruction. SUPER-CHIP and XO-CHIP always use their own quirks.
+typedef enum {
+    CHIP8_QUIRKS_DEFAULT,           // what this emulator has always done
+    CHIP8_QUIRKS_VIP,               // the original COSMAC VIP interpreter
+    CHIP8_QUIRKS_CHIP48,            // CHIP-48 on the HP 48
+    CHIP8_QUIRKS_SCHIP,             // SUPER-CHIP 1.1, for CHIP-8 programs
+    CHIP8_QUIRKS_MODERN,            // Octo and most programs written today
+    CHIP8_QUIRKS_COUNT
+} Chip8Quirks;
+
+// What a SUPER-CHIP or XO-CHIP machine has on top of a Chip8. Allocated
+// by chip8_set_variant in one block, sized for the variant: one bit plane
+// and no extra memory for SUPER-CHIP, two planes and 60KB for XO-CHIP.
+typedef struct Chip8Ext {
+    size_t size;                    // bytes in the block
+    const uint8_t **high_pages;     // memory from 0x1000 up, by page (in the block), shared like `pages`
+    int high_page_count;            // 0 for SUPER-CHIP
+    int plane_count;                // bit planes in `screen`
+    uint8_t hires;                  // 128x64 mode (00FF) rather than 64x32 (00FE)
+    uint8_t plane_mask;             // planes that drawing, clearing and scrolling touch (XO-CHIP FN01)
+    uint8_t pitch;                  // XO-CHIP FX3A
+    uint8_t flags[16];              // SUPER-CHIP FX75/FX85 flag registers
+    uint8_t pattern[16];            // XO-CHIP F002 audio pattern
+    uint64_t screen[][CHIP8_HIRES_HEIGHT][CHIP8_HIRES_WORDS];  // by plane, row, word
+} Chip8Ext;
+
+struct Chip8Profile;
+
+typedef struct {
+    // 4KB of RAM, by page. Read with chip8_mem_read; pages may be shared
+    // with other machines, so write only with chip8_mem_write*.
+    const uint8_t *pages[CHIP8_PAGE_COUNT];
+    // Display, one bit per pixel: display[y] is row y, and the leftmost
+    // pixel (x = 0) is the top bit (bit 63)
+    uint64_t display[CHIP8_DISPLAY_HEIGHT];
+    uint8_t V[16];                  // 16 general purpose 8-bit registers (V0-VF)
+    uint16_t I;                     // 16-bit index register
+    uint16_t pc;                    // Program counter
+    uint8_t delay_timer;            // Delay timer
+    uint8_t sound_timer;            // Sound timer
+    uint16_t stack[16];             // Stack for subroutines
+    uint8_t sp;                     // Stack pointer
+    uint8_t keypad[16];             // Keypad state (0-F)
+    uint32_t rng_state;             // This machine's CXNN generator (xorshift32, never 0)
+    uint32_t dirty_rows;            // Bit y set = display row y changed since the frontend last looked
+    struct Chip8Profile *profile;   // Counters to add to, or NULL (see Chip8Profile)
+    uint8_t variant;                // Chip8Variant
+    uint8_t quirks;                 // Chip8Quirks (CHIP-8 machines only)
+    Chip8Ext *ext;                  // SUPER-CHIP/XO-CHIP state, NULL for CHIP-8
+} Chip8;
+
+// Read one byte of memory. Addresses wrap at 4KB.
+static inline uint8_t chip8_mem_read(const Chip8 *chip8, uint16_t addr) {
+    return chip8->pages[(addr >> 8) & (CHIP8_PAGE_COUNT - 1)][addr & (CHIP8_PAGE_SIZE - 1)];
+}
+
+// Read one byte of an XO-CHIP machine's 64KB (or of any machine's 4KB,
+// below 0x1000)
+static inline uint8_t chip8_xmem_read(const Chip8 *chip8, uint16_t addr) {
+    if (addr < CHIP8_MEMORY_SIZE) {
+        return chip8_mem_read(chip8, addr);
+    }
+    return chip8->ext->high_pages[(addr >> 8) - CHIP8_PAGE_COUNT][addr & (CHIP8_PAGE_SIZE - 1)];
+}
+
+// Next random byte for CXNN. xorshift32: three shifts and XORs, no shared
+// state, the same numbers on every platform. The top byte of the state
+// covers all of 0-255.
+static inline uint8_t chip8_random_byte(Chip8 *chip8) {
+    uint32_t x = chip8->rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    chip8->rng_state = x;
+    return x >> 24;
+}
+
+// Read one pixel (0 or 1) from the packed display
+static inline int chip8_get_pixel(const Chip8 *chip8, int x, int y) {
+    return (chip8->display[y] >> (63 - x)) & 1;
+}
+
+// Every row of the display marked as changed
+#define CHIP8_ALL_ROWS_DIRTY 0xFFFFFFFFu
+
+// Operations, one per instruction. CHIP8_OP_NOP covers every opcode that
+// isn't a real instruction (they are ignored).
+typedef enum {
+    CHIP8_OP_NOP,
+    CHIP8_OP_00E0, CHIP8_OP_00EE, CHIP8_OP_1NNN, CHIP8_OP_2NNN,
+    CHIP8_OP_3XNN, CHIP8_OP_4XNN, CHIP8_OP_5XY0, CHIP8_OP_6XNN,
+    CHIP8_OP_7XNN, CHIP8_OP_8XY0, CHIP8_OP_8XY1, CHIP8_OP_8XY2,
+    CHIP8_OP_8XY3, CHIP8_OP_8XY4, CHIP8_OP_8XY5, CHIP8_OP_8XY6,
+    CHIP8_OP_8XY7, CHIP8_OP_9XY0, CHIP8_OP_ANNN, CHIP8_OP_BNNN,
+    CHIP8_OP_CXNN, CHIP8_OP_DXYN, CHIP8_OP_EX9E, CHIP8_OP_EXA1,
+    CHIP8_OP_FX07, CHIP8_OP_FX0A, CHIP8_OP_FX15, CHIP8_OP_FX18,
+    CHIP8_OP_FX1E, CHIP8_OP_FX29, CHIP8_OP_FX33, CHIP8_OP_FX55,
+    CHIP8_OP_FX65,
+    CHIP8_OP_COUNT
+} Chip8Op;
+
+// A decoded instruction: the operation plus every operand field, already
+// shifted out of the opcode
+typedef struct {
+    uint8_t op;                     // Chip8Op
+    uint8_t x;                      // 0x0X00
+    uint8_t y;                      // 0x00Y0
+    uint8_t n;                      // 0x000N
+    uint8_t nn;                     // 0x00NN
+    uint16_t nnn;                   // 0x0NNN
+} Chip8Instruction;
+
+// Core (src/chip8.c). A machine holds memory pages: when you are done
+// with one, or before chip8_init-ing it again, call chip8_free.
+void chip8_init(Chip8 *chip8);
+void chip8_seed(Chip8 *chip8, unsigned int seed);
+int chip8_load_rom(Chip8 *chip8, const char *filename);
+int chip8_load_rom_buffer(Chip8 *chip8, const uint8_t *data, size_t size);
+uint16_t chip8_fetch(Chip8 *chip8);
+void chip8_cycle(Chip8 *chip8);
+void chip8_execute(Chip8 *chip8, uint16_t opcode);
+void chip8_decode(uint16_t opcode, Chip8Instruction *in);
+void chip8_execute_decoded(Chip8 *chip8, const Chip8Instruction *in);
+uint64_t chip8_state_hash(const Chip8 *chip8);
+uint64_t chip8_state_key(const Chip8 *chip8);
+uint64_t chip8_display_checksum(const Chip8 *chip8);
+
+// Idle detection (src/idle.c). Spots a machine that is only waiting - on
+// FX0A with no key down, in a jump to itself, or in an FX07/3XNN/1NNN loop
+// on the delay timer - so the scheduler can skip the wait and the frontend
+// can sleep through it.
+typedef enum {
+    CHIP8_IDLE_NONE,
+    CHIP8_IDLE_KEY,                 // FX0A at pc, no key down
+    CHIP8_IDLE_HALT,                // 1NNN jumping to itself
+    CHIP8_IDLE_TIMER                // looping until the delay timer reads until_delay
+} Chip8IdleKind;
+
+typedef struct {
+    Chip8IdleKind kind;
+    uint16_t head;                  // first instruction of the loop
+    uint8_t x;                      // register FX0A or FX07 loads
+    uint8_t until_delay;            // CHIP8_IDLE_TIMER: delay timer value that ends it
+} Chip8Idle;
+
+Chip8IdleKind chip8_idle_check(const Chip8 *chip8, Chip8Idle *idle);
+long chip8_idle_frames(const Chip8 *chip8, const Chip8Idle *idle);
+
+// Paged memory (src/memory.c)
+void chip8_mem_init(Chip8 *chip8);
+void chip8_mem_write(Chip8 *chip8, uint16_t addr, uint8_t value);
+void chip8_mem_write_block(Chip8 *chip8, uint16_t addr, const uint8_t *data, size_t size);
+void chip8_mem_read_block(const Chip8 *chip8, uint16_t addr, uint8_t *out, size_t size);
+void chip8_xmem_write(Chip8 *chip8, uint16_t addr, uint8_t value);
+void chip8_xmem_write_block(Chip8 *chip8, uint16_t addr, const uint8_t *data, size_t size);
+int chip8_mem_extend(Chip8 *chip8, int plane_count, size_t memory_size);
+size_t chip8_mem_size(const Chip8 *chip8);
+void chip8_fork(Chip8 *child, const Chip8 *parent);
+void chip8_free(Chip8 *chip8);
+int chip8_mem_private_pages(const Chip8 *chip8);
+uint64_t chip8_mem_hash(const Chip8 *chip8);
+
+// Performance counters (src/profile.c). Only collected when everything is
+// built with CHIP8_PROFILE (cmake -DCHIP8_PROFILE=ON); without it the hooks
+// compile to nothing and cost nothing. To profile a machine, point its
+// `profile` at a zeroed Chip8Profile after chip8_init. Forks share it.
+// Instructions the JIT compiles aren't counted, only the ones it leaves to
+// the interpreter.
+typedef struct Chip8Profile {
+    uint64_t op_counts[CHIP8_OP_COUNT];     // instructions run, by operation
+    uint64_t pc_counts[CHIP8_MEMORY_SIZE];  // instructions run, by address
+    uint64_t sprites_drawn;                 // DXYN
+    uint64_t sprite_collisions;             // DXYN that set VF
+    uint64_t frames_rendered;               // frontend frames that were drawn
+    uint64_t frames_skipped;                // and ones with nothing new to draw
+    uint64_t emulate_ns;                    // host time running the CPU
+    uint64_t render_ns;                     // drawing frames
+    uint64_t delay_ns;                      // sleeping to hold 60 FPS
+    uint64_t idle_cycles;                   // cycles skipped as idle (see chip8_idle_check)
+} Chip8Profile;
+
+#ifdef CHIP8_PROFILE
+#define CHIP8_PROFILE_ADD(chip8, field, amount) \
+    do { if ((chip8)->profile) { (chip8)->profile->field += (amount); } } while (0)
+#define CHIP8_PROFILE_CLOCK() chip8_time_ns()
+#else
+// Not evaluated - only there so the arguments still count as used
+#define CHIP8_PROFILE_ADD(chip8, field, amount) ((void)sizeof((chip8)->profile->field += (amount)))
+#define CHIP8_PROFILE_CLOCK() 0
+#endif
+
+int chip8_profile_available(void);
+int chip8_profile_write_json(const Chip8Profile *profile, FILE *out, int hot_addresses);
+
+// Display conversion (src/display.c)
+void chip8_display_to_rgba(const Chip8 *chip8, uint32_t *pixels, int first_row, int row_count);
+void chip8_rows_to_rgba(const uint64_t *display, uint32_t *pixels, int first_row, int row_count);
+void chip8_screen_to_rgba(const uint64_t (*screen)[CHIP8_HIRES_HEIGHT][CHIP8_HIRES_WORDS], int plane_count,
+                          uint32_t *pixels, int first_row, int row_count);
+
+// Beeper tone (src/audio.c). A square wave for the sound timer, made a
+// buffer at a time; safe to call from an audio callback.
+#define CHIP8_TONE_HZ 440
+
+typedef struct {
+    uint32_t phase;                 // position in the wave, in 1/2^32 of a period
+    uint32_t step;                  // phase advance per sample
+    int16_t amplitude;
+} Chip8Tone;
+
+void chip8_tone_init(Chip8Tone *tone, int sample_rate, int frequency, int16_t amplitude);
+void chip8_tone_fill(Chip8Tone *tone, int16_t *samples, int count, int on);
+
+// Frame triple buffer (src/triple_buffer.c). Passes finished frames from
+// the thread running a machine to the thread drawing it, lock-free: one
+// writer fills chip8_triple_back and publishes it, one reader takes the
+// newest. Neither ever waits for the other.
+typedef struct {
+    uint64_t display[CHIP8_DISPLAY_HEIGHT];
+    int plane_count;                // 0 = a CHIP-8 frame, in `display`; else the planes of `screen`
+    uint64_t screen[2][CHIP8_HIRES_HEIGHT][CHIP8_HIRES_WORDS];
+    uint64_t cycle;                 // scheduler cycle count when it was taken
+} Chip8Frame;
+
+typedef struct Chip8TripleBuffer Chip8TripleBuffer;
+
+Chip8TripleBuffer *chip8_triple_create(void);
+void chip8_triple_destroy(Chip8TripleBuffer *buffer);
+Chip8Frame *chip8_triple_back(Chip8TripleBuffer *buffer);
+void chip8_triple_publish(Chip8TripleBuffer *buffer);
+const Chip8Frame *chip8_triple_take(Chip8TripleBuffer *buffer);
+
+// Save states (src/savestate.c). The format is versioned and the same on
+// every host; see the top of savestate.c for the layout. A CHIP-8 state is
+// CHIP8_STATE_SIZE bytes; SUPER-CHIP and XO-CHIP ones are bigger (see
+// chip8_state_size), up to CHIP8_STATE_MAX_SIZE.
+#define CHIP8_STATE_VERSION 3
+#define CHIP8_STATE_SIZE (8 + CHIP8_MEMORY_SIZE + CHIP8_DISPLAY_HEIGHT * 8 + 16 + 2 + 2 + 16 * 2 + 3 + 16 + 4)
+#define CHIP8_STATE_EXT_SIZE(planes, memory_size) \
+    (3 + 16 + 16 + (planes) * CHIP8_HIRES_HEIGHT * CHIP8_HIRES_WORDS * 8 + (memory_size) - CHIP8_MEMORY_SIZE)
+#define CHIP8_STATE_MAX_SIZE (CHIP8_STATE_SIZE + CHIP8_STATE_EXT_SIZE(2, CHIP8_XO_MEMORY_SIZE))
+
+size_t chip8_state_size(const Chip8 *chip8);
+size_t chip8_save_state(const Chip8 *chip8, uint8_t *buffer, size_t size);
+int chip8_load_state(Chip8 *chip8, const uint8_t *buffer, size_t size);
+int chip8_save_state_file(const Chip8 *chip8, const char *filename);
+int chip8_load_state_file(Chip8 *chip8, const char *filename);
+
+// The last `capacity` snapshots of a machine, for rewinding
+typedef struct {
+    Chip8 *snapshots;
+    int capacity;
+    int count;                      // snapshots currently held
+    int newest;                     // index of the most recent one
+} Chip8Rewind;
+
+int chip8_rewind_init(Chip8Rewind *rewind, int capacity);
+void chip8_rewind_free(Chip8Rewind *rewind);
+void chip8_rewind_push(Chip8Rewind *rewind, const Chip8 *chip8);
+int chip8_rewind_pop(Chip8Rewind *rewind, Chip8 *chip8);
+
+// An execution engine: runs exactly `cycles` CPU cycles on `chip8` without
+// touching the timers, and returns `cycles`. The interpreter (NULL), the
+// decode cache (chip8_decode_cache_run) and the JIT (chip8_jit_run) all fit.
+typedef uint64_t (*Chip8RunFn)(void *context, Chip8 *chip8, uint64_t cycles);
+
+// Drives a Chip8 at a fixed instruction rate with 60 Hz timers
+typedef struct {
+    uint64_t cpu_hz;                // instructions per second
+    uint64_t cycles;                // cycles run so far
+    uint64_t timer_ticks;           // 60 Hz timer ticks so far (= frames)
+    uint64_t next_tick_cycle;       // cycle count at which the next tick happens
+    uint64_t owed;                  // fraction of a cycle carried between advances
+    uint64_t max_catchup_ns;        // most host time one advance will make up
+    uint64_t dropped_ns;            // host time dropped because we fell too far behind
+    Chip8RunFn run;                 // engine; NULL = plain chip8_cycle loop
+    void *run_context;
+} Chip8Scheduler;
+
+// Scheduler (src/scheduler.c)
+void chip8_sched_init(Chip8Scheduler *sched, uint64_t cpu_hz);
+void chip8_sched_set_engine(Chip8Scheduler *sched, Chip8RunFn run, void *context);
+void chip8_tick_timers(Chip8 *chip8);
+uint64_t chip8_sched_cycles_to_tick(const Chip8Scheduler *sched);
+uint64_t chip8_sched_cycles_for_frames(uint64_t cpu_hz, uint64_t frames);
+void chip8_sched_run_cycles(Chip8Scheduler *sched, Chip8 *chip8, uint64_t cycles);
+uint64_t chip8_sched_cycles_due(Chip8Scheduler *sched, uint64_t elapsed_ns);
+uint64_t chip8_sched_advance(Chip8Scheduler *sched, Chip8 *chip8, uint64_t elapsed_ns);
+uint64_t chip8_time_ns(void);
+
+// SUPER-CHIP and XO-CHIP (src/variant.c, src/core_schip.c,
+// src/core_xochip.c). Turn a freshly chip8_init-ed machine into a variant
+// before loading anything into it, and run it on chip8_machine_engine(),
+// not chip8_cycle, the decode cache or the JIT - those are CHIP-8 only.
+int chip8_set_variant(Chip8 *chip8, Chip8Variant variant);
+Chip8RunFn chip8_variant_engine(Chip8Variant variant);
+const char *chip8_variant_name(Chip8Variant variant);
+int chip8_variant_from_name(const char *name);
+Chip8Variant chip8_variant_for_file(const char *filename);
+uint64_t chip8_schip_run(void *context, Chip8 *chip8, uint64_t cycles);
+uint64_t chip8_xochip_run(void *context, Chip8 *chip8, uint64_t cycles);
+Chip8RunFn chip8_machine_engine(const Chip8 *chip8);
+
+// Quirk profiles (src/quirks.c, src/core_quirks_*.c). Set them on a
+// CHIP-8 machine like a variant, and run it on chip8_machine_engine(), or
+// the decode cache or the JIT: the decode cache runs the few instructions a
+// profile changes (chip8_quirks_differ) on its core, and the JIT compiles
+// them for the profile.
+// chip8_quirks_for_rom looks the ROM up in a small database of programs
+// known to need a particular profile; -1 if it isn't there.
+typedef struct {
+    uint8_t is_default;             // the default core's own: 8XYE ignored, FX29 unmasked, VF written first
+    uint8_t shift_vy;               // 8XY6/8XYE shift VY into VX
+    uint8_t memory_step;            // FX55/FX65: 0 = I kept, 1 = I += X + 1, 2 = I += X
+    uint8_t jump_vx;                // BXNN jumps to XNN + VX
+    uint8_t clip;                   // DXYN clips at the screen edges
+    uint8_t logic_resets_vf;        // 8XY1-3 clear VF
+} Chip8QuirkFlags;
+
+int chip8_set_quirks(Chip8 *chip8, Chip8Quirks quirks);
+Chip8RunFn chip8_quirks_engine(Chip8Quirks quirks);
+const Chip8QuirkFlags *chip8_quirk_flags(Chip8Quirks quirks);
+int chip8_quirks_differ(Chip8Quirks quirks, uint16_t opcode);
+const char *chip8_quirks_name(Chip8Quirks quirks);
+int chip8_quirks_from_name(const char *name);
+uint64_t chip8_rom_hash(const uint8_t *data, size_t size);
+int chip8_quirks_for_rom(const uint8_t *data, size_t size);
+int chip8_quirks_for_file(const char *filename);
+uint64_t chip8_quirks_vip_run(void *context, Chip8 *chip8, uint64_t cycles);
+uint64_t chip8_quirks_chip48_run(void *context, Chip8 *chip8, uint64_t cycles);
+uint64_t chip8_quirks_schip_run(void *context, Chip8 *chip8, uint64_t cycles);
+uint64_t chip8_quirks_modern_run(void *context, Chip8 *chip8, uint64_t cycles);
+
+// Pre-decoded instruction cache (src/decode_cache.c). Use it as a
+// scheduler engine: chip8_sched_set_engine(&sched, chip8_decode_cache_run,
+// &cache). Clear it before first use, and again after changing the
+// machine's memory from outside (loading a ROM or a saved state) or its
+// quirk profile.
+#define CHIP8_DECODE_CACHE_SLOTS CHIP8_MEMORY_SIZE
+
+typedef struct {
+    Chip8Instruction entries[CHIP8_DECODE_CACHE_SLOTS];  // by pc
+} Chip8DecodeCache;
+
+void chip8_decode_cache_clear(Chip8DecodeCache *cache);
+void chip8_decode_cache_invalidate(Chip8DecodeCache *cache, uint16_t addr, uint16_t size);
+uint64_t chip8_decode_cache_run(void *cache, Chip8 *chip8, uint64_t cycles);
+
+// JIT recompiler (src/jit_x64.c). One Chip8Jit per machine. After changing
+// a machine's memory from outside (loading a ROM or a saved state), call
+// chip8_jit_invalidate_all.
+typedef struct Chip8Jit Chip8Jit;
+
+typedef struct {
+    uint64_t blocks_compiled;
+    uint64_t invalidations;         // blocks dropped because FX33/FX55 wrote over them
+    uint64_t flushes;               // times the whole code cache was thrown away
+    uint64_t native_cycles;         // cycles run as compiled code
+    uint64_t interpreted_cycles;    // cycles that fell back to the interpreter
+} Chip8JitStats;
+
+int chip8_jit_available(void);
+Chip8Jit *chip8_jit_create(void);
+void chip8_jit_destroy(Chip8Jit *jit);
+uint64_t chip8_jit_run(void *jit, Chip8 *chip8, uint64_t cycles);
+void chip8_jit_invalidate(Chip8Jit *jit, uint16_t addr, uint16_t size);
+void chip8_jit_invalidate_all(Chip8Jit *jit);
+void chip8_jit_get_stats(const Chip8Jit *jit, Chip8JitStats *stats);
+
+// Visited-state set (src/visited.c). A fixed-size set of chip8_state_key
+// values that any number of threads can add to at once without locks, for
+// searches that must not explore the same machine state twice.
+typedef struct Chip8VisitedSet Chip8VisitedSet;
+
+Chip8VisitedSet *chip8_visited_create(size_t capacity);
+void chip8_visited_destroy(Chip8VisitedSet *set);
+int chip8_visited_insert(Chip8VisitedSet *set, uint64_t key);
+int chip8_visited_contains(const Chip8VisitedSet *set, uint64_t key);
+size_t chip8_visited_count(const Chip8VisitedSet *set);
+
+// ROM library (src/rom_library.c). Memory-maps ROMs once - a directory of
+// them, a pack archive (chip8-pack), or single files - and checks each one
+// when it is added. Every ROM keeps a machine with it already loaded, so
+// starting one more copy is a chip8_fork: a struct copy sharing the ROM's
+// pages, with no file access and nothing copied. Look ROMs up by name or
+// by content (chip8_rom_hash). Once filled, a library can be shared by any
+// number of threads.
+#define CHIP8_PACK_VERSION 1
+
+typedef struct {
+    char *name;                     // file name in the directory or pack, or the path given
+    const uint8_t *data;            // in the mapping
+    size_t size;
+    uint64_t hash;                  // chip8_rom_hash of the contents
+    Chip8Variant variant;           // from the name's extension
+    int quirks;                     // Chip8Quirks from the ROM database, or -1
+    Chip8 start;                    // a fresh machine with the ROM loaded; fork it with chip8_rom_start
+} Chip8Rom;
+
+typedef struct Chip8RomLibrary Chip8RomLibrary;
+
+Chip8RomLibrary *chip8_library_create(void);
+Chip8RomLibrary *chip8_library_open(const char *path);
+void chip8_library_close(Chip8RomLibrary *library);
+int chip8_library_add(Chip8RomLibrary *library, const char *path);
+const Chip8Rom *chip8_library_add_file(Chip8RomLibrary *library, const char *path);
+int chip8_library_count(const Chip8RomLibrary *library);
+const Chip8Rom *chip8_library_rom(const Chip8RomLibrary *library, int index);
+const Chip8Rom *chip8_library_find(const Chip8RomLibrary *library, const char *name);
+const Chip8Rom *chip8_library_find_hash(const Chip8RomLibrary *library, uint64_t hash);
+int chip8_library_write_pack(const Chip8RomLibrary *library, const char *filename);
+void chip8_rom_start(const Chip8Rom *rom, Chip8 *chip8);
+
+// Static analysis (src/analyze.c, chip8-analyze). Disassembles a CHIP-8
+// machine's memory by recursive descent from its pc, through chip8_decode,
+// following jumps, calls, returns and both ways out of skips, and splits
+// the code into basic blocks. It follows I through ANNN to find what
+// FX33/FX55 write over, and flags what it can't see through: BNNN jumps,
+// writes to code, and writes through an I it doesn't know. Loops come
+// from the back edges of a walk from the entry.
+#define CHIP8_ANALYSIS_CODE     0x01    // an instruction starts here
+#define CHIP8_ANALYSIS_OPERAND  0x02    // second byte of an instruction
+#define CHIP8_ANALYSIS_LEADER   0x04    // a block starts here
+#define CHIP8_ANALYSIS_POINTER  0x08    // an ANNN points here
+#define CHIP8_ANALYSIS_READ     0x10    // DXYN or FX65 reads here
+#define CHIP8_ANALYSIS_WRITTEN  0x20    // FX33 or FX55 writes here
+
+// How a block ends
+typedef enum {
+    CHIP8_EXIT_FALLTHROUGH,         // into the next block
+    CHIP8_EXIT_JUMP,                // 1NNN
+    CHIP8_EXIT_HALT,                // 1NNN to itself
+    CHIP8_EXIT_CALL,                // 2NNN; next[0] is where it returns to
+    CHIP8_EXIT_RETURN,              // 00EE
+    CHIP8_EXIT_SKIP,                // 3XNN 4XNN 5XY0 9XY0 EX9E EXA1: next[0] not taken, next[1] taken
+    CHIP8_EXIT_INDIRECT,            // BNNN; where it goes is only known at run time
+    CHIP8_EXIT_END,                 // runs off the end of memory
+} Chip8BlockExit;
+
+#define CHIP8_BLOCK_LOOP_HEADER   0x01  // target of a back edge
+#define CHIP8_BLOCK_WRITES        0x02  // FX33 or FX55
+#define CHIP8_BLOCK_SELF_MODIFY   0x04  // writes over instructions
+#define CHIP8_BLOCK_UNKNOWN_WRITE 0x08  // writes through an I it can't follow
+#define CHIP8_BLOCK_WAITS_KEY     0x10  // FX0A
+
+typedef struct {
+    uint16_t start;                 // first instruction
+    uint16_t end;                   // one past the last instruction's bytes
+    uint16_t length;                // instructions
+    uint8_t exit;                   // Chip8BlockExit
+    uint8_t flags;                  // CHIP8_BLOCK_*
+    uint16_t next[2];               // successors, by address
+    uint8_t next_count;
+    uint16_t call;                  // 2NNN target, for CHIP8_EXIT_CALL
+    uint8_t loop_depth;             // loops the block is in
+} Chip8Block;
+
+typedef struct {
+    uint8_t memory[CHIP8_MEMORY_SIZE];  // what was analysed
+    uint8_t addr[CHIP8_MEMORY_SIZE];    // CHIP8_ANALYSIS_* flags by address
+    int16_t block_at[CHIP8_MEMORY_SIZE];    // block starting at each address, or -1
+    Chip8Block *blocks;             // by start address
+    int block_count;
+    uint16_t entry;
+    uint16_t program_end;           // one past the last non-zero byte from 0x200
+    int instructions;
+    int loops;
+    int indirect_jumps;
+    int self_modifying_writes;
+    int unknown_writes;
+    int data_bytes;                 // bytes before program_end that are never run
+} Chip8Analysis;
+
+int chip8_analyze(const Chip8 *chip8, Chip8Analysis *analysis);
+void chip8_analysis_free(Chip8Analysis *analysis);
+void chip8_disassemble(uint16_t opcode, char *text, size_t size);
+void chip8_analysis_write_text(const Chip8Analysis *analysis, FILE *out);
+void chip8_analysis_write_dot(const Chip8Analysis *analysis, FILE *out);
+
+// Ahead-of-time translation (src/aot.c, chip8-aot). A CHIP-8 ROM is
+// written out as C, one function per block from chip8_analyze, and built
+// into a binary of its own (chip8_aot_game in CMakeLists.txt). The
+// generated file defines a Chip8AotProgram; run it on a machine with the
+// ROM loaded with chip8_aot_run, which goes through the interpreter for
+// whatever the translation doesn't cover: BNNN targets it never saw and
+// code that has been written over. One Chip8Aot per machine; after
+// replacing memory (loading a state), call chip8_aot_invalidate_all.
+typedef struct Chip8Aot Chip8Aot;
+
+// Runs from chip8->pc, anywhere in the block, for at most `budget`
+// instructions, and returns how many ran
+typedef uint32_t (*Chip8AotBlockFn)(Chip8 *chip8, Chip8Aot *aot, uint32_t budget);
+
+typedef struct {
+    uint16_t start;                 // first instruction
+    uint16_t end;                   // one past the last byte it was built from
+    Chip8AotBlockFn fn;
+} Chip8AotBlock;
+
+typedef struct {
+    const char *name;               // ROM it was translated from
+    const uint8_t *rom;
+    size_t rom_size;
+    uint8_t quirks;                 // Chip8Quirks it was translated for
+    const Chip8AotBlock *blocks;    // by start address
+    int block_count;
+} Chip8AotProgram;
+
+typedef struct {
+    uint64_t native_cycles;         // cycles run in translated blocks
+    uint64_t interpreted_cycles;    // and in the interpreter
+    uint64_t checks;                // blocks compared with memory
+    uint64_t invalidations;         // blocks written over, to compare again
+} Chip8AotStats;
+
+int chip8_aot_translate(const Chip8Rom *rom, Chip8Quirks quirks, const char *symbol, FILE *out);
+Chip8Aot *chip8_aot_create(const Chip8AotProgram *program);
+void chip8_aot_destroy(Chip8Aot *aot);
+int chip8_aot_matches(const Chip8AotProgram *program, const Chip8 *chip8);
+uint64_t chip8_aot_run(void *aot, Chip8 *chip8, uint64_t cycles);
+void chip8_aot_invalidate(Chip8Aot *aot, uint16_t addr, uint16_t size);
+void chip8_aot_invalidate_all(Chip8Aot *aot);
+void chip8_aot_get_stats(const Chip8Aot *aot, Chip8AotStats *stats);
+
+// Scripted keypad input for headless runs: before cycle `cycle` runs,
+// set `key` to `pressed`
+typedef struct {
+    long cycle;
+    uint8_t key;
+    uint8_t pressed;
+} Chip8InputEvent;
+
+typedef struct {
+    Chip8InputEvent *events;
+    int count;
+} Chip8InputScript;
+
+// Progress of a headless run that is driven a few cycles at a time
+typedef struct {
+    const Chip8InputScript *script;
+    int next_event;                 // next script event to apply
+    Chip8Scheduler sched;           // sched.cycles is the number of cycles run so far
+    struct Chip8Recorder *recorder; // if set, keypad changes are recorded here
+} Chip8HeadlessRun;
+
+// Headless running (src/headless.c)
+int chip8_load_input_script(Chip8InputScript *script, const char *filename);
+void chip8_free_input_script(Chip8InputScript *script);
+void chip8_headless_begin(Chip8HeadlessRun *run, const Chip8InputScript *script, uint64_t cpu_hz);
+long chip8_headless_step(Chip8 *chip8, Chip8HeadlessRun *run, long cycles);
+long chip8_run_headless(Chip8 *chip8, const Chip8InputScript *script, long cycles, uint64_t cpu_hz);
+void chip8_dump_state(Chip8 *chip8, FILE *out);
+
+// Input replays (src/replay.c). A recording stores every keypad change by
+// cycle number, plus the seed and CPU speed, so playing it back through
+// Chip8HeadlessRun gives the same machine bit for bit.
+#define CHIP8_REPLAY_VERSION 2
+
+typedef struct Chip8Recorder {
+    FILE *file;
+    uint64_t last_cycle;            // cycle of the last record written
+    uint16_t keys;                  // keypad as last written, bit N = key N
+    long records;
+} Chip8Recorder;
+
+typedef struct {
+    unsigned variant;               // Chip8Variant it was recorded on
+    unsigned quirks;                // and its Chip8Quirks
+    uint32_t rng_state;             // CXNN generator state before the first cycle
+    uint64_t cpu_hz;
+    uint64_t cycles;                // length of the recording
+    uint64_t start_hash;            // chip8_state_hash before the first cycle
+    uint64_t end_hash;              // and after the last one
+    Chip8InputScript script;        // the keypad changes as key events
+} Chip8Replay;
+
+int chip8_record_begin(Chip8Recorder *recorder, const char *filename, const Chip8 *chip8, uint64_t cpu_hz);
+void chip8_record_keys(Chip8Recorder *recorder, const Chip8 *chip8, uint64_t cycle);
+int chip8_record_end(Chip8Recorder *recorder, const Chip8 *chip8, uint64_t cycles);
+int chip8_load_replay(Chip8Replay *replay, const char *filename);
+void chip8_free_replay(Chip8Replay *replay);
+int chip8_replay_prepare(const Chip8Replay *replay, Chip8 *chip8);
+
+// One batch job: run `rom` for `cycles` cycles at `cpu_hz` (0 = default)
+// with keypad input from `script` (may be NULL) and the CXNN generator
+// seeded with `seed`
+typedef struct {
+    const uint8_t *rom;
+    size_t rom_size;
+    const Chip8InputScript *script;
+    long cycles;
+    uint64_t cpu_hz;
+    unsigned int seed;
+    Chip8Variant variant;           // CHIP8_VARIANT_CHIP8 (0) unless set
+    Chip8Quirks quirks;             // CHIP8_QUIRKS_DEFAULT (0) unless set
+    const Chip8 *start;             // if set, a machine with the ROM loaded to fork instead (Chip8Rom.start)
+} Chip8BatchJob;
+
+typedef struct {
+    int ok;                         // 0 if the job couldn't run (ROM too big)
+    long cycles;                    // cycles actually run
+    long frames;                    // frames (60 Hz timer ticks) run, counting a final partial one
+    uint64_t state_hash;            // chip8_state_hash of the final machine
+    uint64_t frames_hash;           // hash over every frame's display checksum
+    uint64_t *frame_checksums;      // per-frame checksums, if asked for (malloc'd)
+} Chip8BatchResult;
+
+// Batch running (src/batch.c)
+int chip8_batch_run(const Chip8BatchJob *jobs, Chip8BatchResult *results, int job_count,
+                    int threads, int keep_frame_checksums);
+void chip8_batch_free_results(Chip8BatchResult *results, int job_count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,605 @@
+// Static analysis
+// Recursive-descent disassembly: start at the entry point, decode with
+// chip8_decode, and follow every way an instruction can hand on control -
+// straight on, 1NNN, 2NNN and the return after it, and both sides of a
+// skip. What is never reached that way is data (or dead code). Jump
+// targets, skip landings and return points start basic blocks.
+//
+// I is followed through the blocks so FX33 and FX55 can be checked against
+// the code: it is known after ANNN, unknown after FX1E or FX29, and unknown
+// where blocks with different I meet and after a call returns (the callee
+// may have changed it). A write through a known I that lands on code is
+// self-modifying; one through an unknown I might be.
+//
+// Only CHIP-8 (4KB) memory and instructions are understood, under the
+// machine's quirk profile.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+
+#define I_UNSEEN -2                 // no path into the block seen yet
+#define I_UNKNOWN -1
+
+static int is_skip(uint8_t op) {
+    return op == CHIP8_OP_3XNN || op == CHIP8_OP_4XNN || op == CHIP8_OP_5XY0 || op == CHIP8_OP_9XY0 ||
+           op == CHIP8_OP_EX9E || op == CHIP8_OP_EXA1;
+}
+
+static uint16_t opcode_at(const Chip8Analysis *a, uint16_t addr) {
+    return a->memory[addr] << 8 | a->memory[addr + 1];
+}
+
+// How far FX55/FX65 move I, by quirk profile (see src/quirks.c)
+static int memory_increment(const Chip8 *chip8, uint8_t x) {
+    switch (chip8->quirks) {
+    case CHIP8_QUIRKS_VIP:
+    case CHIP8_QUIRKS_MODERN:
+        return x + 1;
+    case CHIP8_QUIRKS_CHIP48:
+        return x;
+    default:
+        return 0;
+    }
+}
+
+// Mark `addr` as the start of a block; returns 1 the first time so the
+// caller knows to walk it
+static int lead(Chip8Analysis *a, int addr) {
+    if (addr + 1 >= CHIP8_MEMORY_SIZE || (a->addr[addr] & CHIP8_ANALYSIS_LEADER)) {
+        return 0;
+    }
+    a->addr[addr] |= CHIP8_ANALYSIS_LEADER;
+    return 1;
+}
+
+// Find every instruction reachable from the entry
+static void discover(Chip8Analysis *a) {
+    static uint16_t pending[CHIP8_MEMORY_SIZE];
+    int count = 0;
+    if (lead(a, a->entry)) {
+        pending[count++] = a->entry;
+    }
+    while (count > 0) {
+        int pc = pending[--count];
+        while (pc + 1 < CHIP8_MEMORY_SIZE && !(a->addr[pc] & CHIP8_ANALYSIS_CODE)) {
+            a->addr[pc] |= CHIP8_ANALYSIS_CODE;
+            a->addr[pc + 1] |= CHIP8_ANALYSIS_OPERAND;
+            Chip8Instruction in;
+            chip8_decode(opcode_at(a, pc), &in);
+            if (in.op == CHIP8_OP_1NNN || in.op == CHIP8_OP_2NNN) {
+                if (lead(a, in.nnn)) {
+                    pending[count++] = in.nnn;
+                }
+                if (in.op == CHIP8_OP_2NNN && lead(a, pc + 2)) {
+                    pending[count++] = pc + 2;
+                }
+                break;
+            }
+            if (is_skip(in.op)) {
+                if (lead(a, pc + 2)) {
+                    pending[count++] = pc + 2;
+                }
+                if (lead(a, pc + 4)) {
+                    pending[count++] = pc + 4;
+                }
+                break;
+            }
+            if (in.op == CHIP8_OP_00EE || in.op == CHIP8_OP_BNNN) {
+                break;
+            }
+            pc += 2;
+        }
+    }
+}
+
+// Cut the code into blocks, one per leader
+static int build_blocks(Chip8Analysis *a) {
+    int count = 0;
+    for (int addr = 0; addr < CHIP8_MEMORY_SIZE; addr++) {
+        a->block_at[addr] = -1;
+        count += (a->addr[addr] & CHIP8_ANALYSIS_LEADER) && (a->addr[addr] & CHIP8_ANALYSIS_CODE);
+    }
+    a->blocks = calloc(count ? count : 1, sizeof(Chip8Block));
+    if (!a->blocks) {
+        printf("Error: Out of memory for %d blocks\n", count);
+        return 0;
+    }
+
+    for (int addr = 0; addr < CHIP8_MEMORY_SIZE; addr++) {
+        if (!(a->addr[addr] & CHIP8_ANALYSIS_LEADER) || !(a->addr[addr] & CHIP8_ANALYSIS_CODE)) {
+            continue;
+        }
+        Chip8Block *b = &a->blocks[a->block_count];
+        a->block_at[addr] = a->block_count++;
+        b->start = addr;
+        int pc = addr;
+        for (;;) {
+            Chip8Instruction in;
+            chip8_decode(opcode_at(a, pc), &in);
+            b->length++;
+            b->end = pc + 2;
+            if (in.op == CHIP8_OP_FX0A) {
+                b->flags |= CHIP8_BLOCK_WAITS_KEY;
+            } else if (in.op == CHIP8_OP_FX33 || in.op == CHIP8_OP_FX55) {
+                b->flags |= CHIP8_BLOCK_WRITES;
+            }
+
+            if (in.op == CHIP8_OP_1NNN) {
+                b->exit = in.nnn == pc ? CHIP8_EXIT_HALT : CHIP8_EXIT_JUMP;
+                b->next[b->next_count++] = in.nnn;
+            } else if (in.op == CHIP8_OP_2NNN) {
+                b->exit = CHIP8_EXIT_CALL;
+                b->call = in.nnn;
+                b->next[b->next_count++] = pc + 2;
+            } else if (in.op == CHIP8_OP_00EE) {
+                b->exit = CHIP8_EXIT_RETURN;
+            } else if (in.op == CHIP8_OP_BNNN) {
+                b->exit = CHIP8_EXIT_INDIRECT;
+                a->indirect_jumps++;
+            } else if (is_skip(in.op)) {
+                b->exit = CHIP8_EXIT_SKIP;
+                b->next[b->next_count++] = pc + 2;
+                b->next[b->next_count++] = pc + 4;
+            } else if (pc + 3 >= CHIP8_MEMORY_SIZE) {
+                b->exit = CHIP8_EXIT_END;
+            } else if (a->addr[pc + 2] & CHIP8_ANALYSIS_LEADER) {
+                b->exit = CHIP8_EXIT_FALLTHROUGH;
+                b->next[b->next_count++] = pc + 2;
+            } else {
+                pc += 2;
+                continue;
+            }
+            break;
+        }
+    }
+    return 1;
+}
+
+// Block index at `addr`, or -1 if no block starts there
+static int block_index(const Chip8Analysis *a, int addr) {
+    return addr < CHIP8_MEMORY_SIZE ? a->block_at[addr] : -1;
+}
+
+// Mark `count` bytes from `i` with `flag`; returns 1 if any of them is code
+static int touch(Chip8Analysis *a, int i, int count, uint8_t flag) {
+    int code = 0;
+    for (int k = 0; k < count; k++) {
+        int addr = (i + k) % CHIP8_MEMORY_SIZE;
+        a->addr[addr] |= flag;
+        code |= (a->addr[addr] & (CHIP8_ANALYSIS_CODE | CHIP8_ANALYSIS_OPERAND)) != 0;
+    }
+    return code;
+}
+
+// Run I through block `b` from `i` on entry; returns I on the way out.
+// With `record`, mark what it points at, reads and writes on the way.
+static int follow_i(Chip8Analysis *a, const Chip8 *chip8, Chip8Block *b, int i, int record) {
+    for (int pc = b->start; pc < b->end; pc += 2) {
+        Chip8Instruction in;
+        chip8_decode(opcode_at(a, pc), &in);
+        switch (in.op) {
+        case CHIP8_OP_ANNN:
+            i = in.nnn;
+            if (record) {
+                a->addr[i] |= CHIP8_ANALYSIS_POINTER;
+            }
+            break;
+        case CHIP8_OP_FX1E:
+        case CHIP8_OP_FX29:
+            i = I_UNKNOWN;
+            break;
+        case CHIP8_OP_DXYN:
+            if (record && i >= 0) {
+                touch(a, i, in.n, CHIP8_ANALYSIS_READ);
+            }
+            break;
+        case CHIP8_OP_FX65:
+            if (record && i >= 0) {
+                touch(a, i, in.x + 1, CHIP8_ANALYSIS_READ);
+            }
+            if (i >= 0) {
+                i = (i + memory_increment(chip8, in.x)) & 0xFFFF;
+            }
+            break;
+        case CHIP8_OP_FX33:
+        case CHIP8_OP_FX55:
+            if (record && i < 0) {
+                b->flags |= CHIP8_BLOCK_UNKNOWN_WRITE;
+                a->unknown_writes++;
+            } else if (record && touch(a, i, in.op == CHIP8_OP_FX33 ? 3 : in.x + 1, CHIP8_ANALYSIS_WRITTEN)) {
+                b->flags |= CHIP8_BLOCK_SELF_MODIFY;
+                a->self_modifying_writes++;
+            }
+            if (in.op == CHIP8_OP_FX55 && i >= 0) {
+                i = (i + memory_increment(chip8, in.x)) & 0xFFFF;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return i;
+}
+
+// I on entry to block `to` is `i` if every way in agrees, else unknown.
+// Returns 1 if that changed anything.
+static int meet(int *entry, int to, int i) {
+    if (to < 0 || entry[to] == I_UNKNOWN || entry[to] == i) {
+        return 0;
+    }
+    entry[to] = entry[to] == I_UNSEEN ? i : I_UNKNOWN;
+    return 1;
+}
+
+static int track_i(Chip8Analysis *a, const Chip8 *chip8) {
+    int *entry = malloc(a->block_count * sizeof(int));
+    if (a->block_count && !entry) {
+        printf("Error: Out of memory for the analysis\n");
+        return 0;
+    }
+    for (int k = 0; k < a->block_count; k++) {
+        entry[k] = I_UNSEEN;
+    }
+    meet(entry, block_index(a, a->entry), chip8->I);
+
+    // Each block's I can only go unseen -> known -> unknown, so this settles
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int k = 0; k < a->block_count; k++) {
+            Chip8Block *b = &a->blocks[k];
+            if (entry[k] == I_UNSEEN) {
+                continue;
+            }
+            int i = follow_i(a, chip8, b, entry[k], 0);
+            if (b->exit == CHIP8_EXIT_CALL) {
+                changed |= meet(entry, block_index(a, b->call), i);
+                changed |= meet(entry, block_index(a, b->next[0]), I_UNKNOWN);
+                continue;
+            }
+            for (int n = 0; n < b->next_count; n++) {
+                changed |= meet(entry, block_index(a, b->next[n]), i);
+            }
+        }
+    }
+    for (int k = 0; k < a->block_count; k++) {
+        follow_i(a, chip8, &a->blocks[k], entry[k] == I_UNSEEN ? I_UNKNOWN : entry[k], 1);
+    }
+    free(entry);
+    return 1;
+}
+
+// Successors of block `k` as block indexes, calls included; returns how many
+static int successors(const Chip8Analysis *a, int k, int *out) {
+    const Chip8Block *b = &a->blocks[k];
+    int count = 0;
+    for (int n = 0; n < b->next_count; n++) {
+        int to = block_index(a, b->next[n]);
+        if (to >= 0) {
+            out[count++] = to;
+        }
+    }
+    if (b->exit == CHIP8_EXIT_CALL && block_index(a, b->call) >= 0) {
+        out[count++] = block_index(a, b->call);
+    }
+    return count;
+}
+
+// Depth-first walk from the entry; an edge back to a block still on the
+// walk's stack closes a loop. The loop's body is what reaches the edge's
+// source backwards without going through the header.
+static int find_loops(Chip8Analysis *a) {
+    int n = a->block_count;
+    int entry = block_index(a, a->entry);
+    if (entry < 0) {
+        return 1;
+    }
+    // Every block has at most 3 successors, so at most 3n edges
+    int *scratch = calloc(14 * (size_t)n + 1, sizeof(int));
+    if (!scratch) {
+        printf("Error: Out of memory for the analysis\n");
+        return 0;
+    }
+    int *state = scratch;                   // 0 unvisited, 1 on the stack, 2 done
+    int *stack = state + n;
+    int *edge = stack + n;                  // next successor to try, by block
+    int *member = edge + n;                 // header the block was last counted for
+    int *work = member + n;
+    int *pred_start = work + n;             // n + 1
+    int *preds = pred_start + n + 1;        // 3n
+    int *back_from = preds + 3 * n;         // 3n
+    int *back_to = back_from + 3 * n;       // 3n
+
+    // Predecessor lists: count, sum, then fill (using `edge` as the cursor)
+    int to[3];
+    for (int k = 0; k < n; k++) {
+        int count = successors(a, k, to);
+        for (int s = 0; s < count; s++) {
+            pred_start[to[s] + 1]++;
+        }
+    }
+    for (int k = 0; k < n; k++) {
+        pred_start[k + 1] += pred_start[k];
+        member[k] = -1;
+    }
+    for (int k = 0; k < n; k++) {
+        int count = successors(a, k, to);
+        for (int s = 0; s < count; s++) {
+            preds[pred_start[to[s]] + edge[to[s]]++] = k;
+        }
+    }
+    memset(edge, 0, n * sizeof(int));
+
+    int back_edges = 0;
+    int depth = 0;
+    stack[depth++] = entry;
+    state[entry] = 1;
+    while (depth > 0) {
+        int k = stack[depth - 1];
+        int count = successors(a, k, to);
+        if (edge[k] == count) {
+            state[k] = 2;
+            depth--;
+            continue;
+        }
+        int s = to[edge[k]++];
+        if (state[s] == 0) {
+            state[s] = 1;
+            stack[depth++] = s;
+        } else if (state[s] == 1) {
+            back_from[back_edges] = k;
+            back_to[back_edges++] = s;
+            a->blocks[s].flags |= CHIP8_BLOCK_LOOP_HEADER;
+        }
+    }
+
+    // One loop per header, however many edges close it
+    for (int h = 0; h < n; h++) {
+        if (!(a->blocks[h].flags & CHIP8_BLOCK_LOOP_HEADER)) {
+            continue;
+        }
+        a->loops++;
+        a->blocks[h].loop_depth++;
+        member[h] = h;
+        int pending = 0;
+        for (int e = 0; e < back_edges; e++) {
+            if (back_to[e] == h && member[back_from[e]] != h) {
+                member[back_from[e]] = h;
+                work[pending++] = back_from[e];
+            }
+        }
+        while (pending > 0) {
+            int m = work[--pending];
+            a->blocks[m].loop_depth++;
+            for (int p = pred_start[m]; p < pred_start[m + 1]; p++) {
+                if (member[preds[p]] != h) {
+                    member[preds[p]] = h;
+                    work[pending++] = preds[p];
+                }
+            }
+        }
+    }
+    free(scratch);
+    return 1;
+}
+
+// Analyse `chip8` from its pc. Returns 1 on success, 0 if out of memory or
+// `chip8` isn't a CHIP-8 machine. Free the result with chip8_analysis_free.
+int chip8_analyze(const Chip8 *chip8, Chip8Analysis *analysis) {
+    Chip8Analysis *a = analysis;
+    memset(a, 0, sizeof(*a));
+    if (chip8->variant != CHIP8_VARIANT_CHIP8) {
+        printf("Error: Only CHIP-8 programs can be analysed, not %s\n", chip8_variant_name(chip8->variant));
+        return 0;
+    }
+    for (int addr = 0; addr < CHIP8_MEMORY_SIZE; addr++) {
+        a->memory[addr] = chip8_mem_read(chip8, addr);
+        if (addr >= 0x200 && a->memory[addr]) {
+            a->program_end = addr + 1;
+        }
+    }
+    a->entry = chip8->pc % CHIP8_MEMORY_SIZE;
+
+    discover(a);
+    if (!build_blocks(a) || !track_i(a, chip8) || !find_loops(a)) {
+        chip8_analysis_free(a);
+        return 0;
+    }
+    for (int k = 0; k < a->block_count; k++) {
+        a->instructions += a->blocks[k].length;
+    }
+    for (int addr = 0x200; addr < a->program_end; addr++) {
+        a->data_bytes += !(a->addr[addr] & (CHIP8_ANALYSIS_CODE | CHIP8_ANALYSIS_OPERAND));
+    }
+    return 1;
+}
+
+void chip8_analysis_free(Chip8Analysis *analysis) {
+    free(analysis->blocks);
+    analysis->blocks = NULL;
+    analysis->block_count = 0;
+}
+
+// Write `opcode` as assembly, in the usual Cowgod mnemonics
+void chip8_disassemble(uint16_t opcode, char *text, size_t size) {
+    Chip8Instruction in;
+    chip8_decode(opcode, &in);
+    int x = in.x, y = in.y;
+    switch (in.op) {
+    case CHIP8_OP_00E0: snprintf(text, size, "CLS"); break;
+    case CHIP8_OP_00EE: snprintf(text, size, "RET"); break;
+    case CHIP8_OP_1NNN: snprintf(text, size, "JP 0x%03X", in.nnn); break;
+    case CHIP8_OP_2NNN: snprintf(text, size, "CALL 0x%03X", in.nnn); break;
+    case CHIP8_OP_3XNN: snprintf(text, size, "SE V%X, 0x%02X", x, in.nn); break;
+    case CHIP8_OP_4XNN: snprintf(text, size, "SNE V%X, 0x%02X", x, in.nn); break;
+    case CHIP8_OP_5XY0: snprintf(text, size, "SE V%X, V%X", x, y); break;
+    case CHIP8_OP_6XNN: snprintf(text, size, "LD V%X, 0x%02X", x, in.nn); break;
+    case CHIP8_OP_7XNN: snprintf(text, size, "ADD V%X, 0x%02X", x, in.nn); break;
+    case CHIP8_OP_8XY0: snprintf(text, size, "LD V%X, V%X", x, y); break;
+    case CHIP8_OP_8XY1: snprintf(text, size, "OR V%X, V%X", x, y); break;
+    case CHIP8_OP_8XY2: snprintf(text, size, "AND V%X, V%X", x, y); break;
+    case CHIP8_OP_8XY3: snprintf(text, size, "XOR V%X, V%X", x, y); break;
+    case CHIP8_OP_8XY4: snprintf(text, size, "ADD V%X, V%X", x, y); break;
+    case CHIP8_OP_8XY5: snprintf(text, size, "SUB V%X, V%X", x, y); break;
+    case CHIP8_OP_8XY6: snprintf(text, size, "SHR V%X, V%X", x, y); break;
+    case CHIP8_OP_8XY7: snprintf(text, size, "SUBN V%X, V%X", x, y); break;
+    case CHIP8_OP_9XY0: snprintf(text, size, "SNE V%X, V%X", x, y); break;
+    case CHIP8_OP_ANNN: snprintf(text, size, "LD I, 0x%03X", in.nnn); break;
+    case CHIP8_OP_BNNN: snprintf(text, size, "JP V0, 0x%03X", in.nnn); break;
+    case CHIP8_OP_CXNN: snprintf(text, size, "RND V%X, 0x%02X", x, in.nn); break;
+    case CHIP8_OP_DXYN: snprintf(text, size, "DRW V%X, V%X, %d", x, y, in.n); break;
+    case CHIP8_OP_EX9E: snprintf(text, size, "SKP V%X", x); break;
+    case CHIP8_OP_EXA1: snprintf(text, size, "SKNP V%X", x); break;
+    case CHIP8_OP_FX07: snprintf(text, size, "LD V%X, DT", x); break;
+    case CHIP8_OP_FX0A: snprintf(text, size, "LD V%X, K", x); break;
+    case CHIP8_OP_FX15: snprintf(text, size, "LD DT, V%X", x); break;
+    case CHIP8_OP_FX18: snprintf(text, size, "LD ST, V%X", x); break;
+    case CHIP8_OP_FX1E: snprintf(text, size, "ADD I, V%X", x); break;
+    case CHIP8_OP_FX29: snprintf(text, size, "LD F, V%X", x); break;
+    case CHIP8_OP_FX33: snprintf(text, size, "LD B, V%X", x); break;
+    case CHIP8_OP_FX55: snprintf(text, size, "LD [I], V%X", x); break;
+    case CHIP8_OP_FX65: snprintf(text, size, "LD V%X, [I]", x); break;
+    default:
+        // The default core ignores 8XYE; the quirk profiles run it
+        if ((opcode & 0xF00F) == 0x800E) {
+            snprintf(text, size, "SHL V%X, V%X", x, y);
+        } else {
+            snprintf(text, size, "DW 0x%04X", opcode);
+        }
+        break;
+    }
+}
+
+static void describe_exit(const Chip8Block *b, char *text, size_t size) {
+    switch (b->exit) {
+    case CHIP8_EXIT_FALLTHROUGH: snprintf(text, size, "falls through to 0x%03X", b->next[0]); break;
+    case CHIP8_EXIT_JUMP: snprintf(text, size, "jumps to 0x%03X", b->next[0]); break;
+    case CHIP8_EXIT_HALT: snprintf(text, size, "halts (jumps to itself)"); break;
+    case CHIP8_EXIT_CALL: snprintf(text, size, "calls 0x%03X, returns to 0x%03X", b->call, b->next[0]); break;
+    case CHIP8_EXIT_RETURN: snprintf(text, size, "returns"); break;
+    case CHIP8_EXIT_SKIP: snprintf(text, size, "goes on to 0x%03X or skips to 0x%03X", b->next[0], b->next[1]); break;
+    case CHIP8_EXIT_INDIRECT: snprintf(text, size, "jumps indirectly (BNNN)"); break;
+    default: snprintf(text, size, "runs off the end of memory"); break;
+    }
+}
+
+static void write_block(const Chip8Analysis *a, const Chip8Block *b, FILE *out) {
+    char text[64];
+    describe_exit(b, text, sizeof(text));
+    fprintf(out, "\nblock 0x%03X-0x%03X: %d instruction%s, %s\n", b->start, b->end - 1, b->length,
+            b->length == 1 ? "" : "s", text);
+    if (b->flags & CHIP8_BLOCK_LOOP_HEADER) {
+        fprintf(out, "  ; loop header\n");
+    }
+    if (b->loop_depth) {
+        fprintf(out, "  ; in %d loop%s\n", b->loop_depth, b->loop_depth == 1 ? "" : "s");
+    }
+    if (b->flags & CHIP8_BLOCK_SELF_MODIFY) {
+        fprintf(out, "  ; writes over code\n");
+    }
+    if (b->flags & CHIP8_BLOCK_UNKNOWN_WRITE) {
+        fprintf(out, "  ; writes through an unknown I\n");
+    }
+    if (b->flags & CHIP8_BLOCK_WAITS_KEY) {
+        fprintf(out, "  ; waits for a key\n");
+    }
+    for (int pc = b->start; pc < b->end; pc += 2) {
+        uint16_t opcode = opcode_at(a, pc);
+        chip8_disassemble(opcode, text, sizeof(text));
+        fprintf(out, "  %03X  %04X  %s\n", pc, opcode, text);
+    }
+}
+
+// Bytes from `start` that are never run, up to the next instruction or
+// the end of the program; returns one past the last
+static int data_end(const Chip8Analysis *a, int start) {
+    int end = start;
+    while (end < a->program_end && !(a->addr[end] & (CHIP8_ANALYSIS_CODE | CHIP8_ANALYSIS_OPERAND))) {
+        end++;
+    }
+    return end;
+}
+
+static void write_data(const Chip8Analysis *a, int start, int end, FILE *out) {
+    uint8_t seen = 0;
+    for (int addr = start; addr < end; addr++) {
+        seen |= a->addr[addr];
+    }
+    fprintf(out, "\ndata 0x%03X-0x%03X: %d bytes%s%s%s\n", start, end - 1, end - start,
+            seen & CHIP8_ANALYSIS_POINTER ? ", pointed at by ANNN" : "",
+            seen & CHIP8_ANALYSIS_READ ? ", read" : "", seen & CHIP8_ANALYSIS_WRITTEN ? ", written" : "");
+    for (int addr = start; addr < end; addr += 8) {
+        fprintf(out, "  %03X ", addr);
+        for (int k = addr; k < end && k < addr + 8; k++) {
+            fprintf(out, " %02X", a->memory[k]);
+        }
+        fprintf(out, "\n");
+    }
+}
+
+// The whole analysis as an assembly listing: a summary, then every block
+// and data region in address order
+void chip8_analysis_write_text(const Chip8Analysis *a, FILE *out) {
+    fprintf(out, "; entry 0x%03X, program ends at 0x%03X\n", a->entry, a->program_end);
+    fprintf(out, "; %d instructions in %d blocks, %d data bytes\n", a->instructions, a->block_count,
+            a->data_bytes);
+    fprintf(out, "; %d loops, %d indirect jumps, %d self-modifying writes, %d writes through an unknown I\n",
+            a->loops, a->indirect_jumps, a->self_modifying_writes, a->unknown_writes);
+    if (a->loops) {
+        fprintf(out, "; loops:");
+        for (int k = 0; k < a->block_count; k++) {
+            if (a->blocks[k].flags & CHIP8_BLOCK_LOOP_HEADER) {
+                fprintf(out, " 0x%03X", a->blocks[k].start);
+            }
+        }
+        fprintf(out, "\n");
+    }
+
+    for (int addr = 0; addr < CHIP8_MEMORY_SIZE; addr++) {
+        if (a->block_at[addr] >= 0) {
+            write_block(a, &a->blocks[a->block_at[addr]], out);
+        } else if (addr >= 0x200 && addr < a->program_end &&
+                   !(a->addr[addr] & (CHIP8_ANALYSIS_CODE | CHIP8_ANALYSIS_OPERAND))) {
+            int end = data_end(a, addr);
+            write_data(a, addr, end, out);
+            addr = end - 1;
+        }
+    }
+}
+
+// The control-flow graph for Graphviz: a box per block with its listing,
+// loop headers doubled, blocks Graphviz can't follow out of in red. Calls
+// are bold, skips dashed where taken.
+void chip8_analysis_write_dot(const Chip8Analysis *a, FILE *out) {
+    fprintf(out, "digraph chip8 {\n");
+    fprintf(out, "    node [shape=box fontname=\"monospace\"];\n");
+    for (int k = 0; k < a->block_count; k++) {
+        const Chip8Block *b = &a->blocks[k];
+        fprintf(out, "    b%03X [label=\"", b->start);
+        for (int pc = b->start; pc < b->end; pc += 2) {
+            char text[32];
+            chip8_disassemble(opcode_at(a, pc), text, sizeof(text));
+            fprintf(out, "%03X  %s\\l", pc, text);
+        }
+        fprintf(out, "\"");
+        if (b->flags & CHIP8_BLOCK_LOOP_HEADER) {
+            fprintf(out, " peripheries=2");
+        }
+        if (b->exit == CHIP8_EXIT_INDIRECT || (b->flags & (CHIP8_BLOCK_SELF_MODIFY | CHIP8_BLOCK_UNKNOWN_WRITE))) {
+            fprintf(out, " color=red");
+        }
+        fprintf(out, "];\n");
+        for (int n = 0; n < b->next_count; n++) {
+            if (block_index(a, b->next[n]) >= 0) {
+                fprintf(out, "    b%03X -> b%03X%s;\n", b->start, b->next[n],
+                        b->exit == CHIP8_EXIT_SKIP && n == 1 ? " [style=dashed]" : "");
+            }
+        }
+        if (b->exit == CHIP8_EXIT_CALL && block_index(a, b->call) >= 0) {
+            fprintf(out, "    b%03X -> b%03X [style=bold];\n", b->start, b->call);
+        }
+    }
+    fprintf(out, "}\n");
+}
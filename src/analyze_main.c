@@ -0,0 +1,77 @@
+// chip8-analyze - disassemble a ROM and map its control flow
+//
+// Usage: chip8-analyze [--dot] [--quirks NAME] <rom>
+//
+// Prints a listing of every block and data region with a summary of what
+// the analysis couldn't see through (src/analyze.c), or with --dot the
+// control-flow graph for Graphviz:
+//
+//   chip8-analyze --dot game.ch8 | dot -Tsvg > game.svg
+//
+// The quirk profile (from the ROM database unless --quirks names one)
+// decides how far FX55/FX65 move I.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s [--dot] [--quirks NAME] <rom>\n", prog);
+    printf("  --dot: write the control-flow graph for Graphviz instead of a listing\n");
+    printf("  --quirks NAME: default, vip, chip48, schip or modern (default: from the ROM database)\n");
+}
+
+int main(int argc, char *argv[]) {
+    int dot = 0;
+    int quirks = -1;
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--dot") == 0) {
+            dot = 1;
+        } else if (strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+            quirks = chip8_quirks_from_name(argv[++i]);
+            if (quirks < 0) {
+                printf("Error: --quirks must be default, vip, chip48, schip or modern\n");
+                return 1;
+            }
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!path) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    Chip8RomLibrary *library = chip8_library_create();
+    const Chip8Rom *rom = library ? chip8_library_add_file(library, path) : NULL;
+    if (!rom) {
+        chip8_library_close(library);
+        return 1;
+    }
+    Chip8 chip8;
+    chip8_rom_start(rom, &chip8);
+    if (quirks < 0) {
+        quirks = rom->quirks;
+    }
+    if (quirks >= 0 && rom->variant == CHIP8_VARIANT_CHIP8) {
+        chip8_set_quirks(&chip8, (Chip8Quirks)quirks);
+    }
+
+    static Chip8Analysis analysis;
+    int ok = chip8_analyze(&chip8, &analysis);
+    if (ok && dot) {
+        chip8_analysis_write_dot(&analysis, stdout);
+    } else if (ok) {
+        printf("; %s (%zu bytes, %s quirks)\n", rom->name, rom->size, chip8_quirks_name(chip8.quirks));
+        chip8_analysis_write_text(&analysis, stdout);
+    }
+    chip8_analysis_free(&analysis);
+    chip8_free(&chip8);
+    chip8_library_close(library);
+    return ok ? 0 : 1;
+}
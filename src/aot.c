@@ -0,0 +1,504 @@
+// Ahead-of-time translation
+// chip8_aot_translate writes a CHIP-8 ROM out as C, one function per basic
+// block found by chip8_analyze. Every instruction becomes a few lines of C
+// with its operands filled in, so the compiled program never fetches or
+// decodes anything. The generated file defines a Chip8AotProgram, which is
+// linked into a frontend (CMake's chip8_aot_game) and run with
+// chip8_aot_run, a Chip8RunFn like the JIT's.
+//
+// A block can be entered at any of its instructions and runs at most the
+// cycles it is given, so the scheduler's slices are honoured to the cycle
+// and the next slice picks up where the last one stopped. Before a block
+// first runs, its bytes are compared with what it was translated from.
+// FX33 and FX55 mark any block they write over to be compared again, so
+// self-modified code goes back through the interpreter, one instruction at
+// a time, for as long as it differs. So does code the analysis never
+// reached: BNNN targets, addresses outside the ROM, and all of a machine
+// with a different ROM or quirk profile.
+//
+// Generated code mirrors src/chip8.c for the default quirks and
+// src/core_template.h for the rest, down to the order VF is written in.
+// It keeps no profile counters.
+#define _POSIX_C_SOURCE 200809L  // open_memstream
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "chip8.h"
+
+// Block states
+#define UNCHECKED 0                 // compare with the ROM before running
+#define MATCHES 1                   // memory holds what the block was built from
+#define MODIFIED 2                  // it doesn't; interpret until written again
+
+struct Chip8Aot {
+    const Chip8AotProgram *program;
+    int16_t block_of[CHIP8_MEMORY_SIZE];    // block with an instruction at each address, or -1
+    uint8_t *state;                 // by block
+    Chip8AotStats stats;
+};
+
+Chip8Aot *chip8_aot_create(const Chip8AotProgram *program) {
+    Chip8Aot *aot = calloc(1, sizeof(Chip8Aot));
+    if (!aot || !(aot->state = calloc(program->block_count ? program->block_count : 1, 1))) {
+        printf("Error: Out of memory for the translated program\n");
+        free(aot);
+        return NULL;
+    }
+    aot->program = program;
+    for (int addr = 0; addr < CHIP8_MEMORY_SIZE; addr++) {
+        aot->block_of[addr] = -1;
+    }
+    for (int b = 0; b < program->block_count; b++) {
+        for (int pc = program->blocks[b].start; pc < program->blocks[b].end; pc += 2) {
+            aot->block_of[pc] = b;
+        }
+    }
+    return aot;
+}
+
+void chip8_aot_destroy(Chip8Aot *aot) {
+    if (aot) {
+        free(aot->state);
+        free(aot);
+    }
+}
+
+// Whether the translated blocks can run on `chip8`: a CHIP-8 machine with
+// the quirk profile they were translated for. Memory is compared block by
+// block as they run.
+int chip8_aot_matches(const Chip8AotProgram *program, const Chip8 *chip8) {
+    return chip8->variant == CHIP8_VARIANT_CHIP8 && chip8->quirks == program->quirks;
+}
+
+// Compare block `b` with memory and remember the answer
+static int check(Chip8Aot *aot, const Chip8 *chip8, int b) {
+    const Chip8AotBlock *block = &aot->program->blocks[b];
+    const uint8_t *expected = aot->program->rom + (block->start - 0x200);
+    aot->state[b] = MATCHES;
+    for (int addr = block->start; addr < block->end; addr++) {
+        if (chip8_mem_read(chip8, addr) != expected[addr - block->start]) {
+            aot->state[b] = MODIFIED;
+            break;
+        }
+    }
+    aot->stats.checks++;
+    return aot->state[b] == MATCHES;
+}
+
+// Compare every block built from any byte in [addr, addr + size) again
+// before it next runs
+void chip8_aot_invalidate(Chip8Aot *aot, uint16_t addr, uint16_t size) {
+    int first = addr % CHIP8_MEMORY_SIZE;
+    int last = first + size;  // exclusive
+    if (last > CHIP8_MEMORY_SIZE) {
+        // The write wrapped around to the bottom of memory
+        chip8_aot_invalidate(aot, 0, last - CHIP8_MEMORY_SIZE);
+        last = CHIP8_MEMORY_SIZE;
+    }
+    for (int b = 0; b < aot->program->block_count; b++) {
+        const Chip8AotBlock *block = &aot->program->blocks[b];
+        if (block->start < last && block->end > first && aot->state[b] != UNCHECKED) {
+            aot->state[b] = UNCHECKED;
+            aot->stats.invalidations++;
+        }
+    }
+}
+
+// After memory came from somewhere else (a save state, rewinding)
+void chip8_aot_invalidate_all(Chip8Aot *aot) {
+    memset(aot->state, UNCHECKED, aot->program->block_count);
+}
+
+// Run exactly `cycles` cycles: translated blocks where pc is in one that
+// still matches memory, the machine's own engine one instruction at a
+// time everywhere else
+uint64_t chip8_aot_run(void *context, Chip8 *chip8, uint64_t cycles) {
+    Chip8Aot *aot = context;
+    Chip8RunFn interpret = chip8_machine_engine(chip8);
+    int native = chip8_aot_matches(aot->program, chip8);
+    uint64_t done = 0;
+
+    while (done < cycles) {
+        uint16_t pc = chip8->pc;
+        int b = native && pc < CHIP8_MEMORY_SIZE ? aot->block_of[pc] : -1;
+        if (b >= 0 && (aot->state[b] == MATCHES || (aot->state[b] == UNCHECKED && check(aot, chip8, b)))) {
+            uint64_t left = cycles - done;
+            uint32_t ran = aot->program->blocks[b].fn(chip8, aot, left > UINT32_MAX ? UINT32_MAX : (uint32_t)left);
+            done += ran;
+            aot->stats.native_cycles += ran;
+            continue;
+        }
+
+        // Interpret one instruction, and see whether it writes memory
+        uint16_t opcode = 0;
+        if (pc < CHIP8_MEMORY_SIZE - 1) {
+            opcode = chip8_mem_read(chip8, pc) << 8 | chip8_mem_read(chip8, pc + 1);
+        }
+        uint16_t write_addr = chip8->I;
+        if (interpret) {
+            interpret(NULL, chip8, 1);
+        }
+        else {
+            chip8_cycle(chip8);
+        }
+        done++;
+        aot->stats.interpreted_cycles++;
+
+        if ((opcode & 0xF0FF) == 0xF033) {
+            chip8_aot_invalidate(aot, write_addr, 3);
+        }
+        else if ((opcode & 0xF0FF) == 0xF055) {
+            chip8_aot_invalidate(aot, write_addr, ((opcode & 0x0F00) >> 8) + 1);
+        }
+    }
+    return done;
+}
+
+void chip8_aot_get_stats(const Chip8Aot *aot, Chip8AotStats *stats) {
+    *stats = aot->stats;
+}
+
+// Translation
+
+// Sprite drawing, as the default core (src/chip8.c) does it
+static const char draw_wrap[] =
+    "static void draw(Chip8 *c, uint8_t vx, uint8_t vy, uint8_t n) {\n"
+    "    unsigned shift = c->V[vx] % CHIP8_DISPLAY_WIDTH;\n"
+    "    unsigned top = c->V[vy];\n"
+    "    uint64_t collision = 0;\n"
+    "    for (int i = 0; i < n; i++) {\n"
+    "        uint64_t sprite = (uint64_t)chip8_mem_read(c, c->I + i) << 56;\n"
+    "        uint64_t row = (sprite >> shift) | (sprite << ((64 - shift) & 63));\n"
+    "        uint64_t *line = &c->display[(top + i) % CHIP8_DISPLAY_HEIGHT];\n"
+    "        collision |= *line & row;\n"
+    "        *line ^= row;\n"
+    "        c->dirty_rows |= (uint32_t)(row != 0) << ((top + i) % CHIP8_DISPLAY_HEIGHT);\n"
+    "    }\n"
+    "    c->V[0xF] = collision ? 1 : 0;\n"
+    "}\n";
+
+// and with sprites clipped at the screen edges (src/core_template.h,
+// CORE_CLIP). The modern profile wraps like the default.
+static const char draw_clip[] =
+    "static void draw(Chip8 *c, uint8_t vx, uint8_t vy, uint8_t n) {\n"
+    "    unsigned x = c->V[vx] % CHIP8_DISPLAY_WIDTH;\n"
+    "    unsigned top = c->V[vy] % CHIP8_DISPLAY_HEIGHT;\n"
+    "    uint64_t hit = 0;\n"
+    "    for (int i = 0; i < n; i++) {\n"
+    "        unsigned y = top + i;\n"
+    "        if (y >= CHIP8_DISPLAY_HEIGHT) {\n"
+    "            break;\n"
+    "        }\n"
+    "        uint64_t row = ((uint64_t)chip8_mem_read(c, c->I + i) << 56) >> x;\n"
+    "        hit |= c->display[y] & row;\n"
+    "        c->display[y] ^= row;\n"
+    "        c->dirty_rows |= (uint32_t)(row != 0) << y;\n"
+    "    }\n"
+    "    c->V[0xF] = hit ? 1 : 0;\n"
+    "}\n";
+
+static void emit_memory_step(FILE *out, const Chip8QuirkFlags *q, int x) {
+    if (q->memory_step == 1) {
+        fprintf(out, "    c->I += %d;\n", x + 1);
+    }
+    else if (q->memory_step == 2 && x > 0) {
+        fprintf(out, "    c->I += %d;\n", x);
+    }
+}
+
+// Write the C for the instruction at `pc`. Control flow ends the function
+// with a return; anything else falls through to the caller's budget check.
+// Returns 1 if the instruction left the block.
+static int emit_instruction(FILE *out, const Chip8QuirkFlags *q, const Chip8Block *b, uint16_t pc, uint16_t opcode) {
+    Chip8Instruction in;
+    chip8_decode(opcode, &in);
+    int x = in.x, y = in.y;
+    int next = pc + 2;
+    char pressed[32];
+    snprintf(pressed, sizeof(pressed), "c->keypad[V[0x%X] & 0xF]", x);
+
+    switch (in.op) {
+    case CHIP8_OP_00E0:
+        fprintf(out, "    memset(c->display, 0, sizeof(c->display));\n");
+        fprintf(out, "    c->dirty_rows = CHIP8_ALL_ROWS_DIRTY;\n");
+        return 0;
+    case CHIP8_OP_00EE:
+        fprintf(out, "    c->sp--;\n    c->pc = c->stack[c->sp & 0xF];\n    return ++done;\n");
+        return 1;
+    case CHIP8_OP_1NNN:
+        // Within the block (a loop or a jump to itself): stay in here
+        if (in.nnn >= b->start && in.nnn < b->end && (in.nnn - b->start) % 2 == 0) {
+            fprintf(out, "    if (++done == budget) {\n        c->pc = 0x%03X;\n        return done;\n    }\n", in.nnn);
+            fprintf(out, "    goto i%03X;\n", in.nnn);
+        }
+        else {
+            fprintf(out, "    c->pc = 0x%03X;\n    return ++done;\n", in.nnn);
+        }
+        return 1;
+    case CHIP8_OP_2NNN:
+        fprintf(out, "    c->stack[c->sp & 0xF] = 0x%03X;\n    c->sp++;\n", next);
+        fprintf(out, "    c->pc = 0x%03X;\n    return ++done;\n", in.nnn);
+        return 1;
+    case CHIP8_OP_3XNN:
+        fprintf(out, "    c->pc = V[0x%X] == 0x%02X ? 0x%03X : 0x%03X;\n    return ++done;\n", x, in.nn, pc + 4, next);
+        return 1;
+    case CHIP8_OP_4XNN:
+        fprintf(out, "    c->pc = V[0x%X] != 0x%02X ? 0x%03X : 0x%03X;\n    return ++done;\n", x, in.nn, pc + 4, next);
+        return 1;
+    case CHIP8_OP_5XY0:
+        fprintf(out, "    c->pc = V[0x%X] == V[0x%X] ? 0x%03X : 0x%03X;\n    return ++done;\n", x, y, pc + 4, next);
+        return 1;
+    case CHIP8_OP_9XY0:
+        fprintf(out, "    c->pc = V[0x%X] != V[0x%X] ? 0x%03X : 0x%03X;\n    return ++done;\n", x, y, pc + 4, next);
+        return 1;
+    case CHIP8_OP_EX9E:
+        fprintf(out, "    c->pc = %s ? 0x%03X : 0x%03X;\n    return ++done;\n", pressed, pc + 4, next);
+        return 1;
+    case CHIP8_OP_EXA1:
+        fprintf(out, "    c->pc = !%s ? 0x%03X : 0x%03X;\n    return ++done;\n", pressed, pc + 4, next);
+        return 1;
+    case CHIP8_OP_BNNN:
+        fprintf(out, "    c->pc = 0x%03X + V[0x%X];\n    return ++done;\n", in.nnn, q->jump_vx ? x : 0);
+        return 1;
+    case CHIP8_OP_6XNN:
+        fprintf(out, "    V[0x%X] = 0x%02X;\n", x, in.nn);
+        return 0;
+    case CHIP8_OP_7XNN:
+        fprintf(out, "    V[0x%X] += 0x%02X;\n", x, in.nn);
+        return 0;
+    case CHIP8_OP_8XY0:
+        fprintf(out, "    V[0x%X] = V[0x%X];\n", x, y);
+        return 0;
+    case CHIP8_OP_8XY1:
+    case CHIP8_OP_8XY2:
+    case CHIP8_OP_8XY3:
+        fprintf(out, "    V[0x%X] %c= V[0x%X];\n", x, "|&^"[in.op - CHIP8_OP_8XY1], y);
+        if (q->logic_resets_vf) {
+            fprintf(out, "    V[0xF] = 0;\n");
+        }
+        return 0;
+    case CHIP8_OP_8XY4:
+        if (q->is_default) {
+            fprintf(out, "    sum = V[0x%X] + V[0x%X];\n    V[0xF] = sum > 255;\n    V[0x%X] = (uint8_t)sum;\n", x, y, x);
+        }
+        else {
+            fprintf(out, "    flag = V[0x%X] + V[0x%X] > 255;\n    V[0x%X] += V[0x%X];\n    V[0xF] = flag;\n", x, y, x, y);
+        }
+        return 0;
+    case CHIP8_OP_8XY5:
+        if (q->is_default) {
+            fprintf(out, "    V[0xF] = V[0x%X] >= V[0x%X];\n    V[0x%X] = V[0x%X] - V[0x%X];\n", x, y, x, x, y);
+        }
+        else {
+            fprintf(out, "    flag = V[0x%X] >= V[0x%X];\n    V[0x%X] -= V[0x%X];\n    V[0xF] = flag;\n", x, y, x, y);
+        }
+        return 0;
+    case CHIP8_OP_8XY6:
+        if (q->is_default) {
+            fprintf(out, "    V[0xF] = V[0x%X] & 1;\n    V[0x%X] = V[0x%X] >> 1;\n", x, x, x);
+        }
+        else {
+            fprintf(out, "    flag = V[0x%X];\n    V[0x%X] = flag >> 1;\n    V[0xF] = flag & 1;\n", q->shift_vy ? y : x, x);
+        }
+        return 0;
+    case CHIP8_OP_8XY7:
+        if (q->is_default) {
+            fprintf(out, "    V[0xF] = V[0x%X] >= V[0x%X];\n    V[0x%X] = V[0x%X] - V[0x%X];\n", y, x, x, y, x);
+        }
+        else {
+            fprintf(out, "    flag = V[0x%X] >= V[0x%X];\n    V[0x%X] = V[0x%X] - V[0x%X];\n    V[0xF] = flag;\n", y, x, x, y, x);
+        }
+        return 0;
+    case CHIP8_OP_ANNN:
+        fprintf(out, "    c->I = 0x%03X;\n", in.nnn);
+        return 0;
+    case CHIP8_OP_CXNN:
+        fprintf(out, "    V[0x%X] = chip8_random_byte(c) & 0x%02X;\n", x, in.nn);
+        return 0;
+    case CHIP8_OP_DXYN:
+        fprintf(out, "    draw(c, 0x%X, 0x%X, %d);\n", x, y, in.n);
+        return 0;
+    case CHIP8_OP_FX07:
+        fprintf(out, "    V[0x%X] = c->delay_timer;\n", x);
+        return 0;
+    case CHIP8_OP_FX0A:
+        fprintf(out, "    for (k = 0; k < 16 && !c->keypad[k]; k++) {\n    }\n");
+        fprintf(out, "    if (k == 16) {\n        c->pc = 0x%03X;\n        return ++done;\n    }\n", pc);
+        fprintf(out, "    V[0x%X] = (uint8_t)k;\n", x);
+        return 0;
+    case CHIP8_OP_FX15:
+        fprintf(out, "    c->delay_timer = V[0x%X];\n", x);
+        return 0;
+    case CHIP8_OP_FX18:
+        fprintf(out, "    c->sound_timer = V[0x%X];\n", x);
+        return 0;
+    case CHIP8_OP_FX1E:
+        fprintf(out, "    c->I += V[0x%X];\n", x);
+        return 0;
+    case CHIP8_OP_FX29:
+        if (q->is_default) {
+            fprintf(out, "    c->I = V[0x%X] * 5;\n", x);
+        }
+        else {
+            fprintf(out, "    c->I = (V[0x%X] & 0xF) * 5;\n", x);
+        }
+        return 0;
+    case CHIP8_OP_FX33:
+    case CHIP8_OP_FX55:
+        // Writes can land on code, so hand back to chip8_aot_run to look
+        if (in.op == CHIP8_OP_FX33) {
+            fprintf(out, "    chip8_mem_write(c, c->I, V[0x%X] / 100);\n", x);
+            fprintf(out, "    chip8_mem_write(c, c->I + 1, (V[0x%X] / 10) %% 10);\n", x);
+            fprintf(out, "    chip8_mem_write(c, c->I + 2, V[0x%X] %% 10);\n", x);
+            fprintf(out, "    chip8_aot_invalidate(aot, c->I, 3);\n");
+        }
+        else {
+            fprintf(out, "    for (k = 0; k <= 0x%X; k++) {\n        chip8_mem_write(c, c->I + k, V[k]);\n    }\n", x);
+            fprintf(out, "    chip8_aot_invalidate(aot, c->I, %d);\n", x + 1);
+            emit_memory_step(out, q, x);
+        }
+        fprintf(out, "    c->pc = 0x%03X;\n    return ++done;\n", next);
+        return 1;
+    case CHIP8_OP_FX65:
+        fprintf(out, "    for (k = 0; k <= 0x%X; k++) {\n        V[k] = chip8_mem_read(c, c->I + k);\n    }\n", x);
+        emit_memory_step(out, q, x);
+        return 0;
+    default:
+        if ((opcode & 0xF00F) == 0x800E && !q->is_default) {
+            fprintf(out, "    flag = V[0x%X];\n    V[0x%X] = (uint8_t)(flag << 1);\n    V[0xF] = flag >> 7;\n",
+                    q->shift_vy ? y : x, x);
+        }
+        return 0;
+    }
+}
+
+// Write block `b` as a function. The body goes to a buffer first so the
+// locals it doesn't use can be left out.
+static int emit_block(FILE *out, const Chip8Analysis *a, const Chip8QuirkFlags *q, const Chip8Block *b) {
+    char *body = NULL;
+    size_t body_size = 0;
+    FILE *code = open_memstream(&body, &body_size);
+    if (!code) {
+        printf("Error: Out of memory translating block 0x%03X\n", b->start);
+        return 0;
+    }
+    for (int pc = b->start; pc < b->end; pc += 2) {
+        uint16_t opcode = a->memory[pc] << 8 | a->memory[pc + 1];
+        char text[32];
+        chip8_disassemble(opcode, text, sizeof(text));
+        fprintf(code, "i%03X: // %04X  %s\n", pc, opcode, text);
+        if (!emit_instruction(code, q, b, pc, opcode)) {
+            if (pc + 2 < b->end) {
+                fprintf(code, "    if (++done == budget) {\n        c->pc = 0x%03X;\n        return done;\n    }\n", pc + 2);
+            }
+            else {
+                fprintf(code, "    c->pc = 0x%03X;\n    return ++done;\n", pc + 2);
+            }
+        }
+    }
+    fclose(code);
+
+    fprintf(out, "\nstatic uint32_t block_%03X(Chip8 *c, Chip8Aot *aot, uint32_t budget) {\n", b->start);
+    if (strstr(body, "V[")) {
+        fprintf(out, "    uint8_t *V = c->V;\n");
+    }
+    if (strstr(body, "k = 0") || strstr(body, "(uint8_t)k")) {
+        fprintf(out, "    int k;\n");
+    }
+    if (strstr(body, "flag = ")) {
+        fprintf(out, "    uint8_t flag;\n");
+    }
+    if (strstr(body, "sum = ")) {
+        fprintf(out, "    unsigned sum;\n");
+    }
+    if (!strstr(body, "(aot,")) {
+        fprintf(out, "    (void)aot;\n");
+    }
+    if (!strstr(body, "budget")) {
+        fprintf(out, "    (void)budget;\n");
+    }
+    fprintf(out, "    uint32_t done = 0;\n    switch (c->pc) {\n");
+    for (int pc = b->start; pc < b->end; pc += 2) {
+        fprintf(out, "    case 0x%03X: goto i%03X;\n", pc, pc);
+    }
+    fprintf(out, "    default: return 0;\n    }\n%s}\n", body);
+    free(body);
+    return 1;
+}
+
+// Write `rom` as a C file defining `symbol`, a Chip8AotProgram for
+// running it with `quirks` (a CHIP-8 ROM only). Returns 1 on success.
+int chip8_aot_translate(const Chip8Rom *rom, Chip8Quirks quirks, const char *symbol, FILE *out) {
+    if (rom->variant != CHIP8_VARIANT_CHIP8) {
+        printf("Error: Only CHIP-8 ROMs can be translated, not %s\n", chip8_variant_name(rom->variant));
+        return 0;
+    }
+    Chip8 chip8;
+    chip8_rom_start(rom, &chip8);
+    chip8_set_quirks(&chip8, quirks);
+    static Chip8Analysis analysis;
+    int ok = chip8_analyze(&chip8, &analysis);
+    chip8_free(&chip8);
+    if (!ok) {
+        return 0;
+    }
+    const Chip8Analysis *a = &analysis;
+    const Chip8QuirkFlags *q = chip8_quirk_flags(quirks);
+
+    // Only code inside the ROM can be checked against it
+    int blocks = 0, instructions = 0, draws = 0;
+    for (int k = 0; k < a->block_count; k++) {
+        const Chip8Block *b = &a->blocks[k];
+        if (b->start >= 0x200 && b->end <= 0x200 + rom->size) {
+            blocks++;
+            instructions += b->length;
+            for (int pc = b->start; pc < b->end; pc += 2) {
+                draws += a->memory[pc] >> 4 == 0xD;
+            }
+        }
+    }
+
+    fprintf(out, "// Generated by chip8-aot from %s (%s quirks): %d blocks, %d instructions.\n", rom->name,
+            chip8_quirks_name(quirks), blocks, instructions);
+    fprintf(out, "// Don't edit; translate the ROM again instead.\n");
+    fprintf(out, "#include <stdint.h>\n#include <string.h>\n\n#include \"chip8.h\"\n\n");
+    fprintf(out, "static const uint8_t rom[%zu] = {", rom->size);
+    for (size_t i = 0; i < rom->size; i++) {
+        fprintf(out, "%s0x%02X,", i % 12 ? " " : "\n    ", rom->data[i]);
+    }
+    fprintf(out, "\n};\n");
+    if (draws) {
+        fprintf(out, "\n%s", q->clip ? draw_clip : draw_wrap);
+    }
+
+    for (int k = 0; k < a->block_count; k++) {
+        const Chip8Block *b = &a->blocks[k];
+        if (b->start >= 0x200 && b->end <= 0x200 + rom->size && !emit_block(out, a, q, b)) {
+            chip8_analysis_free(&analysis);
+            return 0;
+        }
+    }
+
+    fprintf(out, "\nstatic const Chip8AotBlock blocks[%d] = {\n", blocks ? blocks : 1);
+    for (int k = 0; k < a->block_count; k++) {
+        const Chip8Block *b = &a->blocks[k];
+        if (b->start >= 0x200 && b->end <= 0x200 + rom->size) {
+            fprintf(out, "    { 0x%03X, 0x%03X, block_%03X },\n", b->start, b->end, b->start);
+        }
+    }
+    // Named by the file name alone: binaries built from it save states
+    // next to where they run, not next to the ROM they were built from
+    const char *name = strrchr(rom->name, '/') ? strrchr(rom->name, '/') + 1 : rom->name;
+    fprintf(out, "};\n\nconst Chip8AotProgram %s = {\n    \"", symbol);
+    for (const char *p = name; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fputc('\\', out);
+        }
+        fputc(*p, out);
+    }
+    fprintf(out, "\", rom, sizeof(rom), %d, blocks, %d\n};\n", quirks, blocks);
+    chip8_analysis_free(&analysis);
+    return 1;
+}
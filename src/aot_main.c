@@ -0,0 +1,74 @@
+// chip8-aot - translate a CHIP-8 ROM to C ahead of time
+//
+// Usage: chip8-aot [--quirks NAME] [--symbol NAME] <rom> <output.c>
+//
+// Writes the C for src/aot.c's Chip8AotProgram, named `chip8_aot_program`
+// unless --symbol says otherwise. CMake's chip8_aot_game runs this at
+// build time and links the result into the frontend. The quirk profile
+// comes from the ROM database unless --quirks names one, and the binary
+// only runs translated code on a machine with the same profile.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s [--quirks NAME] [--symbol NAME] <rom> <output.c>\n", prog);
+    printf("  --quirks NAME: default, vip, chip48, schip or modern (default: from the ROM database)\n");
+    printf("  --symbol NAME: name of the Chip8AotProgram to define (default: chip8_aot_program)\n");
+}
+
+int main(int argc, char *argv[]) {
+    int quirks = -1;
+    const char *symbol = "chip8_aot_program";
+    const char *paths[2];
+    int path_count = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+            quirks = chip8_quirks_from_name(argv[++i]);
+            if (quirks < 0) {
+                printf("Error: --quirks must be default, vip, chip48, schip or modern\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--symbol") == 0 && i + 1 < argc) {
+            symbol = argv[++i];
+        } else if (argv[i][0] != '-' && path_count < 2) {
+            paths[path_count++] = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (path_count != 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    Chip8RomLibrary *library = chip8_library_create();
+    const Chip8Rom *rom = library ? chip8_library_add_file(library, paths[0]) : NULL;
+    if (!rom) {
+        chip8_library_close(library);
+        return 1;
+    }
+    if (quirks < 0) {
+        quirks = rom->quirks >= 0 ? rom->quirks : CHIP8_QUIRKS_DEFAULT;
+    }
+
+    FILE *out = fopen(paths[1], "w");
+    if (!out) {
+        printf("Error: Could not open %s for writing\n", paths[1]);
+        chip8_library_close(library);
+        return 1;
+    }
+    int ok = chip8_aot_translate(rom, (Chip8Quirks)quirks, symbol, out);
+    if (fclose(out) != 0) {
+        printf("Error: Could not write %s\n", paths[1]);
+        ok = 0;
+    }
+    if (!ok) {
+        remove(paths[1]);
+    }
+    chip8_library_close(library);
+    return ok ? 0 : 1;
+}
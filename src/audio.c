@@ -0,0 +1,31 @@
+// Beeper tone
+// CHIP-8 has one sound: a fixed tone for as long as the sound timer is
+// above zero. This makes it as a square wave, a buffer of samples at a
+// time, for whatever audio callback the frontend has. It does no I/O and
+// takes no locks, so it can run on the audio thread.
+#include <stdint.h>
+#include <string.h>
+
+#include "chip8.h"
+
+// `amplitude` is the peak sample value (the wave swings +/- amplitude)
+void chip8_tone_init(Chip8Tone *tone, int sample_rate, int frequency, int16_t amplitude) {
+    tone->phase = 0;
+    tone->step = (uint32_t)(((uint64_t)frequency << 32) / (uint64_t)sample_rate);
+    tone->amplitude = amplitude;
+}
+
+// Write `count` signed 16-bit mono samples: the tone if `on`, else
+// silence. The phase carries over between calls so buffers join up
+// cleanly; every beep starts at the top of the wave.
+void chip8_tone_fill(Chip8Tone *tone, int16_t *samples, int count, int on) {
+    if (!on) {
+        memset(samples, 0, count * sizeof(int16_t));
+        tone->phase = 0;
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        samples[i] = tone->phase < 0x80000000u ? tone->amplitude : (int16_t)-tone->amplitude;
+        tone->phase += tone->step;
+    }
+}
@@ -0,0 +1,232 @@
+// Batch runner
+// Runs a list of headless jobs on a pool of worker threads. Each worker owns
+// a deque of job indexes: it takes work from the back of its own deque and,
+// once that is empty, steals from the front of someone else's. Each worker
+// reuses a single Chip8 and decode cache for all of its jobs, so they stay
+// hot in that core's cache.
+#define _POSIX_C_SOURCE 200809L  // sysconf
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "chip8.h"
+
+typedef struct {
+    pthread_mutex_t lock;
+    int *jobs;                      // job indexes, [head, tail) still to run
+    int head;
+    int tail;
+} JobDeque;
+
+typedef struct {
+    const Chip8BatchJob *jobs;
+    Chip8BatchResult *results;
+    JobDeque *deques;
+    int worker_count;
+    int keep_frame_checksums;
+} BatchShared;
+
+typedef struct {
+    BatchShared *shared;
+    int id;
+    pthread_t thread;
+} Worker;
+
+// Take the newest job from our own deque
+static int pop_own(JobDeque *deque) {
+    int job = -1;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->head < deque->tail) {
+        job = deque->jobs[--deque->tail];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return job;
+}
+
+// Take the oldest job from someone else's deque
+static int steal(JobDeque *deque) {
+    int job = -1;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->head < deque->tail) {
+        job = deque->jobs[deque->head++];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return job;
+}
+
+// Nothing is ever pushed after startup, so once every deque is empty
+// there is no more work and the worker can stop
+static int next_job(BatchShared *shared, int id) {
+    int job = pop_own(&shared->deques[id]);
+    for (int i = 1; job < 0 && i < shared->worker_count; i++) {
+        job = steal(&shared->deques[(id + i) % shared->worker_count]);
+    }
+    return job;
+}
+
+static void run_job(Chip8 *chip8, Chip8DecodeCache *cache, const Chip8BatchJob *job, Chip8BatchResult *result,
+                    int keep_frame_checksums) {
+    memset(result, 0, sizeof(*result));
+
+    if (job->start) {
+        chip8_fork(chip8, job->start);  // the ROM's pages are shared, not copied
+    }
+    else {
+        chip8_init(chip8);
+        if (!chip8_set_variant(chip8, job->variant) || !chip8_load_rom_buffer(chip8, job->rom, job->rom_size)) {
+            return;
+        }
+    }
+    chip8_seed(chip8, job->seed);
+    if (!chip8_set_quirks(chip8, job->quirks)) {
+        return;
+    }
+
+    Chip8HeadlessRun run;
+    chip8_headless_begin(&run, job->script, job->cpu_hz);
+    if (!chip8->ext) {
+        chip8_decode_cache_clear(cache);  // it follows the machine's quirk profile
+        chip8_sched_set_engine(&run.sched, chip8_decode_cache_run, cache);
+    }
+    else {
+        chip8_sched_set_engine(&run.sched, chip8_machine_engine(chip8), NULL);
+    }
+
+    // One frame per 60 Hz timer tick, plus a partial one at the end if the
+    // budget doesn't land on a tick
+    long frame_count = 0;
+    if (job->cycles > 0) {
+        frame_count = (long)((uint64_t)(job->cycles - 1) * CHIP8_TIMER_HZ / run.sched.cpu_hz) + 1;
+    }
+    if (keep_frame_checksums && frame_count > 0) {
+        result->frame_checksums = malloc(frame_count * sizeof(uint64_t));
+        if (!result->frame_checksums) {
+            return;
+        }
+    }
+
+    uint64_t frames_hash = 0xCBF29CE484222325ULL;
+    long remaining = job->cycles;
+    while (remaining > 0) {
+        long step = (long)chip8_sched_cycles_to_tick(&run.sched);
+        if (step > remaining) {
+            step = remaining;
+        }
+        remaining -= chip8_headless_step(chip8, &run, step);
+
+        uint64_t checksum = chip8_display_checksum(chip8);
+        if (result->frame_checksums) {
+            result->frame_checksums[result->frames] = checksum;
+        }
+        frames_hash = (frames_hash ^ checksum) * 0x100000001B3ULL;
+        result->frames++;
+    }
+
+    result->ok = 1;
+    result->cycles = (long)run.sched.cycles;
+    result->state_hash = chip8_state_hash(chip8);
+    result->frames_hash = frames_hash;
+}
+
+static int cpu_count(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+static void *worker_main(void *arg) {
+    Worker *worker = arg;
+    BatchShared *shared = worker->shared;
+    Chip8 *chip8 = malloc(sizeof(Chip8));
+    Chip8DecodeCache *cache = malloc(sizeof(Chip8DecodeCache));
+    if (!chip8 || !cache) {
+        free(chip8);
+        free(cache);
+        return NULL;
+    }
+
+    int job;
+    while ((job = next_job(shared, worker->id)) >= 0) {
+        run_job(chip8, cache, &shared->jobs[job], &shared->results[job], shared->keep_frame_checksums);
+        chip8_free(chip8);
+    }
+
+    free(chip8);
+    free(cache);
+    return NULL;
+}
+
+// Run every job and fill in results[i] for jobs[i]. `threads` <= 0 means
+// one worker per online CPU. Returns 0 if the pool couldn't be set up.
+int chip8_batch_run(const Chip8BatchJob *jobs, Chip8BatchResult *results, int job_count,
+                    int threads, int keep_frame_checksums) {
+    if (threads <= 0) {
+        threads = cpu_count();
+    }
+    if (threads > job_count) {
+        threads = job_count > 0 ? job_count : 1;
+    }
+
+    BatchShared shared;
+    shared.jobs = jobs;
+    shared.results = results;
+    shared.worker_count = threads;
+    shared.keep_frame_checksums = keep_frame_checksums;
+    shared.deques = calloc(threads, sizeof(JobDeque));
+    Worker *workers = calloc(threads, sizeof(Worker));
+    int *job_indexes = malloc((job_count > 0 ? job_count : 1) * sizeof(int));
+    if (!shared.deques || !workers || !job_indexes) {
+        free(shared.deques);
+        free(workers);
+        free(job_indexes);
+        return 0;
+    }
+
+    // Deal out contiguous slices up front; stealing evens things out
+    // when some jobs turn out to be much longer than others
+    for (int i = 0; i < job_count; i++) {
+        job_indexes[i] = i;
+    }
+    for (int w = 0; w < threads; w++) {
+        JobDeque *deque = &shared.deques[w];
+        pthread_mutex_init(&deque->lock, NULL);
+        deque->jobs = job_indexes;
+        deque->head = (int)((long)job_count * w / threads);
+        deque->tail = (int)((long)job_count * (w + 1) / threads);
+    }
+
+    int started = 0;
+    for (int w = 0; w < threads; w++) {
+        workers[w].shared = &shared;
+        workers[w].id = w;
+        if (pthread_create(&workers[w].thread, NULL, worker_main, &workers[w]) != 0) {
+            break;
+        }
+        started++;
+    }
+    // If some threads failed to start, the ones that did will steal
+    // their work. With none at all, run it on this thread.
+    if (started == 0) {
+        worker_main(&workers[0]);
+    }
+    for (int w = 0; w < started; w++) {
+        pthread_join(workers[w].thread, NULL);
+    }
+
+    for (int w = 0; w < threads; w++) {
+        pthread_mutex_destroy(&shared.deques[w].lock);
+    }
+    free(shared.deques);
+    free(workers);
+    free(job_indexes);
+    return 1;
+}
+
+void chip8_batch_free_results(Chip8BatchResult *results, int job_count) {
+    for (int i = 0; i < job_count; i++) {
+        free(results[i].frame_checksums);
+        results[i].frame_checksums = NULL;
+    }
+}
@@ -0,0 +1,288 @@
+// chip8-batch - run many headless ROM sessions across all cores
+//
+// Usage: chip8-batch [--threads N] [--hz N] [--quirks NAME] [--library PATH] [--frame-checksums]
+//                    <jobs file> <results file>
+//
+// The jobs file has one job per line, tab separated:
+//     <rom file> <TAB> <input script or -> <TAB> <cycles> [<TAB> <seed>]
+// Blank lines and lines starting with # are skipped. Each distinct ROM and
+// input script is read once, however many jobs use it, and every job forks
+// its ROM's loaded machine rather than loading the ROM again. With
+// --library, ROMs are looked up by name in a directory or pack (see
+// chip8-pack) first. ROMs named .sc8 or .xo8 run as SUPER-CHIP or
+// XO-CHIP. CHIP-8 ROMs get the quirk profile the ROM database has for
+// them, or the one --quirks names.
+#define _POSIX_C_SOURCE 200809L  // clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "chip8.h"
+
+typedef struct {
+    char *path;
+    Chip8InputScript script;
+} ScriptFile;
+
+typedef struct {
+    Chip8RomLibrary *roms;          // --library, plus every other ROM file named
+    ScriptFile *scripts;
+    int script_count;
+} FileCache;
+
+static char *copy_string(const char *s) {
+    char *copy = malloc(strlen(s) + 1);
+    if (copy) {
+        strcpy(copy, s);
+    }
+    return copy;
+}
+
+// A ROM from the library, or mapped from the file of that name
+static const Chip8Rom *get_rom(FileCache *cache, const char *path) {
+    const Chip8Rom *rom = chip8_library_find(cache->roms, path);
+    return rom ? rom : chip8_library_add_file(cache->roms, path);
+}
+
+// Load an input script, or return the copy we already have
+static ScriptFile *get_script(FileCache *cache, const char *path) {
+    for (int i = 0; i < cache->script_count; i++) {
+        if (strcmp(cache->scripts[i].path, path) == 0) {
+            return &cache->scripts[i];
+        }
+    }
+
+    ScriptFile script;
+    if (!chip8_load_input_script(&script.script, path)) {
+        return NULL;
+    }
+    ScriptFile *grown = realloc(cache->scripts, (cache->script_count + 1) * sizeof(ScriptFile));
+    if (!grown || !(script.path = copy_string(path))) {
+        printf("Error: Out of memory\n");
+        chip8_free_input_script(&script.script);
+        return NULL;
+    }
+    cache->scripts = grown;
+    cache->scripts[cache->script_count] = script;
+    return &cache->scripts[cache->script_count++];
+}
+
+static void free_cache(FileCache *cache) {
+    chip8_library_close(cache->roms);
+    for (int i = 0; i < cache->script_count; i++) {
+        free(cache->scripts[i].path);
+        chip8_free_input_script(&cache->scripts[i].script);
+    }
+    free(cache->scripts);
+}
+
+// Parsed jobs keep the index of their script in the cache rather than a
+// pointer, because the cache array moves as it grows (library ROMs don't)
+typedef struct {
+    const Chip8Rom *rom;
+    int script;                     // -1 for no input
+    long cycles;
+    unsigned int seed;
+    int line;
+} JobSpec;
+
+static int read_jobs(const char *filename, FileCache *cache, JobSpec **out_specs, int *out_count) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        printf("Error: Could not open jobs file %s\n", filename);
+        return 0;
+    }
+
+    JobSpec *specs = NULL;
+    int count = 0;
+    int capacity = 0;
+    int line_number = 0;
+    char line[4096];
+    while (fgets(line, sizeof(line), file)) {
+        line_number++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '#' || line[0] == '\0') {
+            continue;
+        }
+
+        char *rom_path = strtok(line, "\t");
+        char *script_path = strtok(NULL, "\t");
+        char *cycles = strtok(NULL, "\t");
+        char *seed = strtok(NULL, "\t");
+        if (!rom_path || !script_path || !cycles) {
+            printf("Error: %s:%d: expected \"<rom>\\t<script|->\\t<cycles>[\\t<seed>]\"\n", filename, line_number);
+            goto fail;
+        }
+
+        const Chip8Rom *rom = get_rom(cache, rom_path);
+        ScriptFile *script = NULL;
+        if (!rom || (strcmp(script_path, "-") != 0 && !(script = get_script(cache, script_path)))) {
+            goto fail;
+        }
+
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            JobSpec *grown = realloc(specs, capacity * sizeof(JobSpec));
+            if (!grown) {
+                printf("Error: Out of memory\n");
+                goto fail;
+            }
+            specs = grown;
+        }
+        specs[count].rom = rom;
+        specs[count].script = script ? (int)(script - cache->scripts) : -1;
+        specs[count].cycles = atol(cycles);
+        specs[count].seed = seed ? (unsigned int)strtoul(seed, NULL, 0) : 1;
+        specs[count].line = line_number;
+        count++;
+    }
+    fclose(file);
+    *out_specs = specs;
+    *out_count = count;
+    return 1;
+
+fail:
+    fclose(file);
+    free(specs);
+    return 0;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s [--threads N] [--hz N] [--quirks NAME] [--library PATH] [--frame-checksums] <jobs file> <results file>\n",
+           prog);
+    printf("  jobs file: one \"<rom>\\t<input script|->\\t<cycles>[\\t<seed>]\" per line\n");
+    printf("  --quirks NAME: default, vip, chip48, schip or modern for every CHIP-8 ROM (default: from the ROM database)\n");
+    printf("  --library PATH: a directory of ROMs or a ROM pack to find the jobs' ROMs in by name\n");
+}
+
+int main(int argc, char *argv[]) {
+    int threads = 0;
+    uint64_t cpu_hz = CHIP8_DEFAULT_CPU_HZ;
+    int keep_frame_checksums = 0;
+    int quirks = -1;
+    const char *library_path = NULL;
+    const char *jobs_file = NULL;
+    const char *results_file = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--hz") == 0 && i + 1 < argc) {
+            cpu_hz = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+            quirks = chip8_quirks_from_name(argv[++i]);
+            if (quirks < 0) {
+                printf("Error: --quirks must be default, vip, chip48, schip or modern\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--library") == 0 && i + 1 < argc) {
+            library_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--frame-checksums") == 0) {
+            keep_frame_checksums = 1;
+        }
+        else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            print_usage(argv[0]);
+            return 1;
+        }
+        else if (!jobs_file) {
+            jobs_file = argv[i];
+        }
+        else {
+            results_file = argv[i];
+        }
+    }
+    if (!jobs_file || !results_file) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    FileCache cache = { NULL, NULL, 0 };
+    cache.roms = library_path ? chip8_library_open(library_path) : chip8_library_create();
+    if (!cache.roms) {
+        return 1;
+    }
+    JobSpec *specs = NULL;
+    int job_count = 0;
+    if (!read_jobs(jobs_file, &cache, &specs, &job_count)) {
+        free_cache(&cache);
+        return 1;
+    }
+
+    Chip8BatchJob *jobs = calloc(job_count ? job_count : 1, sizeof(Chip8BatchJob));
+    Chip8BatchResult *results = calloc(job_count ? job_count : 1, sizeof(Chip8BatchResult));
+    if (!jobs || !results) {
+        printf("Error: Out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < job_count; i++) {
+        const Chip8Rom *rom = specs[i].rom;
+        jobs[i].rom = rom->data;
+        jobs[i].rom_size = rom->size;
+        jobs[i].start = &rom->start;
+        jobs[i].script = specs[i].script >= 0 ? &cache.scripts[specs[i].script].script : NULL;
+        jobs[i].cycles = specs[i].cycles;
+        jobs[i].cpu_hz = cpu_hz;
+        jobs[i].seed = specs[i].seed;
+        jobs[i].variant = rom->variant;
+        if (jobs[i].variant == CHIP8_VARIANT_CHIP8) {
+            int rom_quirks = quirks >= 0 ? quirks : rom->quirks;
+            jobs[i].quirks = rom_quirks >= 0 ? (Chip8Quirks)rom_quirks : CHIP8_QUIRKS_DEFAULT;
+        }
+    }
+
+    double start = now_seconds();
+    if (!chip8_batch_run(jobs, results, job_count, threads, keep_frame_checksums)) {
+        printf("Error: Could not start worker threads\n");
+        return 1;
+    }
+    double elapsed = now_seconds() - start;
+
+    FILE *out = fopen(results_file, "w");
+    if (!out) {
+        printf("Error: Could not open %s for writing\n", results_file);
+        return 1;
+    }
+    long long total_cycles = 0;
+    int failed = 0;
+    fprintf(out, "# line\tstatus\tcycles\tframes\tstate_hash\tframes_hash%s\n",
+            keep_frame_checksums ? "\tframe_checksums" : "");
+    for (int i = 0; i < job_count; i++) {
+        Chip8BatchResult *r = &results[i];
+        fprintf(out, "%d\t%s\t%ld\t%ld\t%016" PRIx64 "\t%016" PRIx64,
+                specs[i].line, r->ok ? "ok" : "error", r->cycles, r->frames, r->state_hash, r->frames_hash);
+        if (r->frame_checksums) {
+            fputc('\t', out);
+            for (long f = 0; f < r->frames; f++) {
+                fprintf(out, "%s%016" PRIx64, f ? "," : "", r->frame_checksums[f]);
+            }
+        }
+        fputc('\n', out);
+        total_cycles += r->cycles;
+        failed += !r->ok;
+    }
+    fclose(out);
+
+    printf("%d jobs, %lld cycles in %.3f s (%.0f instructions/second)%s\n",
+           job_count, total_cycles, elapsed, elapsed > 0 ? total_cycles / elapsed : 0.0,
+           failed ? " - some jobs failed" : "");
+
+    chip8_batch_free_results(results, job_count);
+    free(results);
+    free(jobs);
+    free(specs);
+    free_cache(&cache);
+    return failed ? 1 : 0;
+}
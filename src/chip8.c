@@ -0,0 +1,516 @@
+// CHIP-8 core - the part of the emulator with no SDL in it.
+// Everything lives in the Chip8 struct, so any number of machines can
+// run side by side in one process.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "chip8.h"
+
+// Initialize the CHIP-8 system
+void chip8_init(Chip8 *chip8) {
+    // Clear everything
+    memset(chip8, 0, sizeof(Chip8));
+    
+    // Program counter starts at 0x200
+    chip8->pc = 0x200;
+    
+    // Nothing has been shown yet, so the first frame draws everything
+    chip8->dirty_rows = CHIP8_ALL_ROWS_DIRTY;
+    
+    // Memory starts out as the shared font page (fontset at 0x000) and
+    // empty pages - nothing to copy
+    chip8_mem_init(chip8);
+    
+    // Seed this instance's random number generator
+    chip8_seed(chip8, (unsigned int)time(NULL));
+}
+
+// Reseed the CXNN random number generator (for reproducible runs). The
+// seed is scrambled first so that nearby seeds give unrelated sequences,
+// and so the state is never 0, where xorshift would get stuck.
+void chip8_seed(Chip8 *chip8, unsigned int seed) {
+    uint32_t z = (uint32_t)seed + 0x9E3779B9u;
+    z = (z ^ (z >> 16)) * 0x85EBCA6Bu;
+    z = (z ^ (z >> 13)) * 0xC2B2AE35u;
+    z ^= z >> 16;
+    chip8->rng_state = z ? z : 0x9E3779B9u;
+}
+
+// Load a program into memory
+int chip8_load_rom(Chip8 *chip8, const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        printf("Error: Could not open file %s\n", filename);
+        return 0;
+    }
+    
+    // Get file size
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    rewind(file);
+    
+    // Check if ROM fits in memory
+    if (file_size > (long)(chip8_mem_size(chip8) - 0x200)) {
+        printf("Error: ROM too large\n");
+        fclose(file);
+        return 0;
+    }
+    
+    // Load ROM into memory starting at 0x200
+    uint8_t *rom = malloc(file_size > 0 ? file_size : 1);
+    if (!rom) {
+        printf("Error: Out of memory loading %s\n", filename);
+        fclose(file);
+        return 0;
+    }
+    size_t size = fread(rom, 1, file_size, file);
+    fclose(file);
+    chip8_load_rom_buffer(chip8, rom, size);
+    free(rom);
+    
+    printf("Loaded ROM: %ld bytes\n", file_size);
+    return 1;
+}
+
+// Load a program that is already in memory (no file access, no output).
+// Used by the batch runner, which reads each ROM file once up front.
+int chip8_load_rom_buffer(Chip8 *chip8, const uint8_t *data, size_t size) {
+    if (size > chip8_mem_size(chip8) - 0x200) {
+        return 0;
+    }
+    if (chip8->ext) {
+        chip8_xmem_write_block(chip8, 0x200, data, size);
+    }
+    else {
+        chip8_mem_write_block(chip8, 0x200, data, size);
+    }
+    return 1;
+}
+
+// Fetch the next instruction (2 bytes)
+static inline uint16_t fetch(Chip8 *chip8) {
+    // CHIP-8 instructions are 2 bytes, stored big-endian
+    // Combine two consecutive bytes into one 16-bit instruction
+    uint16_t opcode = chip8_mem_read(chip8, chip8->pc) << 8 | chip8_mem_read(chip8, chip8->pc + 1);
+    chip8->pc += 2;
+    return opcode;
+}
+
+uint16_t chip8_fetch(Chip8 *chip8) {
+    return fetch(chip8);
+}
+
+// Opcode handlers
+// Every instruction gets its own small function, working on an already
+// decoded Chip8Instruction (see chip8_decode below). chip8_execute looks the
+// handler up by operation instead of walking a long if/else chain, so
+// 0xDXYN costs the same to reach as 0x00E0.
+typedef void (*chip8_handler)(Chip8 *chip8, const Chip8Instruction *in);
+
+// Anything we don't recognise is ignored (same as the old decoder)
+static void op_nop(Chip8 *chip8, const Chip8Instruction *in) {
+    (void)chip8;
+    (void)in;
+}
+
+static void op_00e0(Chip8 *chip8, const Chip8Instruction *in) {
+    (void)in;
+    // Only 256 bytes with the packed display - the compiler turns this
+    // into a few vector stores
+    memset(chip8->display, 0, sizeof(chip8->display));
+    chip8->dirty_rows = CHIP8_ALL_ROWS_DIRTY;
+}
+
+// The stack wraps around rather than running off either end: a ROM that
+// calls more than 16 deep overwrites its oldest return addresses
+static void op_00ee(Chip8 *chip8, const Chip8Instruction *in) {
+    (void)in;
+    chip8->sp--;
+    chip8->pc = chip8->stack[chip8->sp & 0xF];
+}
+
+static void op_1nnn(Chip8 *chip8, const Chip8Instruction *in) {
+    chip8->pc = in->nnn; //we incremented pc by 2 in fetch, so we jump by setting nnn.
+}
+
+static void op_2nnn(Chip8 *chip8, const Chip8Instruction *in) { // to jump to subroutine
+    chip8->stack[chip8->sp & 0xF] = chip8->pc;
+    chip8->sp++;
+    chip8->pc = in->nnn;
+}
+
+static void op_3xnn(Chip8 *chip8, const Chip8Instruction *in) { //skipping
+    if (chip8->V[in->x] == in->nn) {
+        chip8->pc += 2;
+    }
+}
+
+static void op_4xnn(Chip8 *chip8, const Chip8Instruction *in) {
+    if (chip8->V[in->x] != in->nn) {
+        chip8->pc += 2;
+    }
+}
+
+static void op_5xy0(Chip8 *chip8, const Chip8Instruction *in) {
+    if (chip8->V[in->x] == chip8->V[in->y]) {
+        chip8->pc += 2;
+    }
+}
+
+static void op_6xnn(Chip8 *chip8, const Chip8Instruction *in) {
+    chip8->V[in->x] = in->nn;
+}
+
+static void op_7xnn(Chip8 *chip8, const Chip8Instruction *in) {
+    chip8->V[in->x] += in->nn;
+}
+
+// 0x8XYN arithmetic
+static void op_8xy0(Chip8 *chip8, const Chip8Instruction *in) {
+    chip8->V[in->x] = chip8->V[in->y];
+}
+
+static void op_8xy1(Chip8 *chip8, const Chip8Instruction *in) {
+    chip8->V[in->x] |= chip8->V[in->y];
+}
+
+static void op_8xy2(Chip8 *chip8, const Chip8Instruction *in) {
+    chip8->V[in->x] &= chip8->V[in->y];
+}
+
+static void op_8xy3(Chip8 *chip8, const Chip8Instruction *in) {
+    chip8->V[in->x] ^= chip8->V[in->y];
+}
+
+static void op_8xy4(Chip8 *chip8, const Chip8Instruction *in) {
+    uint16_t sum = chip8->V[in->x] + chip8->V[in->y];
+    chip8->V[0xF] = (sum > 255) ? 1 : 0;
+    chip8->V[in->x] = sum & 0xFF;
+}
+
+static void op_8xy5(Chip8 *chip8, const Chip8Instruction *in) {
+    chip8->V[0xF] = (chip8->V[in->x] >= chip8->V[in->y]) ? 1 : 0;
+    chip8->V[in->x] = chip8->V[in->x] - chip8->V[in->y];
+}
+
+static void op_8xy6(Chip8 *chip8, const Chip8Instruction *in) {
+    chip8->V[0xF] = chip8->V[in->x] & 0x01;
+    chip8->V[in->x] = chip8->V[in->x] >> 1;
+}
+
+static void op_8xy7(Chip8 *chip8, const Chip8Instruction *in) {
+    chip8->V[0xF] = (chip8->V[in->y] >= chip8->V[in->x]) ? 1 : 0;
+    chip8->V[in->x] = chip8->V[in->y] - chip8->V[in->x];
+}
+
+static void op_9xy0(Chip8 *chip8, const Chip8Instruction *in) {
+    if (chip8->V[in->x] != chip8->V[in->y]) {
+        chip8->pc += 2;
+    }
+}
+
+static void op_annn(Chip8 *chip8, const Chip8Instruction *in) {
+    chip8->I = in->nnn;
+}
+
+static void op_bnnn(Chip8 *chip8, const Chip8Instruction *in) {
+    chip8->pc = in->nnn + chip8->V[0];
+}
+
+static void op_cxnn(Chip8 *chip8, const Chip8Instruction *in) {
+    chip8->V[in->x] = chip8_random_byte(chip8) & in->nn;
+}
+
+// Each sprite row is 8 pixels wide. Put it at the top of a 64-bit word
+// and rotate it right by x, and it lands exactly where it belongs on the
+// packed row - wrapping off the right edge comes for free. Collision is
+// then just an AND with what is already there.
+static void op_dxyn(Chip8 *chip8, const Chip8Instruction *in) {
+    unsigned shift = chip8->V[in->x] % CHIP8_DISPLAY_WIDTH;
+    unsigned top = chip8->V[in->y];
+    uint64_t collision = 0;
+
+    for (int i = 0; i < in->n; i++) {
+        uint64_t sprite = (uint64_t)chip8_mem_read(chip8, chip8->I + i) << 56;
+        uint64_t row = (sprite >> shift) | (sprite << ((64 - shift) & 63));
+        uint64_t *line = &chip8->display[(top + i) % CHIP8_DISPLAY_HEIGHT];
+
+        collision |= *line & row;
+        *line ^= row;
+        chip8->dirty_rows |= (uint32_t)(row != 0) << ((top + i) % CHIP8_DISPLAY_HEIGHT);
+    }
+    chip8->V[0xF] = collision ? 1 : 0;  // Collision detected!
+    CHIP8_PROFILE_ADD(chip8, sprites_drawn, 1);
+    CHIP8_PROFILE_ADD(chip8, sprite_collisions, collision != 0);
+}
+
+// 0xEX9E / 0xEXA1 keypad skips (only the low nibble of VX names a key)
+static void op_ex9e(Chip8 *chip8, const Chip8Instruction *in) {
+    uint8_t key = chip8->V[in->x] & 0xF;
+    if (chip8->keypad[key]) {
+        chip8->pc += 2; //skip next instruction
+    }
+}
+
+static void op_exa1(Chip8 *chip8, const Chip8Instruction *in) {
+    uint8_t key = chip8->V[in->x] & 0xF;
+    if (!chip8->keypad[key]) {
+        chip8->pc += 2; //skip next instruction
+    }
+}
+
+// 0xFXNN misc - timers, I register, BCD, register dump/load
+static void op_fx07(Chip8 *chip8, const Chip8Instruction *in) {
+    chip8->V[in->x] = chip8->delay_timer;
+}
+
+static void op_fx0a(Chip8 *chip8, const Chip8Instruction *in) {
+    // Check if any key is pressed
+    for (int i = 0; i < 16; i++) {
+        if (chip8->keypad[i]) {
+            // A key was pressed! Store it and continue
+            chip8->V[in->x] = i;
+            return;
+        }
+    }
+    // No key pressed yet - repeat this instruction
+    chip8->pc -= 2;  // Go back 2 bytes to re-execute this opcode
+}
+
+static void op_fx15(Chip8 *chip8, const Chip8Instruction *in) {
+    chip8->delay_timer = chip8->V[in->x];
+}
+
+static void op_fx18(Chip8 *chip8, const Chip8Instruction *in) {
+    chip8->sound_timer = chip8->V[in->x];
+}
+
+static void op_fx1e(Chip8 *chip8, const Chip8Instruction *in) {
+    chip8->I += chip8->V[in->x];
+}
+
+static void op_fx29(Chip8 *chip8, const Chip8Instruction *in) {
+    chip8->I = chip8->V[in->x] * 5; //cuz character is 5 bytes tall
+}
+
+static void op_fx33(Chip8 *chip8, const Chip8Instruction *in) {
+    uint8_t vx = chip8->V[in->x];
+    chip8_mem_write(chip8, chip8->I, vx/100);
+    chip8_mem_write(chip8, chip8->I +1, (vx/10)%10);
+    chip8_mem_write(chip8, chip8->I +2, vx%10);
+}
+
+static void op_fx55(Chip8 *chip8, const Chip8Instruction *in) {
+    for (int i = 0; i <= in->x; i++) {
+        chip8_mem_write(chip8, chip8->I + i, chip8->V[i]);
+    }
+}
+
+static void op_fx65(Chip8 *chip8, const Chip8Instruction *in) {
+    for (int i = 0; i <= in->x; i++) {
+        chip8->V[i] = chip8_mem_read(chip8, chip8->I + i);
+    }
+}
+
+// Handlers by operation, in Chip8Op order
+static const chip8_handler chip8_handlers[CHIP8_OP_COUNT] = {
+    op_nop,  op_00e0, op_00ee, op_1nnn, op_2nnn, op_3xnn, op_4xnn, op_5xy0,
+    op_6xnn, op_7xnn, op_8xy0, op_8xy1, op_8xy2, op_8xy3, op_8xy4, op_8xy5,
+    op_8xy6, op_8xy7, op_9xy0, op_annn, op_bnnn, op_cxnn, op_dxyn, op_ex9e,
+    op_exa1, op_fx07, op_fx0a, op_fx15, op_fx18, op_fx1e, op_fx29, op_fx33,
+    op_fx55, op_fx65
+};
+
+// Decoding
+// One table lookup on the top nibble and the low byte gives the operation.
+// That covers every family: 8XYN is keyed on the low nibble, 5XY0/9XY0
+// need a low nibble of 0, and the E and F families on the low byte. Slots
+// that aren't instructions stay CHIP8_OP_NOP (0).
+#define REPEAT_16(a) a, a, a, a, a, a, a, a, a, a, a, a, a, a, a, a
+#define ROW_ALL(op) { REPEAT_16(REPEAT_16(op)) }
+#define LOW_NIBBLE_0(op) op, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+#define ARITHMETIC \
+    CHIP8_OP_8XY0, CHIP8_OP_8XY1, CHIP8_OP_8XY2, CHIP8_OP_8XY3, \
+    CHIP8_OP_8XY4, CHIP8_OP_8XY5, CHIP8_OP_8XY6, CHIP8_OP_8XY7, \
+    0, 0, 0, 0, 0, 0, 0, 0
+
+static const uint8_t chip8_ops[16][256] = {
+    [0x0] = { [0xE0] = CHIP8_OP_00E0, [0xEE] = CHIP8_OP_00EE },
+    [0x1] = ROW_ALL(CHIP8_OP_1NNN),
+    [0x2] = ROW_ALL(CHIP8_OP_2NNN),
+    [0x3] = ROW_ALL(CHIP8_OP_3XNN),
+    [0x4] = ROW_ALL(CHIP8_OP_4XNN),
+    [0x5] = { REPEAT_16(LOW_NIBBLE_0(CHIP8_OP_5XY0)) },
+    [0x6] = ROW_ALL(CHIP8_OP_6XNN),
+    [0x7] = ROW_ALL(CHIP8_OP_7XNN),
+    [0x8] = { REPEAT_16(ARITHMETIC) },
+    [0x9] = { REPEAT_16(LOW_NIBBLE_0(CHIP8_OP_9XY0)) },
+    [0xA] = ROW_ALL(CHIP8_OP_ANNN),
+    [0xB] = ROW_ALL(CHIP8_OP_BNNN),
+    [0xC] = ROW_ALL(CHIP8_OP_CXNN),
+    [0xD] = ROW_ALL(CHIP8_OP_DXYN),
+    [0xE] = { [0x9E] = CHIP8_OP_EX9E, [0xA1] = CHIP8_OP_EXA1 },
+    [0xF] = {
+        [0x07] = CHIP8_OP_FX07, [0x0A] = CHIP8_OP_FX0A, [0x15] = CHIP8_OP_FX15,
+        [0x18] = CHIP8_OP_FX18, [0x1E] = CHIP8_OP_FX1E, [0x29] = CHIP8_OP_FX29,
+        [0x33] = CHIP8_OP_FX33, [0x55] = CHIP8_OP_FX55, [0x65] = CHIP8_OP_FX65
+    }
+};
+
+// Split an opcode into its operation and operands
+static inline void decode(uint16_t opcode, Chip8Instruction *in) {
+    in->op = chip8_ops[opcode >> 12][opcode & 0x00FF];
+    // 00E0 and 00EE only with X = 0; the rest of 0NNN is ignored
+    if (opcode >= 0x0100 && opcode < 0x1000) {
+        in->op = CHIP8_OP_NOP;
+    }
+    in->x = (opcode & 0x0F00) >> 8;
+    in->y = (opcode & 0x00F0) >> 4;
+    in->n = opcode & 0x000F;
+    in->nn = opcode & 0x00FF;
+    in->nnn = opcode & 0x0FFF;
+}
+
+void chip8_decode(uint16_t opcode, Chip8Instruction *in) {
+    decode(opcode, in);
+}
+
+// Run the handler, counting the instruction (at pc - 2) when profiling
+static inline void dispatch(Chip8 *chip8, const Chip8Instruction *in) {
+    CHIP8_PROFILE_ADD(chip8, op_counts[in->op], 1);
+    CHIP8_PROFILE_ADD(chip8, pc_counts[(uint16_t)(chip8->pc - 2) % CHIP8_MEMORY_SIZE], 1);
+    chip8_handlers[in->op](chip8, in);
+}
+
+// Execute an instruction that has already been decoded (pc already
+// points past it)
+void chip8_execute_decoded(Chip8 *chip8, const Chip8Instruction *in) {
+    dispatch(chip8, in);
+}
+
+// Decode and execute one instruction
+void chip8_execute(Chip8 *chip8, uint16_t opcode) {
+    Chip8Instruction in;
+    decode(opcode, &in);
+    dispatch(chip8, &in);
+}
+
+// Execute one cycle. The timers are not touched here - they run at 60 Hz
+// whatever the CPU speed, see chip8_tick_timers and src/scheduler.c.
+void chip8_cycle(Chip8 *chip8) {
+    // Fetch instruction
+    uint16_t opcode = fetch(chip8);
+    
+    // Decode and execute instruction
+    Chip8Instruction in;
+    decode(opcode, &in);
+    dispatch(chip8, &in);
+}
+
+// State hashing
+// 64-bit FNV-1a over a byte range, continuing from `hash`
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// Hash of the whole machine. Fields are hashed one by one so struct
+// padding never leaks into the result.
+uint64_t chip8_state_hash(const Chip8 *chip8) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (int p = 0; p < CHIP8_PAGE_COUNT; p++) {
+        hash = fnv1a(hash, chip8->pages[p], CHIP8_PAGE_SIZE);
+    }
+    hash = fnv1a(hash, chip8->V, sizeof(chip8->V));
+    hash = fnv1a(hash, &chip8->I, sizeof(chip8->I));
+    hash = fnv1a(hash, &chip8->pc, sizeof(chip8->pc));
+    hash = fnv1a(hash, chip8->display, sizeof(chip8->display));
+    hash = fnv1a(hash, &chip8->delay_timer, sizeof(chip8->delay_timer));
+    hash = fnv1a(hash, &chip8->sound_timer, sizeof(chip8->sound_timer));
+    hash = fnv1a(hash, chip8->stack, sizeof(chip8->stack));
+    hash = fnv1a(hash, &chip8->sp, sizeof(chip8->sp));
+    hash = fnv1a(hash, chip8->keypad, sizeof(chip8->keypad));
+    hash = fnv1a(hash, &chip8->rng_state, sizeof(chip8->rng_state));
+    if (chip8->quirks != CHIP8_QUIRKS_DEFAULT) {
+        hash = fnv1a(hash, &chip8->quirks, sizeof(chip8->quirks));
+    }
+    if (chip8->ext) {
+        const Chip8Ext *ext = chip8->ext;
+        hash = fnv1a(hash, &chip8->variant, sizeof(chip8->variant));
+        for (int p = 0; p < ext->high_page_count; p++) {
+            hash = fnv1a(hash, ext->high_pages[p], CHIP8_PAGE_SIZE);
+        }
+        hash = fnv1a(hash, ext->screen, ext->plane_count * sizeof(ext->screen[0]));
+        hash = fnv1a(hash, &ext->hires, sizeof(ext->hires));
+        hash = fnv1a(hash, &ext->plane_mask, sizeof(ext->plane_mask));
+        hash = fnv1a(hash, &ext->pitch, sizeof(ext->pitch));
+        hash = fnv1a(hash, ext->flags, sizeof(ext->flags));
+        hash = fnv1a(hash, ext->pattern, sizeof(ext->pattern));
+    }
+    return hash;
+}
+
+// One 64-bit word into a running state key
+static inline uint64_t key_word(uint64_t key, uint64_t word) {
+    key = (key ^ word) * 0x9E3779B97F4A7C15ULL;
+    return key ^ (key >> 29);
+}
+
+static uint64_t key_bytes(uint64_t key, const void *data, size_t size) {
+    for (size_t i = 0; i < size; i += 8) {
+        uint64_t word = 0;
+        memcpy(&word, (const uint8_t *)data + i, size - i < 8 ? size - i : 8);
+        key = key_word(key, word);
+    }
+    return key;
+}
+
+// A 64-bit key for the whole machine, for telling states apart in a search
+// (see chip8_visited_insert). It covers what chip8_state_hash does, but
+// memory comes from the hashes its pages keep up to date as they are
+// written (chip8_mem_hash), so only the registers and the display are read:
+// about 60 multiplies for a CHIP-8 machine rather than 6KB of FNV-1a. The
+// value may change between versions; store chip8_state_hash instead.
+uint64_t chip8_state_key(const Chip8 *chip8) {
+    uint64_t key = key_bytes(0, chip8->V, sizeof(chip8->V));
+    key = key_word(key, chip8->I | (uint64_t)chip8->pc << 16 | (uint64_t)chip8->delay_timer << 32 |
+                            (uint64_t)chip8->sound_timer << 40 | (uint64_t)chip8->sp << 48 |
+                            (uint64_t)chip8->quirks << 56);
+    key = key_word(key, chip8->rng_state | (uint64_t)chip8->variant << 32);
+    key = key_bytes(key, chip8->stack, sizeof(chip8->stack));
+    key = key_bytes(key, chip8->keypad, sizeof(chip8->keypad));
+    key = key_bytes(key, chip8->display, sizeof(chip8->display));
+    if (chip8->ext) {
+        const Chip8Ext *ext = chip8->ext;
+        key = key_bytes(key, ext->screen, ext->plane_count * sizeof(ext->screen[0]));
+        key = key_word(key, ext->hires | ext->plane_mask << 8 | ext->pitch << 16);
+        key = key_bytes(key, ext->flags, sizeof(ext->flags));
+        key = key_bytes(key, ext->pattern, sizeof(ext->pattern));
+    }
+    return key_word(key, chip8_mem_hash(chip8));
+}
+
+// Quick checksum of the display, one packed row at a time. Cheap enough
+// to take after every frame.
+// SUPER-CHIP and XO-CHIP machines show their 128x64 screen instead.
+uint64_t chip8_display_checksum(const Chip8 *chip8) {
+    const uint64_t *words = chip8->display;
+    size_t count = CHIP8_DISPLAY_HEIGHT;
+    if (chip8->ext) {
+        words = &chip8->ext->screen[0][0][0];
+        count = chip8->ext->plane_count * CHIP8_HIRES_HEIGHT * CHIP8_HIRES_WORDS;
+    }
+    uint64_t hash = 0;
+    for (size_t i = 0; i < count; i++) {
+        hash = (hash ^ words[i]) * 0x9E3779B97F4A7C15ULL;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
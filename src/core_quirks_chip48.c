@@ -0,0 +1,12 @@
+// CHIP-8 core with CHIP-48's quirks (see src/core_template.h): shifts
+// work on VX alone, FX55/FX65 move I one short of the last register, BXNN
+// adds VX, and sprites are clipped at the screen edges
+#define CORE_RUN chip8_quirks_chip48_run
+#define CORE_CHIP8 1
+#define CORE_XO 0
+#define CORE_SHIFT_VY 0
+#define CORE_MEMORY_INCREMENTS_I 2
+#define CORE_JUMP_VX 1
+#define CORE_CLIP 1
+#define CORE_LOGIC_RESETS_VF 0
+#include "core_template.h"
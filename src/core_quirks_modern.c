@@ -0,0 +1,13 @@
+// CHIP-8 core with the quirks most programs written today expect, the
+// same as Octo's and XO-CHIP's (see src/core_template.h): shifts take VY,
+// FX55/FX65 move I past the registers, BNNN adds V0, and sprites wrap
+// round the screen edges
+#define CORE_RUN chip8_quirks_modern_run
+#define CORE_CHIP8 1
+#define CORE_XO 0
+#define CORE_SHIFT_VY 1
+#define CORE_MEMORY_INCREMENTS_I 1
+#define CORE_JUMP_VX 0
+#define CORE_CLIP 0
+#define CORE_LOGIC_RESETS_VF 0
+#include "core_template.h"
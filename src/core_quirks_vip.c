@@ -0,0 +1,12 @@
+// CHIP-8 core with the COSMAC VIP's quirks (see src/core_template.h):
+// shifts take VY, FX55/FX65 move I past the registers, BNNN adds V0,
+// sprites are clipped at the screen edges, and 8XY1/8XY2/8XY3 clear VF
+#define CORE_RUN chip8_quirks_vip_run
+#define CORE_CHIP8 1
+#define CORE_XO 0
+#define CORE_SHIFT_VY 1
+#define CORE_MEMORY_INCREMENTS_I 1
+#define CORE_JUMP_VX 0
+#define CORE_CLIP 1
+#define CORE_LOGIC_RESETS_VF 1
+#include "core_template.h"
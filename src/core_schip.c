@@ -0,0 +1,12 @@
+// SUPER-CHIP core (see src/core_template.h), with SUPER-CHIP 1.1's quirks:
+// shifts work on VX alone, FX55/FX65 leave I where it was, BXNN adds VX,
+// and sprites are clipped at the screen edges
+#define CORE_RUN chip8_schip_run
+#define CORE_CHIP8 0
+#define CORE_XO 0
+#define CORE_SHIFT_VY 0
+#define CORE_MEMORY_INCREMENTS_I 0
+#define CORE_JUMP_VX 1
+#define CORE_CLIP 1
+#define CORE_LOGIC_RESETS_VF 0
+#include "core_template.h"
@@ -0,0 +1,518 @@
+// Core template
+// The SUPER-CHIP and XO-CHIP interpreters, and CHIP-8 with each quirk
+// profile, are the same code with different instructions and quirks
+// switched on, so it is written once, here, and compiled once per core: a
+// core is a .c file that defines the macros below and then includes this
+// file. Every switch is a compile-time constant, so each core only holds
+// the instructions it has, and its hot loop never asks which variant or
+// quirk profile it is running.
+//
+//   CORE_RUN                   name of the Chip8RunFn to define
+//   CORE_CHIP8                 1 for plain CHIP-8: the 64x32 display in
+//                              Chip8.display and no Chip8Ext. 0 for the
+//                              SUPER-CHIP instructions and 128x64 screen.
+//   CORE_XO                    1 for XO-CHIP: bit planes (FN01), 64KB of
+//                              memory, 5XY2/5XY3, F000 NNNN, F002, FX3A
+//                              and 00DN. 0 for SUPER-CHIP.
+//   CORE_SHIFT_VY              8XY6/8XYE shift VY into VX (1), or VX in place (0)
+//   CORE_MEMORY_INCREMENTS_I   FX55/FX65 leave I just past the last register
+//                              (1), one short of it as CHIP-48 did (2), or
+//                              where it was (0)
+//   CORE_JUMP_VX               BXNN jumps to XNN + VX instead of NNN + V0
+//   CORE_CLIP                  sprites stop at the screen edges instead of
+//                              wrapping round
+//   CORE_LOGIC_RESETS_VF       8XY1/8XY2/8XY3 clear VF, as on the COSMAC VIP
+//
+// CHIP-8 with the default quirks stays in src/chip8.c: its decoded
+// instructions are what the decode cache and the JIT are built on.
+#include <stdint.h>
+#include <string.h>
+
+#include "chip8.h"
+
+#if CORE_XO
+#define READ(chip8, addr) chip8_xmem_read(chip8, (uint16_t)(addr))
+#define WRITE(chip8, addr, value) chip8_xmem_write(chip8, (uint16_t)(addr), value)
+#else
+#define READ(chip8, addr) chip8_mem_read(chip8, (uint16_t)(addr))
+#define WRITE(chip8, addr, value) chip8_mem_write(chip8, (uint16_t)(addr), value)
+#endif
+
+#if CORE_CHIP8
+// 00E0
+static void clear_screen(Chip8 *chip8) {
+    memset(chip8->display, 0, sizeof(chip8->display));
+    chip8->dirty_rows = CHIP8_ALL_ROWS_DIRTY;
+}
+
+// DXYN on the 64x32 display. The sprite's top left corner wraps onto the
+// screen; the rest of it is clipped or wraps round depending on CORE_CLIP.
+static void draw(Chip8 *chip8, uint8_t vx, uint8_t vy, uint8_t n) {
+    unsigned x = chip8->V[vx] % CHIP8_DISPLAY_WIDTH;
+    unsigned top = chip8->V[vy] % CHIP8_DISPLAY_HEIGHT;
+    uint64_t hit = 0;
+
+    for (int i = 0; i < n; i++) {
+        unsigned y = top + i;
+#if CORE_CLIP
+        if (y >= CHIP8_DISPLAY_HEIGHT) {
+            break;
+        }
+        uint64_t sprite = (uint64_t)READ(chip8, chip8->I + i) << 56;
+        uint64_t row = sprite >> x;
+#else
+        y %= CHIP8_DISPLAY_HEIGHT;
+        uint64_t sprite = (uint64_t)READ(chip8, chip8->I + i) << 56;
+        uint64_t row = sprite >> x | sprite << ((64 - x) & 63);
+#endif
+        hit |= chip8->display[y] & row;
+        chip8->display[y] ^= row;
+        chip8->dirty_rows |= (uint32_t)(row != 0) << y;
+    }
+    chip8->V[0xF] = hit ? 1 : 0;
+    CHIP8_PROFILE_ADD(chip8, sprites_drawn, 1);
+    CHIP8_PROFILE_ADD(chip8, sprite_collisions, hit != 0);
+}
+#else
+typedef uint64_t Row[CHIP8_HIRES_WORDS];
+
+// Screen rows are marked dirty in pairs: bit y covers rows 2y and 2y + 1
+static inline void mark_row(Chip8 *chip8, int y) {
+    chip8->dirty_rows |= 1u << (y >> 1);
+}
+
+// Pixels per 64x32-mode pixel (the screen is always 128x64)
+static inline int pixel_size(const Chip8 *chip8) {
+    return chip8->ext->hires ? 1 : 2;
+}
+
+// 00E0 - clear the selected planes
+static void clear_screen(Chip8 *chip8) {
+    Chip8Ext *ext = chip8->ext;
+    for (int p = 0; p < ext->plane_count; p++) {
+        if (ext->plane_mask & (1 << p)) {
+            memset(ext->screen[p], 0, sizeof(ext->screen[p]));
+        }
+    }
+    chip8->dirty_rows = CHIP8_ALL_ROWS_DIRTY;
+}
+
+// Scrolling. Up and down move whole rows; left and right shift each row
+// across its two words. Counts are in 64x32-mode pixels when in that mode.
+static void scroll_down(Chip8 *chip8, int n) {
+    Chip8Ext *ext = chip8->ext;
+    n *= pixel_size(chip8);
+    for (int p = 0; p < ext->plane_count; p++) {
+        if (ext->plane_mask & (1 << p)) {
+            memmove(&ext->screen[p][n], &ext->screen[p][0], (CHIP8_HIRES_HEIGHT - n) * sizeof(Row));
+            memset(&ext->screen[p][0], 0, n * sizeof(Row));
+        }
+    }
+    chip8->dirty_rows = CHIP8_ALL_ROWS_DIRTY;
+}
+
+#if CORE_XO
+static void scroll_up(Chip8 *chip8, int n) {
+    Chip8Ext *ext = chip8->ext;
+    n *= pixel_size(chip8);
+    for (int p = 0; p < ext->plane_count; p++) {
+        if (ext->plane_mask & (1 << p)) {
+            memmove(&ext->screen[p][0], &ext->screen[p][n], (CHIP8_HIRES_HEIGHT - n) * sizeof(Row));
+            memset(&ext->screen[p][CHIP8_HIRES_HEIGHT - n], 0, n * sizeof(Row));
+        }
+    }
+    chip8->dirty_rows = CHIP8_ALL_ROWS_DIRTY;
+}
+#endif
+
+static void scroll_right(Chip8 *chip8) {
+    Chip8Ext *ext = chip8->ext;
+    int n = 4 * pixel_size(chip8);
+    for (int p = 0; p < ext->plane_count; p++) {
+        if (ext->plane_mask & (1 << p)) {
+            for (int y = 0; y < CHIP8_HIRES_HEIGHT; y++) {
+                uint64_t *row = ext->screen[p][y];
+                row[1] = row[1] >> n | row[0] << (64 - n);
+                row[0] >>= n;
+            }
+        }
+    }
+    chip8->dirty_rows = CHIP8_ALL_ROWS_DIRTY;
+}
+
+static void scroll_left(Chip8 *chip8) {
+    Chip8Ext *ext = chip8->ext;
+    int n = 4 * pixel_size(chip8);
+    for (int p = 0; p < ext->plane_count; p++) {
+        if (ext->plane_mask & (1 << p)) {
+            for (int y = 0; y < CHIP8_HIRES_HEIGHT; y++) {
+                uint64_t *row = ext->screen[p][y];
+                row[0] = row[0] << n | row[1] >> (64 - n);
+                row[1] <<= n;
+            }
+        }
+    }
+    chip8->dirty_rows = CHIP8_ALL_ROWS_DIRTY;
+}
+
+// 00FE / 00FF - switch between 64x32 and 128x64. XO-CHIP clears the
+// screen when it does; SUPER-CHIP leaves it be.
+static void set_hires(Chip8 *chip8, int hires) {
+    chip8->ext->hires = (uint8_t)hires;
+#if CORE_XO
+    memset(chip8->ext->screen, 0, chip8->ext->plane_count * sizeof(chip8->ext->screen[0]));
+    chip8->dirty_rows = CHIP8_ALL_ROWS_DIRTY;
+#endif
+}
+
+// Double every pixel of a sprite row of up to 16 pixels: abcd -> aabbccdd
+static inline uint64_t double_pixels(uint64_t bits) {
+    bits = (bits | bits << 8) & 0x00FF00FF;
+    bits = (bits | bits << 4) & 0x0F0F0F0F;
+    bits = (bits | bits << 2) & 0x33333333;
+    bits = (bits | bits << 1) & 0x55555555;
+    return bits | bits << 1;
+}
+
+// XOR a sprite row into a screen row with its first pixel at column `x`.
+// `bits` holds the sprite row left-aligned (first pixel in bit 63), at most
+// 32 pixels. Returns the pixels it turned off.
+static inline uint64_t draw_row(uint64_t *row, uint64_t bits, unsigned x) {
+    uint64_t left, right;
+    if (x < 64) {
+        left = bits >> x;
+        right = x ? bits << (64 - x) : 0;
+    }
+    else {
+        right = bits >> (x - 64);
+#if CORE_CLIP
+        left = 0;
+#else
+        // What runs off the right edge comes back on the left
+        left = x > 64 ? bits << (128 - x) : 0;
+#endif
+    }
+    uint64_t hit = (row[0] & left) | (row[1] & right);
+    row[0] ^= left;
+    row[1] ^= right;
+    return hit;
+}
+
+// DXYN - an 8xN sprite, or 16x16 for DXY0. On XO-CHIP every selected
+// plane gets its own sprite, one after another in memory from I. VF is
+// set if any pixel was turned off.
+static void draw(Chip8 *chip8, uint8_t vx, uint8_t vy, uint8_t n) {
+    Chip8Ext *ext = chip8->ext;
+    int size = pixel_size(chip8);
+    int width = n ? 8 : 16;
+    int height = n ? n : 16;
+    int bytes = width / 8;
+    unsigned x = (chip8->V[vx] % (CHIP8_HIRES_WIDTH / size)) * size;
+    unsigned top = (chip8->V[vy] % (CHIP8_HIRES_HEIGHT / size)) * size;
+    uint16_t addr = chip8->I;
+    uint64_t hit = 0;
+
+    for (int p = 0; p < ext->plane_count; p++) {
+        if (!(ext->plane_mask & (1 << p))) {
+            continue;
+        }
+        for (int i = 0; i < height; i++) {
+            uint64_t bits = READ(chip8, addr + i * bytes);
+            if (bytes == 2) {
+                bits = bits << 8 | READ(chip8, addr + i * bytes + 1);
+            }
+            if (size == 2) {
+                bits = double_pixels(bits);
+            }
+            bits <<= 64 - width * size;
+
+            for (int k = 0; k < size; k++) {
+                unsigned y = top + i * size + k;
+#if CORE_CLIP
+                if (y >= CHIP8_HIRES_HEIGHT) {
+                    break;
+                }
+#else
+                y %= CHIP8_HIRES_HEIGHT;
+#endif
+                hit |= draw_row(ext->screen[p][y], bits, x);
+                mark_row(chip8, y);
+            }
+        }
+        addr += height * bytes;
+    }
+    chip8->V[0xF] = hit ? 1 : 0;
+    CHIP8_PROFILE_ADD(chip8, sprites_drawn, 1);
+    CHIP8_PROFILE_ADD(chip8, sprite_collisions, hit != 0);
+}
+#endif
+
+// Skip the next instruction. On XO-CHIP, F000 NNNN is four bytes long and
+// skipping it skips all four.
+static inline void skip(Chip8 *chip8) {
+#if CORE_XO
+    if (READ(chip8, chip8->pc) == 0xF0 && READ(chip8, chip8->pc + 1) == 0x00) {
+        chip8->pc += 2;
+    }
+#endif
+    chip8->pc += 2;
+}
+
+// 8XY6 / 8XYE
+#if CORE_SHIFT_VY
+#define SHIFT_SOURCE(x, y) (y)
+#else
+#define SHIFT_SOURCE(x, y) (x)
+#endif
+
+// 8XY1 / 8XY2 / 8XY3
+#if CORE_LOGIC_RESETS_VF
+#define LOGIC_FLAG(V) ((V)[0xF] = 0)
+#else
+#define LOGIC_FLAG(V) ((void)0)
+#endif
+
+// How far FX55 / FX65 move I
+#if CORE_MEMORY_INCREMENTS_I == 2
+#define MEMORY_STEP(x) (x)
+#elif CORE_MEMORY_INCREMENTS_I
+#define MEMORY_STEP(x) ((x) + 1)
+#else
+#define MEMORY_STEP(x) 0
+#endif
+
+static inline void execute(Chip8 *chip8, uint16_t opcode) {
+    uint8_t *V = chip8->V;
+    uint8_t x = (opcode >> 8) & 0xF;
+    uint8_t y = (opcode >> 4) & 0xF;
+    uint8_t n = opcode & 0xF;
+    uint8_t nn = opcode & 0xFF;
+    uint16_t nnn = opcode & 0xFFF;
+    uint8_t flag, source;
+
+    switch (opcode >> 12) {
+        case 0x0:
+#if !CORE_CHIP8
+            if ((opcode & 0xFFF0) == 0x00C0) {
+                scroll_down(chip8, n);
+                break;
+            }
+#endif
+#if CORE_XO
+            if ((opcode & 0xFFF0) == 0x00D0) {
+                scroll_up(chip8, n);
+                break;
+            }
+#endif
+            switch (opcode) {
+                case 0x00E0: clear_screen(chip8); break;
+                case 0x00EE:
+                    chip8->sp--;
+                    chip8->pc = chip8->stack[chip8->sp & 0xF];
+                    break;
+#if !CORE_CHIP8
+                case 0x00FB: scroll_right(chip8); break;
+                case 0x00FC: scroll_left(chip8); break;
+                case 0x00FD: chip8->pc -= 2; break;  // exit: stay here for good
+                case 0x00FE: set_hires(chip8, 0); break;
+                case 0x00FF: set_hires(chip8, 1); break;
+#endif
+                default: break;                      // the rest of 0NNN is ignored
+            }
+            break;
+        case 0x1:
+            chip8->pc = nnn;
+            break;
+        case 0x2:
+            chip8->stack[chip8->sp & 0xF] = chip8->pc;
+            chip8->sp++;
+            chip8->pc = nnn;
+            break;
+        case 0x3:
+            if (V[x] == nn) {
+                skip(chip8);
+            }
+            break;
+        case 0x4:
+            if (V[x] != nn) {
+                skip(chip8);
+            }
+            break;
+        case 0x5:
+            if (n == 0 && V[x] == V[y]) {
+                skip(chip8);
+            }
+#if CORE_XO
+            // 5XY2 / 5XY3 - save or load VX..VY (either way round) at I,
+            // leaving I alone
+            else if (n == 2 || n == 3) {
+                int step = x <= y ? 1 : -1;
+                int count = (x <= y ? y - x : x - y) + 1;
+                for (int i = 0; i < count; i++) {
+                    if (n == 2) {
+                        WRITE(chip8, chip8->I + i, V[x + i * step]);
+                    }
+                    else {
+                        V[x + i * step] = READ(chip8, chip8->I + i);
+                    }
+                }
+            }
+#endif
+            break;
+        case 0x6:
+            V[x] = nn;
+            break;
+        case 0x7:
+            V[x] += nn;
+            break;
+        case 0x8:
+            // VF is written last, so it ends up the flag even when X is F
+            switch (n) {
+                case 0x0: V[x] = V[y]; break;
+                case 0x1: V[x] |= V[y]; LOGIC_FLAG(V); break;
+                case 0x2: V[x] &= V[y]; LOGIC_FLAG(V); break;
+                case 0x3: V[x] ^= V[y]; LOGIC_FLAG(V); break;
+                case 0x4:
+                    flag = V[x] + V[y] > 255;
+                    V[x] += V[y];
+                    V[0xF] = flag;
+                    break;
+                case 0x5:
+                    flag = V[x] >= V[y];
+                    V[x] -= V[y];
+                    V[0xF] = flag;
+                    break;
+                case 0x6:
+                    source = V[SHIFT_SOURCE(x, y)];
+                    V[x] = source >> 1;
+                    V[0xF] = source & 1;
+                    break;
+                case 0x7:
+                    flag = V[y] >= V[x];
+                    V[x] = V[y] - V[x];
+                    V[0xF] = flag;
+                    break;
+                case 0xE:
+                    source = V[SHIFT_SOURCE(x, y)];
+                    V[x] = (uint8_t)(source << 1);
+                    V[0xF] = source >> 7;
+                    break;
+                default: break;
+            }
+            break;
+        case 0x9:
+            if (n == 0 && V[x] != V[y]) {
+                skip(chip8);
+            }
+            break;
+        case 0xA:
+            chip8->I = nnn;
+            break;
+        case 0xB:
+#if CORE_JUMP_VX
+            chip8->pc = nnn + V[x];
+#else
+            chip8->pc = nnn + V[0];
+#endif
+            break;
+        case 0xC:
+            V[x] = chip8_random_byte(chip8) & nn;
+            break;
+        case 0xD:
+            draw(chip8, x, y, n);
+            break;
+        case 0xE:
+            if (nn == 0x9E && chip8->keypad[V[x] & 0xF]) {
+                skip(chip8);
+            }
+            else if (nn == 0xA1 && !chip8->keypad[V[x] & 0xF]) {
+                skip(chip8);
+            }
+            break;
+        case 0xF:
+#if CORE_XO
+            if (opcode == 0xF000) {
+                // I = the 16-bit word after the instruction
+                chip8->I = READ(chip8, chip8->pc) << 8 | READ(chip8, chip8->pc + 1);
+                chip8->pc += 2;
+                break;
+            }
+            if (opcode == 0xF002) {
+                for (int i = 0; i < 16; i++) {
+                    chip8->ext->pattern[i] = READ(chip8, chip8->I + i);
+                }
+                break;
+            }
+            if (nn == 0x01) {
+                chip8->ext->plane_mask = x & 3;  // FN01: N is the plane mask
+                break;
+            }
+#endif
+            switch (nn) {
+                case 0x07: V[x] = chip8->delay_timer; break;
+                case 0x0A:
+                    for (int i = 0; i < 16; i++) {
+                        if (chip8->keypad[i]) {
+                            V[x] = i;
+                            return;
+                        }
+                    }
+                    chip8->pc -= 2;  // no key yet - run this again
+                    break;
+                case 0x15: chip8->delay_timer = V[x]; break;
+                case 0x18: chip8->sound_timer = V[x]; break;
+                case 0x1E: chip8->I += V[x]; break;
+                case 0x29: chip8->I = (V[x] & 0xF) * 5; break;
+#if !CORE_CHIP8
+                case 0x30: chip8->I = CHIP8_BIG_FONT_ADDR + (V[x] & 0xF) * 10; break;
+#endif
+                case 0x33:
+                    WRITE(chip8, chip8->I, V[x] / 100);
+                    WRITE(chip8, chip8->I + 1, (V[x] / 10) % 10);
+                    WRITE(chip8, chip8->I + 2, V[x] % 10);
+                    break;
+#if CORE_XO
+                case 0x3A: chip8->ext->pitch = V[x]; break;
+#endif
+                case 0x55:
+                    for (int i = 0; i <= x; i++) {
+                        WRITE(chip8, chip8->I + i, V[i]);
+                    }
+                    chip8->I += MEMORY_STEP(x);
+                    break;
+                case 0x65:
+                    for (int i = 0; i <= x; i++) {
+                        V[i] = READ(chip8, chip8->I + i);
+                    }
+                    chip8->I += MEMORY_STEP(x);
+                    break;
+#if !CORE_CHIP8
+                // FX75 / FX85 - the flag registers. SUPER-CHIP has 8.
+                case 0x75:
+                    for (int i = 0; i <= (CORE_XO ? x : x & 7); i++) {
+                        chip8->ext->flags[i] = V[i];
+                    }
+                    break;
+                case 0x85:
+                    for (int i = 0; i <= (CORE_XO ? x : x & 7); i++) {
+                        V[i] = chip8->ext->flags[i];
+                    }
+                    break;
+#endif
+                default: break;
+            }
+            break;
+    }
+}
+
+// Run exactly `cycles` instructions (a Chip8RunFn; `context` is unused)
+uint64_t CORE_RUN(void *context, Chip8 *chip8, uint64_t cycles) {
+    (void)context;
+    for (uint64_t i = 0; i < cycles; i++) {
+        uint16_t opcode = READ(chip8, chip8->pc) << 8 | READ(chip8, chip8->pc + 1);
+        CHIP8_PROFILE_ADD(chip8, pc_counts[chip8->pc % CHIP8_MEMORY_SIZE], 1);
+        chip8->pc += 2;
+        execute(chip8, opcode);
+    }
+    return cycles;
+}
@@ -0,0 +1,12 @@
+// XO-CHIP core (see src/core_template.h), with Octo's quirks: shifts take
+// VY, FX55/FX65 move I past the registers, BNNN adds V0, and sprites wrap
+// round the screen edges
+#define CORE_RUN chip8_xochip_run
+#define CORE_CHIP8 0
+#define CORE_XO 1
+#define CORE_SHIFT_VY 1
+#define CORE_MEMORY_INCREMENTS_I 1
+#define CORE_JUMP_VX 0
+#define CORE_CLIP 0
+#define CORE_LOGIC_RESETS_VF 0
+#include "core_template.h"
@@ -0,0 +1,118 @@
+// Pre-decoded instruction cache
+// A parallel array to memory with one decoded instruction per address.
+// Each slot is decoded the first time it runs; after that the interpreter
+// skips the fetch and the shifts and masks and goes straight to the
+// handler. There is a slot for every byte rather than every other byte
+// because CHIP-8 code can run from odd addresses (the bundled Space
+// Invaders does, all the time).
+//
+// The only instructions that write memory are FX33 and FX55, so those are
+// the only ones that can make a slot stale. After either runs, the slots
+// of every instruction overlapping the bytes it wrote are emptied and get
+// decoded again next time. Anything else that writes memory (loading a ROM
+// or a saved state) must call chip8_decode_cache_clear.
+//
+// A machine with a quirk profile runs here too. The few instructions the
+// profile changes (see chip8_quirks_differ) are decoded to SLOT_CORE and
+// go to the profile's own core one at a time; everything else runs on the
+// default handlers like it would without a profile.
+#include <stdint.h>
+#include <string.h>
+
+#include "chip8.h"
+
+#define SLOT_EMPTY 0xFF  // op of a slot that hasn't been decoded yet
+#define SLOT_CORE 0xFE   // op of a slot the machine's own core runs
+
+void chip8_decode_cache_clear(Chip8DecodeCache *cache) {
+    memset(cache->entries, SLOT_EMPTY, sizeof(cache->entries));
+}
+
+// Empty the slot of every instruction that includes a byte of
+// [addr, addr + size) - including the one starting just before addr
+void chip8_decode_cache_invalidate(Chip8DecodeCache *cache, uint16_t addr, uint16_t size) {
+    int first = addr - 1;
+    int last = addr + size;  // exclusive
+    if (first < 0) {
+        first = 0;
+    }
+    if (last > CHIP8_DECODE_CACHE_SLOTS) {
+        // The write wrapped around to the bottom of memory
+        chip8_decode_cache_invalidate(cache, 0, last - CHIP8_DECODE_CACHE_SLOTS);
+        last = CHIP8_DECODE_CACHE_SLOTS;
+    }
+    for (int slot = first; slot < last; slot++) {
+        cache->entries[slot].op = SLOT_EMPTY;
+    }
+}
+
+// Run one instruction and drop whatever it wrote over
+static void execute(Chip8DecodeCache *cache, Chip8 *chip8, const Chip8Instruction *in) {
+    if (in->op == CHIP8_OP_FX33 || in->op == CHIP8_OP_FX55) {
+        uint16_t addr = chip8->I;
+        uint16_t size = in->op == CHIP8_OP_FX33 ? 3 : in->x + 1;
+        chip8_execute_decoded(chip8, in);
+        chip8_decode_cache_invalidate(cache, addr, size);
+    }
+    else {
+        chip8_execute_decoded(chip8, in);
+    }
+}
+
+// Run the instruction at pc on the machine's own core (the default one if
+// it has no profile), and drop whatever it wrote over
+static void interpret(Chip8DecodeCache *cache, Chip8 *chip8) {
+    uint16_t opcode = chip8_mem_read(chip8, chip8->pc) << 8 | chip8_mem_read(chip8, chip8->pc + 1);
+    uint16_t write_addr = chip8->I;
+    Chip8RunFn core = chip8_machine_engine(chip8);
+    if (core) {
+        core(NULL, chip8, 1);
+    }
+    else {
+        chip8_cycle(chip8);
+    }
+
+    if ((opcode & 0xF0FF) == 0xF033) {
+        chip8_decode_cache_invalidate(cache, write_addr, 3);
+    }
+    else if ((opcode & 0xF0FF) == 0xF055) {
+        chip8_decode_cache_invalidate(cache, write_addr, ((opcode & 0x0F00) >> 8) + 1);
+    }
+}
+
+static void decode_slot(const Chip8 *chip8, uint16_t pc, Chip8Instruction *in) {
+    uint16_t opcode = chip8_mem_read(chip8, pc) << 8 | chip8_mem_read(chip8, pc + 1);
+    chip8_decode(opcode, in);
+    if (chip8_quirks_differ((Chip8Quirks)chip8->quirks, opcode)) {
+        in->op = SLOT_CORE;
+    }
+}
+
+// Run exactly `cycles` cycles (a Chip8RunFn, see chip8_sched_set_engine)
+uint64_t chip8_decode_cache_run(void *context, Chip8 *chip8, uint64_t cycles) {
+    Chip8DecodeCache *cache = context;
+
+    for (uint64_t i = 0; i < cycles; i++) {
+        uint16_t pc = chip8->pc;
+
+        // Off the end of memory - leave it to the plain interpreter
+        if (pc >= CHIP8_DECODE_CACHE_SLOTS - 1) {
+            interpret(cache, chip8);
+            continue;
+        }
+
+        Chip8Instruction *in = &cache->entries[pc];
+        if (in->op >= SLOT_CORE) {
+            if (in->op == SLOT_EMPTY) {
+                decode_slot(chip8, pc, in);
+            }
+            if (in->op == SLOT_CORE) {
+                interpret(cache, chip8);
+                continue;
+            }
+        }
+        chip8->pc = pc + 2;
+        execute(cache, chip8, in);
+    }
+    return cycles;
+}
@@ -0,0 +1,70 @@
+// Display conversion
+// Expands the packed 1-bit-per-pixel display into 32-bit RGBA for the
+// frontend (white for on, black for off), and the same for the 128x64
+// SUPER-CHIP/XO-CHIP screen.
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "chip8.h"
+
+// Convert `row_count` rows starting at `first_row` into `pixels`, which
+// holds CHIP8_DISPLAY_WIDTH pixels per row starting with `first_row`
+void chip8_display_to_rgba(const Chip8 *chip8, uint32_t *pixels, int first_row, int row_count) {
+    chip8_rows_to_rgba(chip8->display, pixels, first_row, row_count);
+}
+
+// The same for a display that isn't in a Chip8 (e.g. a Chip8Frame)
+void chip8_rows_to_rgba(const uint64_t *display, uint32_t *pixels, int first_row, int row_count) {
+#ifdef __SSE2__
+    // Four pixels per store: copy the pixel bits into all four lanes, keep a
+    // different bit in each lane, and compare - lanes whose bit is set
+    // become 0xFFFFFFFF, the rest 0
+    const __m128i high_bits = _mm_set_epi32(0x10, 0x20, 0x40, 0x80);
+    const __m128i low_bits = _mm_set_epi32(0x01, 0x02, 0x04, 0x08);
+
+    for (int y = 0; y < row_count; y++) {
+        uint64_t row = display[first_row + y];
+        uint32_t *out = pixels + y * CHIP8_DISPLAY_WIDTH;
+        for (int byte = 0; byte < 8; byte++) {
+            __m128i bits = _mm_set1_epi32((int)(row >> (56 - byte * 8)) & 0xFF);
+            __m128i left = _mm_cmpeq_epi32(_mm_and_si128(bits, high_bits), high_bits);
+            __m128i right = _mm_cmpeq_epi32(_mm_and_si128(bits, low_bits), low_bits);
+            _mm_storeu_si128((__m128i *)(out + byte * 8), left);
+            _mm_storeu_si128((__m128i *)(out + byte * 8 + 4), right);
+        }
+    }
+#else
+    for (int y = 0; y < row_count; y++) {
+        uint64_t row = display[first_row + y];
+        uint32_t *out = pixels + y * CHIP8_DISPLAY_WIDTH;
+        for (int x = 0; x < CHIP8_DISPLAY_WIDTH; x++) {
+            // White if pixel is on (1), black if off (0)
+            out[x] = (row >> (63 - x)) & 1 ? 0xFFFFFFFF : 0x00000000;
+        }
+    }
+#endif
+}
+
+// XO-CHIP's two planes make four colours: a pixel in neither plane is
+// black, in the first white, in the second light grey, in both dark grey
+static const uint32_t plane_colours[4] = { 0x00000000, 0xFFFFFFFF, 0xAAAAAAFF, 0x555555FF };
+
+// Convert rows of a 128x64 screen with `plane_count` planes (1 or 2) into
+// `pixels`, CHIP8_HIRES_WIDTH pixels per row starting with `first_row`
+void chip8_screen_to_rgba(const uint64_t (*screen)[CHIP8_HIRES_HEIGHT][CHIP8_HIRES_WORDS], int plane_count,
+                          uint32_t *pixels, int first_row, int row_count) {
+    for (int y = 0; y < row_count; y++) {
+        uint32_t *out = pixels + y * CHIP8_HIRES_WIDTH;
+        for (int w = 0; w < CHIP8_HIRES_WORDS; w++) {
+            uint64_t first = screen[0][first_row + y][w];
+            uint64_t second = plane_count > 1 ? screen[1][first_row + y][w] : 0;
+            for (int x = 0; x < 64; x++) {
+                int colour = (first >> (63 - x) & 1) | (second >> (63 - x) & 1) << 1;
+                out[w * 64 + x] = plane_colours[colour];
+            }
+        }
+    }
+}
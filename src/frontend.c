@@ -0,0 +1,440 @@
+// Frontend - what the SDL frontend and chip8-headless share (see
+// frontend.h): reading the command line, setting a machine and its engine
+// up, and the headless and --jit-diff runs.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "frontend.h"
+
+// Built with -DCHIP8_AOT (chip8_aot_game in CMakeLists.txt), the binary
+// carries one ROM translated to C by chip8-aot, and runs it without a ROM
+// file
+#ifdef CHIP8_AOT
+extern const Chip8AotProgram chip8_aot_program;
+#endif
+
+// Create a JIT and make it `sched`'s engine. Without one (not an x86-64
+// host, or no executable memory) we say so and keep the engine we had.
+static Chip8Jit *start_jit(Chip8Scheduler *sched) {
+    Chip8Jit *jit = chip8_jit_create();
+    if (!jit) {
+        printf("JIT not available on this host, using the interpreter\n");
+        return NULL;
+    }
+    chip8_sched_set_engine(sched, chip8_jit_run, jit);
+    return jit;
+}
+
+// Run the translated program (CHIP8_AOT builds) if it was translated for
+// `chip8`'s quirk profile. Returns NULL, leaving the engine alone, if not.
+Chip8Aot *start_aot(Chip8Scheduler *sched, const Chip8 *chip8) {
+#ifdef CHIP8_AOT
+    if (!chip8_aot_matches(&chip8_aot_program, chip8)) {
+        printf("%s was translated for the %s quirks, using the interpreter\n", chip8_aot_program.name,
+               chip8_quirks_name(chip8_aot_program.quirks));
+        return NULL;
+    }
+    Chip8Aot *aot = chip8_aot_create(&chip8_aot_program);
+    if (aot) {
+        chip8_sched_set_engine(sched, chip8_aot_run, aot);
+    }
+    return aot;
+#else
+    (void)sched;
+    (void)chip8;
+    return NULL;
+#endif
+}
+
+// Load the ROM file from the options, or the ROM built into a CHIP8_AOT
+// binary when none was given
+int load_rom(Chip8 *chip8, const Options *opt) {
+#ifdef CHIP8_AOT
+    if (opt->rom == chip8_aot_program.name) {
+        return chip8_load_rom_buffer(chip8, chip8_aot_program.rom, chip8_aot_program.rom_size);
+    }
+#endif
+    return chip8_load_rom(chip8, opt->rom);
+}
+
+// chip8_init `chip8` as the variant and quirk profile the options ask for
+int init_machine(Chip8 *chip8, const Options *opt) {
+    chip8_init(chip8);
+    return chip8_set_variant(chip8, (Chip8Variant)opt->variant) &&
+           chip8_set_quirks(chip8, (Chip8Quirks)opt->quirks);
+}
+
+// Pick `chip8`'s engine: the decode cache (clearing it), or the JIT if
+// asked for. Both follow a CHIP-8 machine's quirk profile. SUPER-CHIP and
+// XO-CHIP machines always run on their own core.
+Chip8Jit *start_engine(Chip8Scheduler *sched, const Chip8 *chip8, Chip8DecodeCache *cache, int use_jit) {
+    if (chip8->ext) {
+        if (use_jit) {
+            printf("The JIT only runs CHIP-8, using the %s core\n", chip8_variant_name(chip8->variant));
+        }
+        chip8_sched_set_engine(sched, chip8_machine_engine(chip8), NULL);
+        return NULL;
+    }
+    chip8_decode_cache_clear(cache);
+    chip8_sched_set_engine(sched, chip8_decode_cache_run, cache);
+    return use_jit ? start_jit(sched) : NULL;
+}
+
+// Load a replay and set `chip8` up the way the recording started
+int start_replay(Chip8Replay *replay, const char *replay_file, Chip8 *chip8) {
+    if (!chip8_load_replay(replay, replay_file)) {
+        return 0;
+    }
+    if (!chip8_replay_prepare(replay, chip8)) {
+        chip8_free_replay(replay);
+        return 0;
+    }
+    return 1;
+}
+
+// Write the performance counters to `filename` as JSON
+int write_profile(const Chip8Profile *profile, const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        printf("Error: Could not open %s for writing\n", filename);
+        return 0;
+    }
+    int ok = chip8_profile_write_json(profile, file, 32);
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        printf("Error: Could not write profile to %s\n", filename);
+    }
+    return ok;
+}
+
+// Say whether a replay that has run to the end got where the recording did
+int finish_replay(const Chip8Replay *replay, const Chip8 *chip8) {
+    if (chip8_state_hash(chip8) != replay->end_hash) {
+        printf("Error: Replay ended in a different state than the recording\n");
+        return 0;
+    }
+    printf("Replay finished: %llu cycles, same state as the recording\n", (unsigned long long)replay->cycles);
+    return 1;
+}
+
+// Headless mode - run, then write the final state to `out_file` (or stdout).
+// A replay brings its own keys, speed and length.
+int run_headless(const Options *opt) {
+    long cycles = opt->cycles;
+    uint64_t cpu_hz = opt->cpu_hz;
+    Chip8 chip8;
+    Chip8InputScript script = { NULL, 0 };
+    Chip8Replay replay;
+    Chip8Recorder recorder;
+    static Chip8Profile profile;
+
+    if (!init_machine(&chip8, opt)) {
+        return 1;
+    }
+    if (opt->profile_file) {
+        chip8.profile = &profile;
+    }
+    if (!load_rom(&chip8, opt)) {
+        return 1;
+    }
+    if (opt->load_state_file && !chip8_load_state_file(&chip8, opt->load_state_file)) {
+        return 1;
+    }
+    if (opt->input_file && !chip8_load_input_script(&script, opt->input_file)) {
+        return 1;
+    }
+    if (opt->replay_file) {
+        if (!start_replay(&replay, opt->replay_file, &chip8)) {
+            return 1;
+        }
+        script = replay.script;  // freed along with the script below
+        cpu_hz = replay.cpu_hz;
+        cycles = (long)replay.cycles;
+    }
+    if (opt->record_file && !chip8_record_begin(&recorder, opt->record_file, &chip8, cpu_hz)) {
+        return 1;
+    }
+
+    Chip8HeadlessRun run;
+    chip8_headless_begin(&run, &script, cpu_hz);
+    if (opt->record_file) {
+        run.recorder = &recorder;
+    }
+    static Chip8DecodeCache cache;
+    Chip8Aot *aot = start_aot(&run.sched, &chip8);
+    Chip8Jit *jit = aot ? NULL : start_engine(&run.sched, &chip8, &cache, opt->use_jit);
+    uint64_t start = CHIP8_PROFILE_CLOCK();
+    chip8_headless_step(&chip8, &run, cycles);
+    CHIP8_PROFILE_ADD(&chip8, emulate_ns, CHIP8_PROFILE_CLOCK() - start);
+    chip8_jit_destroy(jit);
+    chip8_aot_destroy(aot);
+    chip8_free_input_script(&script);
+
+    if (opt->record_file && !chip8_record_end(&recorder, &chip8, run.sched.cycles)) {
+        return 1;
+    }
+    if (opt->replay_file && !finish_replay(&replay, &chip8)) {
+        return 1;
+    }
+    if (opt->save_state_file && !chip8_save_state_file(&chip8, opt->save_state_file)) {
+        return 1;
+    }
+    if (opt->profile_file && !write_profile(&profile, opt->profile_file)) {
+        return 1;
+    }
+
+    FILE *out = stdout;
+    if (opt->out_file) {
+        out = fopen(opt->out_file, "w");
+        if (!out) {
+            printf("Error: Could not open %s for writing\n", opt->out_file);
+            return 1;
+        }
+    }
+    chip8_dump_state(&chip8, out);
+    if (out != stdout) {
+        fclose(out);
+    }
+    chip8_free(&chip8);
+    return 0;
+}
+
+// JIT check - run the ROM on the interpreter and on the JIT side by side and
+// compare the whole machine after every frame. Reports the first frame
+// where they differ, with both states, so a codegen bug can be pinned down.
+int run_jit_diff(const char *rom, Chip8Quirks quirks, long cycles, uint64_t cpu_hz, const char *input_file) {
+    Chip8 reference, jitted;
+    Chip8InputScript script = { NULL, 0 };
+
+    chip8_init(&reference);
+    chip8_set_quirks(&reference, quirks);
+    if (!chip8_load_rom(&reference, rom)) {
+        return 1;
+    }
+    if (input_file && !chip8_load_input_script(&script, input_file)) {
+        return 1;
+    }
+    chip8_fork(&jitted, &reference);
+
+    Chip8Jit *jit = chip8_jit_create();
+    if (!jit) {
+        printf("Error: JIT not available on this host\n");
+        chip8_free_input_script(&script);
+        return 1;
+    }
+
+    Chip8HeadlessRun reference_run, jit_run;
+    chip8_headless_begin(&reference_run, &script, cpu_hz);
+    chip8_headless_begin(&jit_run, &script, cpu_hz);
+    chip8_sched_set_engine(&reference_run.sched, chip8_machine_engine(&reference), NULL);
+    chip8_sched_set_engine(&jit_run.sched, chip8_jit_run, jit);
+
+    int result = 0;
+    long remaining = cycles;
+    while (remaining > 0) {
+        long step = (long)chip8_sched_cycles_to_tick(&reference_run.sched);
+        if (step > remaining) {
+            step = remaining;
+        }
+        chip8_headless_step(&reference, &reference_run, step);
+        chip8_headless_step(&jitted, &jit_run, step);
+        remaining -= step;
+
+        if (chip8_state_hash(&reference) != chip8_state_hash(&jitted)) {
+            printf("Divergence in frame %llu (by cycle %llu)\n",
+                   (unsigned long long)reference_run.sched.timer_ticks,
+                   (unsigned long long)reference_run.sched.cycles);
+            printf("-- interpreter --\n");
+            chip8_dump_state(&reference, stdout);
+            printf("-- jit --\n");
+            chip8_dump_state(&jitted, stdout);
+            result = 1;
+            break;
+        }
+    }
+
+    if (result == 0) {
+        Chip8JitStats stats;
+        chip8_jit_get_stats(jit, &stats);
+        printf("No divergence in %llu cycles (%llu frames)\n",
+               (unsigned long long)reference_run.sched.cycles,
+               (unsigned long long)reference_run.sched.timer_ticks);
+        printf("JIT: %llu blocks compiled, %llu invalidated, %llu flushes, %llu native / %llu interpreted cycles\n",
+               (unsigned long long)stats.blocks_compiled, (unsigned long long)stats.invalidations,
+               (unsigned long long)stats.flushes, (unsigned long long)stats.native_cycles,
+               (unsigned long long)stats.interpreted_cycles);
+    }
+
+    chip8_free(&reference);
+    chip8_free(&jitted);
+    chip8_jit_destroy(jit);
+    chip8_free_input_script(&script);
+    return result;
+}
+
+static void print_usage(const char *prog) {
+#ifdef CHIP8_AOT
+    printf("Usage: %s [options] [ROM file]\n", prog);
+    printf("  (without a ROM file, runs %s, built in)\n", chip8_aot_program.name);
+#else
+    printf("Usage: %s [options] <ROM file>\n", prog);
+#endif
+    printf("  --headless       run without a window at full speed\n");
+    printf("  --variant NAME   chip8, schip or xochip (default: from the ROM's extension, .sc8 / .xo8)\n");
+    printf("  --quirks NAME    CHIP-8 quirk profile: default, vip, chip48, schip or modern\n");
+    printf("                   (default: from the ROM database, else default)\n");
+    printf("  --cycles N       headless: stop after N cycles\n");
+    printf("  --hz N           CPU speed in instructions/second (default %d); timers stay at 60 Hz\n", CHIP8_DEFAULT_CPU_HZ);
+    printf("  --frames N       headless: stop after N frames (60 Hz timer ticks)\n");
+    printf("  --input FILE     headless: keypad script (\"<cycle> <key> <down|up>\" per line)\n");
+    printf("  --out FILE       headless: write final state here instead of stdout\n");
+    printf("  --load-state F   headless: start from save state F (the ROM is still needed)\n");
+    printf("  --save-state F   headless: write a save state to F at the end\n");
+    printf("  --jit            run blocks of instructions as native x86-64 code\n");
+    printf("  --jit-diff       headless: run interpreter and JIT side by side, report the first difference\n");
+    printf("  --record FILE    record the keypad (by cycle), seed and speed to a replay file\n");
+    printf("  --replay FILE    play a replay back instead of reading the keyboard or --input\n");
+    printf("  --profile FILE   write performance counters to FILE as JSON on exit (CHIP8_PROFILE builds)\n");
+    printf("  --audio-buffer N samples per audio callback, a power of two (default %d); smaller is less latency\n",
+           DEFAULT_AUDIO_BUFFER);
+    printf("  --audio-stats    print audio underruns and callback jitter on exit\n");
+}
+
+// Read the command line into `opt`, filling in what it leaves out (the
+// variant from the file name, the quirk profile from the ROM database).
+// Returns 0, having said why, if the program should stop there.
+int parse_options(Options *opt, int argc, char *argv[]) {
+    memset(opt, 0, sizeof(*opt));
+    opt->variant = -1;
+    opt->quirks = -1;
+    opt->cycles = -1;
+    opt->cpu_hz = CHIP8_DEFAULT_CPU_HZ;
+    opt->audio_buffer = DEFAULT_AUDIO_BUFFER;
+    long frames = 60;  // one second by default
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            opt->headless = 1;
+        }
+        else if (strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+            opt->quirks = chip8_quirks_from_name(argv[++i]);
+            if (opt->quirks < 0) {
+                printf("Error: --quirks must be default, vip, chip48, schip or modern\n");
+                return 0;
+            }
+        }
+        else if (strcmp(argv[i], "--variant") == 0 && i + 1 < argc) {
+            opt->variant = chip8_variant_from_name(argv[++i]);
+            if (opt->variant < 0) {
+                printf("Error: --variant must be chip8, schip or xochip\n");
+                return 0;
+            }
+        }
+        else if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+            opt->cycles = atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frames = atol(argv[++i]);
+            opt->cycles = -1;
+        }
+        else if (strcmp(argv[i], "--hz") == 0 && i + 1 < argc) {
+            opt->cpu_hz = strtoull(argv[++i], NULL, 10);
+            if (opt->cpu_hz < CHIP8_TIMER_HZ) {
+                printf("Error: --hz must be at least %d\n", CHIP8_TIMER_HZ);
+                return 0;
+            }
+        }
+        else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            opt->input_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            opt->out_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--load-state") == 0 && i + 1 < argc) {
+            opt->load_state_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--save-state") == 0 && i + 1 < argc) {
+            opt->save_state_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            opt->record_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            opt->replay_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            opt->profile_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--audio-buffer") == 0 && i + 1 < argc) {
+            opt->audio_buffer = atoi(argv[++i]);
+            if (opt->audio_buffer < 64 || opt->audio_buffer > 8192 || (opt->audio_buffer & (opt->audio_buffer - 1))) {
+                printf("Error: --audio-buffer must be a power of two from 64 to 8192\n");
+                return 0;
+            }
+        }
+        else if (strcmp(argv[i], "--audio-stats") == 0) {
+            opt->audio_stats = 1;
+        }
+        else if (strcmp(argv[i], "--jit") == 0) {
+            opt->use_jit = 1;
+        }
+        else if (strcmp(argv[i], "--jit-diff") == 0) {
+            opt->jit_diff = 1;
+        }
+        else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            print_usage(argv[0]);
+            return 0;
+        }
+        else {
+            opt->rom = argv[i];
+        }
+    }
+
+#ifdef CHIP8_AOT
+    if (!opt->rom) {
+        opt->rom = chip8_aot_program.name;
+        if (opt->quirks < 0) {
+            opt->quirks = chip8_aot_program.quirks;
+        }
+    }
+#endif
+    if (!opt->rom) {
+        print_usage(argv[0]);
+        return 0;
+    }
+
+    if (opt->variant < 0) {
+        opt->variant = chip8_variant_for_file(opt->rom);
+    }
+    if (opt->cycles < 0) {
+        opt->cycles = (long)chip8_sched_cycles_for_frames(opt->cpu_hz, frames);
+    }
+    if (opt->replay_file && (opt->input_file || opt->jit_diff)) {
+        printf("Error: --replay can't be used with --input or --jit-diff\n");
+        return 0;
+    }
+    if (opt->profile_file && !chip8_profile_available()) {
+        printf("Note: built without CHIP8_PROFILE, so the profile will be all zeros\n");
+    }
+
+    if (opt->jit_diff && opt->variant != CHIP8_VARIANT_CHIP8) {
+        printf("Error: --jit-diff is for CHIP-8 ROMs; the JIT doesn't run %s\n", chip8_variant_name(opt->variant));
+        return 0;
+    }
+    if (opt->quirks > CHIP8_QUIRKS_DEFAULT && opt->variant != CHIP8_VARIANT_CHIP8) {
+        printf("Error: --quirks is for CHIP-8 ROMs; %s has its own quirks\n", chip8_variant_name(opt->variant));
+        return 0;
+    }
+    if (opt->quirks < 0) {
+        opt->quirks = opt->variant == CHIP8_VARIANT_CHIP8 ? chip8_quirks_for_file(opt->rom) : -1;
+        if (opt->quirks >= 0) {
+            printf("Using the %s quirks for this ROM\n", chip8_quirks_name(opt->quirks));
+        }
+        else {
+            opt->quirks = CHIP8_QUIRKS_DEFAULT;
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,48 @@
+// Frontend internals shared by the SDL frontend (src/frontend_sdl.c) and
+// the headless one (src/headless_main.c), in src/frontend.c: the command
+// line, setting a machine up the way it asks, and the runs that need no
+// window. Not part of libchip8 - each frontend binary builds frontend.c in,
+// so a CHIP8_AOT build (chip8_aot_game in CMakeLists.txt) gets the ROM it
+// carries.
+#ifndef CHIP8_FRONTEND_H
+#define CHIP8_FRONTEND_H
+
+#include "chip8.h"
+
+#define DEFAULT_AUDIO_BUFFER 512  // samples per audio callback: about 11 ms at 48 kHz
+
+// Everything from the command line
+typedef struct {
+    const char *rom;
+    int variant;                    // Chip8Variant (--variant, or from the ROM's file extension)
+    int quirks;                     // Chip8Quirks (--quirks, or from the ROM database)
+    long cycles;                    // headless run length
+    uint64_t cpu_hz;
+    int use_jit;
+    int headless;                   // --headless (the SDL frontend only - chip8-headless always is)
+    int jit_diff;                   // --jit-diff
+    const char *input_file;
+    const char *out_file;
+    const char *load_state_file;
+    const char *save_state_file;
+    const char *record_file;
+    const char *replay_file;
+    const char *profile_file;
+    int audio_buffer;               // samples per audio callback
+    int audio_stats;                // print audio timing counters on exit
+} Options;
+
+int parse_options(Options *opt, int argc, char *argv[]);
+
+int init_machine(Chip8 *chip8, const Options *opt);
+int load_rom(Chip8 *chip8, const Options *opt);
+Chip8Aot *start_aot(Chip8Scheduler *sched, const Chip8 *chip8);
+Chip8Jit *start_engine(Chip8Scheduler *sched, const Chip8 *chip8, Chip8DecodeCache *cache, int use_jit);
+int start_replay(Chip8Replay *replay, const char *replay_file, Chip8 *chip8);
+int finish_replay(const Chip8Replay *replay, const Chip8 *chip8);
+int write_profile(const Chip8Profile *profile, const char *filename);
+
+int run_headless(const Options *opt);
+int run_jit_diff(const char *rom, Chip8Quirks quirks, long cycles, uint64_t cpu_hz, const char *input_file);
+
+#endif
@@ -0,0 +1,705 @@
+// SDL frontend - window, keyboard and the main loop.
+// The emulator itself is in libchip8 (src/chip8.c); the command line and the
+// headless runs are shared with chip8-headless (src/frontend.c).
+#define _POSIX_C_SOURCE 200809L  // clock_gettime, sem_timedwait
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "frontend.h"
+
+#define DISPLAY_WIDTH CHIP8_DISPLAY_WIDTH
+#define DISPLAY_HEIGHT CHIP8_DISPLAY_HEIGHT
+
+#define SCALE 10  // Each CHIP-8 pixel will be 10x10 screen pixels
+#define WINDOW_WIDTH (DISPLAY_WIDTH * SCALE)
+#define WINDOW_HEIGHT (DISPLAY_HEIGHT * SCALE)
+
+//SDL
+typedef struct {
+    SDL_Window *window;
+    SDL_Renderer *renderer;
+    SDL_Texture *texture;           // 64x32, or 128x64 for SUPER-CHIP/XO-CHIP
+    int width, height;              // of the texture
+    uint64_t shown[DISPLAY_HEIGHT]; // display as it is in the texture
+    uint64_t shown_screen[2][CHIP8_HIRES_HEIGHT][CHIP8_HIRES_WORDS];  // the same for a 128x64 screen
+    int texture_blank;              // nothing uploaded yet
+    int needs_present;              // redraw even if the display didn't change (e.g. window exposed)
+    Chip8Profile *profile;          // render counters go here (see CHIP8_PROFILE_ADD), or NULL
+} SDLContext;
+
+int sdl_init(SDLContext *sdl, int width, int height);
+void sdl_cleanup(SDLContext *sdl);
+void chip8_render(const Chip8Frame *frame, SDLContext *sdl);
+
+// `width` x `height` is the machine's display: 64x32, or 128x64
+int sdl_init(SDLContext *sdl, int width, int height) {
+    // Initialize SDL
+    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+    printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
+    return 0; 
+    }
+    // Create window
+    sdl->window = SDL_CreateWindow(
+    "CHIP-8 Emulator",           // Window title
+    SDL_WINDOWPOS_CENTERED,      // X position (centered)
+    SDL_WINDOWPOS_CENTERED,      // Y position (centered)
+    WINDOW_WIDTH,                // Width
+    WINDOW_HEIGHT,               // Height
+    SDL_WINDOW_SHOWN             // Flags
+    );
+
+    if (!sdl->window) {
+        printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
+        SDL_Quit();
+        return 0;
+    }
+    // Create renderer
+    sdl->renderer = SDL_CreateRenderer(
+    sdl->window,                 // The window to render to
+    -1,                          // Driver index (-1 = first available)
+    SDL_RENDERER_ACCELERATED     // Use hardware acceleration
+    );
+    // No GPU (a VM, SDL_VIDEODRIVER=dummy) - drawing 64x32 pixels in software is fine
+    if (!sdl->renderer) {
+        sdl->renderer = SDL_CreateRenderer(sdl->window, -1, SDL_RENDERER_SOFTWARE);
+    }
+
+    if (!sdl->renderer) {
+        printf("Renderer could not be created! SDL_Error: %s\n", SDL_GetError());
+        SDL_DestroyWindow(sdl->window);
+        SDL_Quit();
+        return 0;
+    }
+    // Create texture for the display
+    sdl->texture = SDL_CreateTexture(
+    sdl->renderer,
+    SDL_PIXELFORMAT_RGBA8888,    // Pixel format (32-bit RGBA)
+    SDL_TEXTUREACCESS_STREAMING, // We'll update it every frame
+    width,                       // 64 pixels wide (128 for SUPER-CHIP)
+    height                       // 32 pixels tall (64 for SUPER-CHIP)
+    );
+
+    if (!sdl->texture) {
+        printf("Texture could not be created! SDL_Error: %s\n", SDL_GetError());
+        SDL_DestroyRenderer(sdl->renderer);
+        SDL_DestroyWindow(sdl->window);
+        SDL_Quit();
+        return 0;
+    }
+    sdl->width = width;
+    sdl->height = height;
+    memset(sdl->shown, 0, sizeof(sdl->shown));
+    memset(sdl->shown_screen, 0, sizeof(sdl->shown_screen));
+    sdl->texture_blank = 1;
+    sdl->needs_present = 1;
+    sdl->profile = NULL;
+    return 1;
+}
+
+void sdl_cleanup(SDLContext *sdl) {
+    SDL_DestroyTexture(sdl->texture);
+    SDL_DestroyRenderer(sdl->renderer);
+    SDL_DestroyWindow(sdl->window);
+    SDL_Quit();
+}
+
+// Draw `frame` (NULL = nothing new). Only rows that differ from what's
+// already in the texture get converted and uploaded.
+void chip8_render(const Chip8Frame *frame, SDLContext *sdl) {
+    uint64_t dirty = sdl->texture_blank && frame ? ~0ULL >> (64 - sdl->height) : 0;
+    int plane_count = frame ? frame->plane_count : 0;
+    if (frame && plane_count == 0) {
+        for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+            if (frame->display[y] != sdl->shown[y]) {
+                dirty |= 1ULL << y;
+            }
+        }
+        memcpy(sdl->shown, frame->display, sizeof(sdl->shown));
+        sdl->texture_blank = 0;
+    }
+    else if (frame) {
+        for (int y = 0; y < CHIP8_HIRES_HEIGHT; y++) {
+            for (int p = 0; p < plane_count; p++) {
+                if (memcmp(frame->screen[p][y], sdl->shown_screen[p][y], sizeof(sdl->shown_screen[p][y])) != 0) {
+                    dirty |= 1ULL << y;
+                }
+            }
+        }
+        memcpy(sdl->shown_screen, frame->screen, plane_count * sizeof(frame->screen[0]));
+        sdl->texture_blank = 0;
+    }
+
+    // Nothing drawn or cleared since last time - the texture is still
+    // right, so skip the conversion, the upload and the present
+    if (!dirty && !sdl->needs_present) {
+        return;
+    }
+    CHIP8_PROFILE_ADD(sdl, frames_rendered, 1);
+    sdl->needs_present = 0;
+
+    // Create a pixel buffer (RGBA format - 32 bits per pixel)
+    uint32_t pixels[CHIP8_HIRES_WIDTH * CHIP8_HIRES_HEIGHT];
+    int width = sdl->width;
+    
+    // Convert and upload each run of changed rows on its own
+    int y = 0;
+    while (dirty) {
+        while (!(dirty & 1)) {
+            dirty >>= 1;
+            y++;
+        }
+        int first = y;
+        while (dirty & 1) {
+            dirty >>= 1;
+            y++;
+        }
+        SDL_Rect rows = { 0, first, width, y - first };
+
+        // Convert CHIP-8 display (1 bit per pixel) to RGBA pixels
+        if (width == CHIP8_HIRES_WIDTH) {
+            // C won't add const to a pointer to arrays by itself
+            chip8_screen_to_rgba((const uint64_t (*)[CHIP8_HIRES_HEIGHT][CHIP8_HIRES_WORDS])sdl->shown_screen, 2,
+                                 pixels + first * width, first, rows.h);
+        }
+        else {
+            chip8_rows_to_rgba(sdl->shown, pixels + first * width, first, rows.h);
+        }
+
+        // Update just those rows of the texture
+        SDL_UpdateTexture(sdl->texture, &rows, pixels + first * width, width * sizeof(uint32_t));
+    }
+    
+    // Clear the renderer
+    SDL_RenderClear(sdl->renderer);
+    
+    // Copy texture to renderer (scales it to window size)
+    SDL_RenderCopy(sdl->renderer, sdl->texture, NULL, NULL);
+    
+    // Present the rendered frame
+    SDL_RenderPresent(sdl->renderer);
+}
+
+// Interactive mode - SDL window, keyboard input, 60 FPS
+// The machine runs on its own thread (emulation_main), so a slow present
+// (vsync, a compositor stall) never holds up the CPU or the timers. This
+// thread polls input and draws. Finished frames come over in a
+// Chip8TripleBuffer, and the keypad goes the other way as an atomic bit
+// mask; neither side takes a lock.
+#define FRAME_NS (1000000000ULL / 60)  // nanoseconds per frame
+
+// Rewind keeps one snapshot per frame: 10 seconds' worth
+#define REWIND_FRAMES 600
+
+// Longest sleep while the machine waits for a key with its timers stopped
+#define IDLE_WAIT_MS 1000
+
+// Requests from the window to the emulation thread
+#define REQUEST_SAVE 1
+#define REQUEST_LOAD 2
+#define REQUEST_QUIT 4
+
+// Everything the emulation thread owns, plus the few atomics it shares
+// with the window
+typedef struct {
+    const Options *opt;
+    Chip8 chip8;
+    Chip8HeadlessRun run;
+    Chip8Replay replay;
+    Chip8Recorder recorder;
+    Chip8DecodeCache cache;
+    Chip8Jit *jit;
+    Chip8Aot *aot;
+    Chip8Rewind rewind;
+    char state_file[4096];          // F5 saves here, F9 loads it back
+
+    // Shared with the window
+    Chip8TripleBuffer *frames;
+    _Atomic uint16_t keys;          // keypad, bit N = key N held
+    atomic_int requests;            // REQUEST_* bits not handled yet
+    atomic_int rewinding;           // Backspace is held
+    atomic_int frame_pending;       // a frame event is on its way to the window
+    Uint32 frame_event;             // SDL event type for "a new frame is ready"
+    sem_t wake;                     // posted to wake the thread before its time
+    atomic_int sound_on;            // sound timer running, for the audio callback
+} Emulation;
+
+// Audio - a square wave while the sound timer runs. The emulation thread
+// sets `sound_on` after every step, and the callback (on SDL's audio
+// thread) reads it. That one atomic is all they share.
+#define AUDIO_RATE 48000
+#define AUDIO_AMPLITUDE 3000
+
+typedef struct {
+    SDL_AudioDeviceID device;       // 0 = no audio
+    Chip8Tone tone;
+    const atomic_int *sound_on;
+    uint64_t period_ns;             // how long one buffer plays for
+
+    // Written only by the callback, and read once the device is closed
+    uint64_t callbacks;
+    uint64_t underruns;             // callbacks a whole buffer late - the device ran dry
+    uint64_t last_callback_ns;
+    uint64_t jitter_total_ns;       // how far each callback was from one period after the last
+    uint64_t jitter_max_ns;
+} Audio;
+
+static void audio_callback(void *userdata, Uint8 *stream, int len) {
+    Audio *audio = userdata;
+    uint64_t now = chip8_time_ns();
+    if (audio->callbacks > 0) {
+        uint64_t interval = now - audio->last_callback_ns;
+        uint64_t jitter = interval > audio->period_ns ? interval - audio->period_ns : audio->period_ns - interval;
+        audio->jitter_total_ns += jitter;
+        if (jitter > audio->jitter_max_ns) {
+            audio->jitter_max_ns = jitter;
+        }
+        if (interval > 2 * audio->period_ns) {
+            audio->underruns++;
+        }
+    }
+    audio->last_callback_ns = now;
+    audio->callbacks++;
+
+    int on = atomic_load_explicit(audio->sound_on, memory_order_relaxed);
+    chip8_tone_fill(&audio->tone, (int16_t *)stream, len / (int)sizeof(int16_t), on);
+}
+
+// Open the default audio device with `buffer_samples` per callback. A
+// smaller buffer means less latency but more risk of underruns. Without
+// audio we say so and carry on silently.
+static int audio_open(Audio *audio, const atomic_int *sound_on, int buffer_samples) {
+    memset(audio, 0, sizeof(*audio));
+    audio->sound_on = sound_on;
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0) {
+        printf("No audio: %s\n", SDL_GetError());
+        return 0;
+    }
+
+    SDL_AudioSpec want, have;
+    memset(&want, 0, sizeof(want));
+    want.freq = AUDIO_RATE;
+    want.format = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples = (Uint16)buffer_samples;
+    want.callback = audio_callback;
+    want.userdata = audio;
+    // No changes allowed: SDL converts to whatever the device really does
+    audio->device = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
+    if (!audio->device) {
+        printf("No audio: %s\n", SDL_GetError());
+        return 0;
+    }
+    chip8_tone_init(&audio->tone, have.freq, CHIP8_TONE_HZ, AUDIO_AMPLITUDE);
+    audio->period_ns = (uint64_t)have.samples * 1000000000ULL / have.freq;
+    SDL_PauseAudioDevice(audio->device, 0);
+    return 1;
+}
+
+// Stop the callback (after this the counters are ours) and report them
+static void audio_close(Audio *audio, int print_stats) {
+    if (!audio->device) {
+        return;
+    }
+    SDL_CloseAudioDevice(audio->device);
+    audio->device = 0;
+    if (print_stats) {
+        uint64_t intervals = audio->callbacks > 1 ? audio->callbacks - 1 : 1;
+        printf("Audio: %llu callbacks, %.1f ms per buffer, %llu underruns, jitter %.2f ms mean, %.2f ms max\n",
+               (unsigned long long)audio->callbacks, audio->period_ns / 1e6, (unsigned long long)audio->underruns,
+               audio->jitter_total_ns / 1e6 / intervals, audio->jitter_max_ns / 1e6);
+    }
+}
+
+// How long `chip8` can be left alone, or 0 if it's busy. While it waits
+// the display can't change, so there is nothing to draw until a key comes
+// or the timer loop ends. Running timers cap the sleep at what the
+// scheduler will catch up on, so they still count down in real time.
+static uint64_t idle_time_ns(const Chip8 *chip8, const Chip8Scheduler *sched) {
+    Chip8Idle idle;
+    if (chip8->sound_timer > 0 || chip8_idle_check(chip8, &idle) == CHIP8_IDLE_NONE) {
+        return 0;  // busy, or beeping - the beep has to stop on time
+    }
+    long frames = chip8_idle_frames(chip8, &idle);
+    if (frames < 0 && chip8->delay_timer == 0) {
+        return IDLE_WAIT_MS * 1000000ULL;
+    }
+    uint64_t ns = frames < 0 ? sched->max_catchup_ns : (uint64_t)frames * 1000000000ULL / CHIP8_TIMER_HZ;
+    return ns < sched->max_catchup_ns ? ns : sched->max_catchup_ns;
+}
+
+// Sleep until chip8_time_ns() reaches `deadline`, or until someone posts
+// `wake`. sem_timedwait wants a wall-clock time, so convert.
+static void sleep_until(sem_t *wake, uint64_t deadline) {
+    uint64_t now = chip8_time_ns();
+    if (deadline <= now) {
+        return;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t ns = ts.tv_nsec + (deadline - now);
+    ts.tv_sec += ns / 1000000000ULL;
+    ts.tv_nsec = ns % 1000000000ULL;
+    sem_timedwait(wake, &ts);
+}
+
+// Give the window the display as it is now, and wake it up to draw it
+static void publish_frame(Emulation *emu) {
+    Chip8Frame *frame = chip8_triple_back(emu->frames);
+    const Chip8Ext *ext = emu->chip8.ext;
+    frame->plane_count = ext ? ext->plane_count : 0;
+    if (ext) {
+        memcpy(frame->screen, ext->screen, ext->plane_count * sizeof(ext->screen[0]));
+    }
+    else {
+        memcpy(frame->display, emu->chip8.display, sizeof(frame->display));
+    }
+    frame->cycle = emu->run.sched.cycles;
+    chip8_triple_publish(emu->frames);
+    emu->chip8.dirty_rows = 0;
+
+    // One event at a time is enough: the window always takes the newest
+    if (!atomic_exchange(&emu->frame_pending, 1)) {
+        SDL_Event event;
+        memset(&event, 0, sizeof(event));
+        event.type = emu->frame_event;
+        SDL_PushEvent(&event);
+    }
+}
+
+// The emulation thread: run the CPU cycles that are due, hand over a frame
+// when the display changed, sleep until the next frame (or longer, if the
+// machine is only waiting), repeat. Keys and requests wake it early.
+static void *emulation_main(void *arg) {
+    Emulation *emu = arg;
+    const Options *opt = emu->opt;
+    Chip8 *chip8 = &emu->chip8;
+    Chip8Scheduler *sched = &emu->run.sched;
+    int deterministic = opt->record_file || opt->replay_file;
+    int replay_done = 0;
+    int memory_replaced = 0;
+    uint64_t last_time = chip8_time_ns();
+    uint64_t next_frame = last_time;
+
+    for (;;) {
+        int requests = atomic_exchange(&emu->requests, 0);
+        if (requests & REQUEST_QUIT) {
+            break;
+        }
+        if ((requests & REQUEST_SAVE) && chip8_save_state_file(chip8, emu->state_file)) {
+            printf("Saved state to %s\n", emu->state_file);
+        }
+        if ((requests & REQUEST_LOAD) && !deterministic && chip8_load_state_file(chip8, emu->state_file)) {
+            printf("Loaded state from %s\n", emu->state_file);
+            memory_replaced = 1;
+        }
+
+        uint64_t now = chip8_time_ns();
+        int frame_due = now >= next_frame;
+        int rewinding = atomic_load(&emu->rewinding) && !deterministic;
+
+        // Rewinding - step back one frame each frame instead of running
+        if (rewinding) {
+            if (frame_due && chip8_rewind_pop(&emu->rewind, chip8)) {
+                memory_replaced = 1;
+            }
+        }
+        else if (frame_due) {
+            chip8_rewind_push(&emu->rewind, chip8);
+        }
+
+        // Memory came from somewhere else, so cached code may be stale
+        if (memory_replaced) {
+            chip8_decode_cache_clear(&emu->cache);
+            if (emu->jit) {
+                chip8_jit_invalidate_all(emu->jit);
+            }
+            if (emu->aot) {
+                chip8_aot_invalidate_all(emu->aot);
+            }
+            memory_replaced = 0;
+        }
+
+        // Run the CPU cycles (and timer ticks) that are due since last time.
+        // If we fell behind, this runs extra cycles to catch up. While a
+        // replay plays its own keys, the keyboard doesn't reach the machine.
+        if (!rewinding) {
+            if (!opt->replay_file) {
+                uint16_t keys = atomic_load(&emu->keys);
+                for (int key = 0; key < 16; key++) {
+                    chip8->keypad[key] = (keys >> key) & 1;
+                }
+            }
+            uint64_t due = chip8_sched_cycles_due(sched, now - last_time);
+            if (opt->replay_file && sched->cycles + due > emu->replay.cycles) {
+                due = emu->replay.cycles - sched->cycles;
+            }
+            chip8_headless_step(chip8, &emu->run, (long)due);
+            CHIP8_PROFILE_ADD(chip8, emulate_ns, CHIP8_PROFILE_CLOCK() - now);
+            if (opt->replay_file && !replay_done && sched->cycles == emu->replay.cycles) {
+                finish_replay(&emu->replay, chip8);
+                replay_done = 1;
+            }
+        }
+        last_time = now;
+        atomic_store_explicit(&emu->sound_on, chip8->sound_timer > 0, memory_order_relaxed);
+
+        if (chip8->dirty_rows) {
+            publish_frame(emu);
+        }
+        else if (frame_due) {
+            CHIP8_PROFILE_ADD(chip8, frames_skipped, 1);
+        }
+
+        if (frame_due) {
+            // If running late, start counting frames again from now
+            next_frame = now - next_frame < FRAME_NS ? next_frame + FRAME_NS : now + FRAME_NS;
+        }
+
+        // Sleep until the next frame. If the machine is only waiting, sleep
+        // until it can do something instead. Not while a replay plays: its
+        // keys don't wake us.
+        uint64_t wake_at = next_frame;
+        uint64_t idle_ns = rewinding || opt->replay_file ? 0 : idle_time_ns(chip8, sched);
+        if (idle_ns > FRAME_NS) {
+            wake_at = now + idle_ns;
+        }
+        uint64_t sleep_start = CHIP8_PROFILE_CLOCK();
+        sleep_until(&emu->wake, wake_at);
+        CHIP8_PROFILE_ADD(chip8, delay_ns, CHIP8_PROFILE_CLOCK() - sleep_start);
+    }
+    return NULL;
+}
+
+// The keypad key for a keyboard key, or -1
+static int keypad_key(int sym) {
+    switch (sym) {
+        case SDLK_1: return 0x1;
+        case SDLK_2: return 0x2;
+        case SDLK_3: return 0x3;
+        case SDLK_4: return 0xC;
+
+        case SDLK_q: return 0x4;
+        case SDLK_w: return 0x5;
+        case SDLK_e: return 0x6;
+        case SDLK_r: return 0xD;
+
+        case SDLK_a: return 0x7;
+        case SDLK_s: return 0x8;
+        case SDLK_d: return 0x9;
+        case SDLK_f: return 0xE;
+
+        case SDLK_z: return 0xA;
+        case SDLK_x: return 0x0;
+        case SDLK_c: return 0xB;
+        case SDLK_v: return 0xF;
+
+        default: return -1;
+    }
+}
+
+// Set up the machine and everything around it, before the thread starts
+static int start_emulation(Emulation *emu, const Options *opt, Chip8Profile *profile) {
+    uint64_t cpu_hz = opt->cpu_hz;
+    emu->opt = opt;
+    if (!init_machine(&emu->chip8, opt)) {
+        chip8_free(&emu->chip8);
+        return 0;
+    }
+    if (opt->profile_file) {
+        emu->chip8.profile = profile;
+    }
+    if (!load_rom(&emu->chip8, opt)) {
+        chip8_free(&emu->chip8);
+        return 0;
+    }
+    if (opt->replay_file) {
+        if (!start_replay(&emu->replay, opt->replay_file, &emu->chip8)) {
+            chip8_free(&emu->chip8);
+            return 0;
+        }
+        cpu_hz = emu->replay.cpu_hz;
+    }
+    if (opt->record_file && !chip8_record_begin(&emu->recorder, opt->record_file, &emu->chip8, cpu_hz)) {
+        chip8_free(&emu->chip8);
+        return 0;
+    }
+
+    // Cycles run through a headless run so that replayed key events land
+    // on their exact cycle, and recorded ones get stamped with it
+    chip8_headless_begin(&emu->run, opt->replay_file ? &emu->replay.script : NULL, cpu_hz);
+    if (opt->record_file) {
+        emu->run.recorder = &emu->recorder;
+    }
+    emu->aot = start_aot(&emu->run.sched, &emu->chip8);
+    emu->jit = emu->aot ? NULL : start_engine(&emu->run.sched, &emu->chip8, &emu->cache, opt->use_jit);
+
+    snprintf(emu->state_file, sizeof(emu->state_file), "%s.state", opt->rom);
+    emu->frame_event = SDL_RegisterEvents(1);
+    if (emu->frame_event == (Uint32)-1) {
+        printf("Error: Out of SDL event types\n");
+        chip8_jit_destroy(emu->jit);
+        chip8_aot_destroy(emu->aot);
+        chip8_free(&emu->chip8);
+        return 0;
+    }
+    emu->frames = chip8_triple_create();
+    if (!emu->frames || !chip8_rewind_init(&emu->rewind, REWIND_FRAMES)) {
+        chip8_triple_destroy(emu->frames);
+        chip8_jit_destroy(emu->jit);
+        chip8_aot_destroy(emu->aot);
+        chip8_free(&emu->chip8);
+        return 0;
+    }
+    atomic_init(&emu->keys, 0);
+    atomic_init(&emu->requests, 0);
+    atomic_init(&emu->rewinding, 0);
+    atomic_init(&emu->frame_pending, 0);
+    atomic_init(&emu->sound_on, 0);
+    sem_init(&emu->wake, 0, 0);
+    return 1;
+}
+
+// Ask the emulation thread for something and wake it to do it
+static void request(Emulation *emu, int what) {
+    atomic_fetch_or(&emu->requests, what);
+    sem_post(&emu->wake);
+}
+
+static int run_sdl(const Options *opt) {
+    static Emulation emu;
+    static Chip8Profile profile;
+    SDLContext sdl;
+
+    int hires = opt->variant != CHIP8_VARIANT_CHIP8;
+    if (!sdl_init(&sdl, hires ? CHIP8_HIRES_WIDTH : DISPLAY_WIDTH, hires ? CHIP8_HIRES_HEIGHT : DISPLAY_HEIGHT)) {
+        return 1;
+    }
+    if (opt->profile_file) {
+        sdl.profile = &profile;
+    }
+    if (!start_emulation(&emu, opt, &profile)) {
+        sdl_cleanup(&sdl);
+        return 1;
+    }
+    static Audio audio;
+    audio_open(&audio, &emu.sound_on, opt->audio_buffer);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, emulation_main, &emu) != 0) {
+        printf("Error: Could not start the emulation thread\n");
+        audio_close(&audio, 0);
+        chip8_rewind_free(&emu.rewind);
+        chip8_triple_destroy(emu.frames);
+        chip8_jit_destroy(emu.jit);
+        chip8_aot_destroy(emu.aot);
+        chip8_free(&emu.chip8);
+        sdl_cleanup(&sdl);
+        return 1;
+    }
+
+    // While recording or replaying, loading a state and rewinding are off:
+    // the replay has to be one unbroken run
+    int deterministic = opt->record_file || opt->replay_file;
+    int quit = 0;
+    SDL_Event event;
+
+    // Sleep until something happens: a key, the window, or a new frame
+    while (!quit && SDL_WaitEvent(&event)) {
+        do {
+            if (event.type == SDL_QUIT) {
+                quit = 1;
+            }
+            else if (event.type == emu.frame_event) {
+                atomic_store(&emu.frame_pending, 0);
+                uint64_t render_start = CHIP8_PROFILE_CLOCK();
+                chip8_render(chip8_triple_take(emu.frames), &sdl);
+                CHIP8_PROFILE_ADD(&sdl, render_ns, CHIP8_PROFILE_CLOCK() - render_start);
+            }
+            else if (event.type == SDL_WINDOWEVENT) {
+                // The window was uncovered or resized - present again
+                sdl.needs_present = 1;
+                chip8_render(NULL, &sdl);
+            }
+            else if (event.type == SDL_KEYDOWN) {
+                int key = keypad_key(event.key.keysym.sym);
+                if (key >= 0) {
+                    atomic_fetch_or(&emu.keys, 1 << key);
+                    sem_post(&emu.wake);
+                }
+                switch (event.key.keysym.sym) {
+                    case SDLK_ESCAPE: quit = 1; break;
+
+                    // F5 saves to <rom>.state, F9 loads it back; holding
+                    // Backspace rewinds
+                    case SDLK_F5: request(&emu, REQUEST_SAVE); break;
+                    case SDLK_F9:
+                        if (deterministic) {
+                            printf("Loading a state is off while recording or replaying\n");
+                        }
+                        else {
+                            request(&emu, REQUEST_LOAD);
+                        }
+                        break;
+                    case SDLK_BACKSPACE:
+                        atomic_store(&emu.rewinding, 1);
+                        sem_post(&emu.wake);
+                        break;
+                }
+            }
+            else if (event.type == SDL_KEYUP) {
+                int key = keypad_key(event.key.keysym.sym);
+                if (key >= 0) {
+                    atomic_fetch_and(&emu.keys, ~(1 << key));
+                    sem_post(&emu.wake);
+                }
+                if (event.key.keysym.sym == SDLK_BACKSPACE) {
+                    atomic_store(&emu.rewinding, 0);
+                }
+            }
+        } while (!quit && SDL_PollEvent(&event));
+    }
+
+    request(&emu, REQUEST_QUIT);
+    pthread_join(thread, NULL);
+    audio_close(&audio, opt->audio_stats);
+
+    Chip8 *chip8 = &emu.chip8;
+    if (opt->record_file && chip8_record_end(&emu.recorder, chip8, emu.run.sched.cycles)) {
+        printf("Recorded %llu cycles and %ld keypad changes to %s\n", (unsigned long long)emu.run.sched.cycles,
+               emu.recorder.records, opt->record_file);
+    }
+    if (opt->replay_file) {
+        chip8_free_replay(&emu.replay);
+    }
+    if (opt->profile_file) {
+        write_profile(&profile, opt->profile_file);
+    }
+    sem_destroy(&emu.wake);
+    chip8_rewind_free(&emu.rewind);
+    chip8_triple_destroy(emu.frames);
+    chip8_free(chip8);
+    chip8_jit_destroy(emu.jit);
+    chip8_aot_destroy(emu.aot);
+    sdl_cleanup(&sdl);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    if (!parse_options(&opt, argc, argv)) {
+        return 1;
+    }
+    if (opt.jit_diff) {
+        return run_jit_diff(opt.rom, (Chip8Quirks)opt.quirks, opt.cycles, opt.cpu_hz, opt.input_file);
+    }
+    if (opt.headless) {
+        return run_headless(&opt);
+    }
+    return run_sdl(&opt);
+}
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "chip8.h"
+
+// Headless mode
+// Runs the CPU flat out with no window, no frame cap and keypad input
+// taken from a script file. Meant for build servers and regression runs.
+
+// Load a keypad script. One event per line: "<cycle> <key 0-F> <down|up>".
+// Blank lines and lines starting with # are ignored.
+int chip8_load_input_script(Chip8InputScript *script, const char *filename) {
+    script->events = NULL;
+    script->count = 0;
+
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        printf("Error: Could not open input script %s\n", filename);
+        return 0;
+    }
+
+    int capacity = 0;
+    int line_number = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        line_number++;
+        char *p = line;
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') {
+            continue;
+        }
+
+        long cycle;
+        unsigned key;
+        char state[16];
+        if (sscanf(p, "%ld %x %15s", &cycle, &key, state) != 3 || cycle < 0 || key > 0xF ||
+            (strcmp(state, "down") != 0 && strcmp(state, "up") != 0)) {
+            printf("Error: %s:%d: expected \"<cycle> <key> <down|up>\"\n", filename, line_number);
+            fclose(file);
+            chip8_free_input_script(script);
+            return 0;
+        }
+
+        if (script->count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            Chip8InputEvent *grown = realloc(script->events, capacity * sizeof(Chip8InputEvent));
+            if (!grown) {
+                printf("Error: Out of memory reading %s\n", filename);
+                fclose(file);
+                chip8_free_input_script(script);
+                return 0;
+            }
+            script->events = grown;
+        }
+        // Keep the list sorted by cycle. Scripts are normally written in
+        // order, so this almost never has to move anything.
+        int pos = script->count;
+        while (pos > 0 && script->events[pos - 1].cycle > cycle) {
+            script->events[pos] = script->events[pos - 1];
+            pos--;
+        }
+        script->events[pos].cycle = cycle;
+        script->events[pos].key = key;
+        script->events[pos].pressed = (strcmp(state, "down") == 0);
+        script->count++;
+    }
+    fclose(file);
+    return 1;
+}
+
+void chip8_free_input_script(Chip8InputScript *script) {
+    free(script->events);
+    script->events = NULL;
+    script->count = 0;
+}
+
+// Start a headless run at `cpu_hz` instructions per second (0 = default).
+// `script` can be NULL.
+void chip8_headless_begin(Chip8HeadlessRun *run, const Chip8InputScript *script, uint64_t cpu_hz) {
+    run->script = script;
+    run->next_event = 0;
+    run->recorder = NULL;
+    chip8_sched_init(&run->sched, cpu_hz ? cpu_hz : CHIP8_DEFAULT_CPU_HZ);
+}
+
+// Run `cycles` more CPU cycles with no frame cap, feeding in scripted key
+// events as their cycle comes up. Can be called repeatedly (e.g. once per
+// frame); event cycles count from chip8_headless_begin.
+long chip8_headless_step(Chip8 *chip8, Chip8HeadlessRun *run, long cycles) {
+    const Chip8InputScript *script = run->script;
+    int event_count = script ? script->count : 0;
+    uint64_t end = run->sched.cycles + cycles;
+
+    while (run->sched.cycles < end) {
+        // Apply every key event due before this cycle
+        while (run->next_event < event_count &&
+               (uint64_t)script->events[run->next_event].cycle <= run->sched.cycles) {
+            chip8->keypad[script->events[run->next_event].key] = script->events[run->next_event].pressed;
+            run->next_event++;
+        }
+        if (run->recorder) {
+            chip8_record_keys(run->recorder, chip8, run->sched.cycles);
+        }
+
+        // Then run straight up to the next event (or the end)
+        uint64_t stop = end;
+        if (run->next_event < event_count && (uint64_t)script->events[run->next_event].cycle < stop) {
+            stop = script->events[run->next_event].cycle;
+        }
+        chip8_sched_run_cycles(&run->sched, chip8, stop - run->sched.cycles);
+    }
+    return cycles;
+}
+
+// Run `cycles` CPU cycles in one go. Returns the number of cycles run.
+long chip8_run_headless(Chip8 *chip8, const Chip8InputScript *script, long cycles, uint64_t cpu_hz) {
+    Chip8HeadlessRun run;
+    chip8_headless_begin(&run, script, cpu_hz);
+    return chip8_headless_step(chip8, &run, cycles);
+}
+
+// The 128x64 screen of a SUPER-CHIP or XO-CHIP machine, with its mode
+// and flag registers. A pixel in the first plane is '#', in the second
+// '+', in both '*'.
+static void dump_screen(const Chip8 *chip8, FILE *out) {
+    const Chip8Ext *ext = chip8->ext;
+    fprintf(out, "%s %s planes=%X flags=", chip8_variant_name(chip8->variant), ext->hires ? "128x64" : "64x32",
+            ext->plane_mask);
+    for (int i = 0; i < 16; i++) {
+        fprintf(out, "%02X", ext->flags[i]);
+    }
+    fprintf(out, "\n");
+
+    for (int y = 0; y < CHIP8_HIRES_HEIGHT; y++) {
+        for (int x = 0; x < CHIP8_HIRES_WIDTH; x++) {
+            int colour = 0;
+            for (int p = 0; p < ext->plane_count; p++) {
+                colour |= (ext->screen[p][y][x / 64] >> (63 - x % 64) & 1) << p;
+            }
+            fputc(".#+*"[colour], out);
+        }
+        fputc('\n', out);
+    }
+}
+
+// Write the registers and the display as text
+void chip8_dump_state(Chip8 *chip8, FILE *out) {
+    fprintf(out, "pc=0x%03X I=0x%03X sp=%d delay=%d sound=%d\n",
+            chip8->pc, chip8->I, chip8->sp, chip8->delay_timer, chip8->sound_timer);
+    for (int i = 0; i < 16; i++) {
+        fprintf(out, "V%X=%02X%c", i, chip8->V[i], i == 15 ? '\n' : ' ');
+    }
+    fprintf(out, "stack=");
+    for (int i = 0; i < chip8->sp && i < 16; i++) {
+        fprintf(out, "%s0x%03X", i ? "," : "", chip8->stack[i]);
+    }
+    fprintf(out, "\n");
+
+    if (chip8->ext) {
+        dump_screen(chip8, out);
+        return;
+    }
+    for (int y = 0; y < CHIP8_DISPLAY_HEIGHT; y++) {
+        for (int x = 0; x < CHIP8_DISPLAY_WIDTH; x++) {
+            fputc(chip8_get_pixel(chip8, x, y) ? '#' : '.', out);
+        }
+        fputc('\n', out);
+    }
+}
@@ -0,0 +1,15 @@
+// chip8-headless - runs a ROM without a window (CI, scripted input, save
+// states, --jit-diff) and doesn't need SDL. Takes the same options as the
+// SDL frontend; the work is in src/frontend.c.
+#include "frontend.h"
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    if (!parse_options(&opt, argc, argv)) {
+        return 1;
+    }
+    if (opt.jit_diff) {
+        return run_jit_diff(opt.rom, (Chip8Quirks)opt.quirks, opt.cycles, opt.cpu_hz, opt.input_file);
+    }
+    return run_headless(&opt);
+}
@@ -0,0 +1,104 @@
+// Idle detection
+// A lot of CHIP-8 time is spent waiting. FX0A waits for a key by running
+// itself over and over, and games wait on the delay timer with a loop like
+//
+//   L:   FX07      VX = delay timer
+//        3XNN      skip the jump once it reads NN
+//        1L        go round again
+//
+// Neither changes anything a later instruction could see, except VX being
+// reloaded each time round, so the scheduler can skip the cycles instead
+// of running them (exactly - the machine ends up the same either way), and
+// the frontend can sleep until a key comes or the timer gets there.
+#include <stdint.h>
+
+#include "chip8.h"
+
+static uint16_t opcode_at(const Chip8 *chip8, uint16_t addr) {
+    return chip8_mem_read(chip8, addr) << 8 | chip8_mem_read(chip8, addr + 1);
+}
+
+// Is there a delay timer loop (above) starting at `head`?
+static int timer_loop_at(const Chip8 *chip8, uint16_t head, Chip8Idle *idle) {
+    uint16_t load = opcode_at(chip8, head);
+    if ((load & 0xF0FF) != 0xF007) {
+        return 0;
+    }
+    uint16_t x = load & 0x0F00;
+    uint16_t skip = opcode_at(chip8, head + 2);
+    if ((skip & 0xFF00) != (0x3000 | x) || opcode_at(chip8, head + 4) != (0x1000 | head)) {
+        return 0;
+    }
+    idle->kind = CHIP8_IDLE_TIMER;
+    idle->head = head;
+    idle->x = x >> 8;
+    idle->until_delay = skip & 0xFF;
+    return 1;
+}
+
+// Work out whether `chip8` is waiting on something. Fills in `idle` and
+// returns its kind (CHIP8_IDLE_NONE if the machine is doing real work).
+// A timer loop is found from any of its three instructions; `head` says
+// where it starts.
+Chip8IdleKind chip8_idle_check(const Chip8 *chip8, Chip8Idle *idle) {
+    uint16_t pc = chip8->pc;
+    idle->kind = CHIP8_IDLE_NONE;
+    idle->head = pc;
+
+    // The loops are read with chip8_mem_read, which only sees the first
+    // 4KB. XO-CHIP code past that just never counts as idle.
+    if (pc >= CHIP8_MEMORY_SIZE - 8 && chip8->ext && chip8->ext->high_page_count) {
+        return CHIP8_IDLE_NONE;
+    }
+
+    // This runs between every pair of timer ticks, so most code should be
+    // turned away on the first byte: only FX0A and the three instructions
+    // of the loops can start a wait
+    uint16_t back;
+    switch (chip8_mem_read(chip8, pc) >> 4) {
+        case 0xF: back = 0; break;
+        case 0x3: back = 2; break;
+        case 0x1: back = 4; break;
+        default: return CHIP8_IDLE_NONE;
+    }
+
+    uint16_t opcode = opcode_at(chip8, pc);
+    if ((opcode & 0xF0FF) == 0xF00A) {
+        for (int key = 0; key < 16; key++) {
+            if (chip8->keypad[key]) {
+                return CHIP8_IDLE_NONE;
+            }
+        }
+        idle->kind = CHIP8_IDLE_KEY;
+        idle->x = (opcode >> 8) & 0xF;
+        return idle->kind;
+    }
+    if (opcode == (0x1000 | pc)) {
+        idle->kind = CHIP8_IDLE_HALT;
+        return idle->kind;
+    }
+
+    // Only a loop that won't leave on this pass counts: the timer only
+    // changes between frames
+    if (timer_loop_at(chip8, (uint16_t)(pc - back), idle) && chip8->delay_timer == idle->until_delay) {
+        idle->kind = CHIP8_IDLE_NONE;
+    }
+    return idle->kind;
+}
+
+// Frames (timer ticks) until `idle` can end by itself, or -1 if it won't
+// (it's waiting for a key, or for good). 0 means not idle.
+long chip8_idle_frames(const Chip8 *chip8, const Chip8Idle *idle) {
+    switch (idle->kind) {
+        case CHIP8_IDLE_TIMER:
+            if (chip8->delay_timer > idle->until_delay) {
+                return chip8->delay_timer - idle->until_delay;
+            }
+            return -1;  // counting down past it, so never
+        case CHIP8_IDLE_KEY:
+        case CHIP8_IDLE_HALT:
+            return -1;
+        default:
+            return 0;
+    }
+}
@@ -0,0 +1,959 @@
+// Basic-block recompiler to x86-64
+//
+// Runs of instructions are translated to native code, ending at a jump,
+// call, return or BNNN, or at FX33/FX55, whose writes can land on code.
+// Every instruction is compiled, drawing, clearing, CXNN, FX0A and FX65
+// included. FX33 and FX55 call out to store their bytes: memory lives in
+// copy-on-write pages (see memory.c), so only chip8_mem_write writes it.
+//
+// A skip (3XNN, 4XNN, 5XY0, 9XY0, EX9E, EXA1) doesn't end the block. The
+// instruction it skips is compiled behind a branch and the block carries on
+// after it, so a ROM polling a row of keys or a timer runs as one block.
+//
+// Blocks chain into each other without coming back to C: each one leaves
+// through the table of compiled entry points, and a jump back to the start
+// of the block goes straight there. Every few instructions a block checks
+// that the budget covers the next stretch of it (or returns if it
+// doesn't), and it takes what it actually ran out of the budget as it
+// leaves. A tight loop, like a ROM polling the delay timer, stays in
+// native code until the budget runs out. The timers only tick and the keypad only changes between
+// two chip8_jit_run calls, never inside one, so a block that reads them
+// gives exactly the same result as interpreting it.
+//
+// Compiled blocks are cached by start address. When FX33 or FX55 write
+// into memory, every block covering the written bytes is dropped and gets
+// recompiled the next time it runs.
+//
+// The quirk profile is read when a block is compiled (Chip8QuirkFlags), so
+// the code follows the machine's profile with no checks at run time. Blocks
+// are built for one profile, and are all dropped if the machine turns up
+// with another.
+//
+// Only built on x86-64 Linux/BSD. Everywhere else chip8_jit_create returns
+// NULL and callers stay on the interpreter.
+#define _DEFAULT_SOURCE  // MAP_ANONYMOUS
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "chip8.h"
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__))
+#define CHIP8_JIT_X64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define MAX_BLOCK_INSTRUCTIONS 64
+#define MAX_BLOCK_BYTES (MAX_BLOCK_INSTRUCTIONS * 2)
+#define CODE_BUFFER_SIZE (1 << 20)  // 1 MB of generated code before a full flush
+#define MAX_INSTRUCTION_CODE 256    // more than the longest native sequence for one instruction
+#define MAX_BLOCK_CODE ((MAX_BLOCK_INSTRUCTIONS + 1) * MAX_INSTRUCTION_CODE)  // + entry and last exit
+#define BUDGET_CHECK_INTERVAL 4     // instructions between budget checks in a block
+
+// Runs the block and whatever it chains into while `budget` lasts, and
+// returns what's left of it
+typedef uint64_t (*BlockFn)(Chip8 *chip8, uint64_t budget);
+
+typedef struct {
+    BlockFn fn;                     // NULL: interpret the instruction at this address
+    uint16_t length;                // CHIP-8 instructions in the block
+    uint16_t end;                   // one past the last byte the block was built from
+} Block;
+
+struct Chip8Jit {
+    Block *blocks[4096];            // by start address, NULL = not compiled yet
+    void *entries[4096];            // native entry by start address, what generated code jumps through
+    Block *block_pool;
+    int blocks_used;
+    uint8_t *code;
+    size_t code_used;
+    size_t page_size;
+    uint8_t quirks;                 // Chip8Quirks the blocks were compiled for
+    Chip8JitStats stats;
+};
+
+#ifdef CHIP8_JIT_X64
+
+#define POOL_SIZE 8192
+
+// Code emitter
+
+typedef struct {
+    uint8_t *p;
+    Chip8Jit *jit;
+    const Chip8QuirkFlags *quirks;
+    uint8_t *entry;                 // the block being compiled: its entry point
+    uint16_t start;                 // and address
+    int count;                      // instructions run to get here along the block's main path
+} Emitter;
+
+static void emit8(Emitter *e, uint8_t b) {
+    *e->p++ = b;
+}
+
+static void emit16(Emitter *e, uint16_t v) {
+    memcpy(e->p, &v, 2);
+    e->p += 2;
+}
+
+static void emit32(Emitter *e, uint32_t v) {
+    memcpy(e->p, &v, 4);
+    e->p += 4;
+}
+
+static void emit64(Emitter *e, uint64_t v) {
+    memcpy(e->p, &v, 8);
+    e->p += 8;
+}
+
+// rdi holds the Chip8 pointer and rsi the cycle budget the whole time; all
+// state is addressed as [rdi + disp32]. eax, ecx, edx and r8-r11 are
+// scratch.
+#define OFF_V(x) ((uint32_t)(offsetof(Chip8, V) + (x)))
+#define OFF_I ((uint32_t)offsetof(Chip8, I))
+#define OFF_PC ((uint32_t)offsetof(Chip8, pc))
+#define OFF_SP ((uint32_t)offsetof(Chip8, sp))
+#define OFF_STACK ((uint32_t)offsetof(Chip8, stack))
+#define OFF_DELAY ((uint32_t)offsetof(Chip8, delay_timer))
+#define OFF_SOUND ((uint32_t)offsetof(Chip8, sound_timer))
+#define OFF_KEYPAD ((uint32_t)offsetof(Chip8, keypad))
+#define OFF_PAGES ((uint32_t)offsetof(Chip8, pages))
+#define OFF_DISPLAY ((uint32_t)offsetof(Chip8, display))
+#define OFF_RNG ((uint32_t)offsetof(Chip8, rng_state))
+#define OFF_DIRTY ((uint32_t)offsetof(Chip8, dirty_rows))
+
+// ModRM byte for [rdi + disp32] with `reg` in the reg field
+#define MODRM_RDI_DISP32(reg) (0x87 | ((reg) << 3))
+
+enum { EAX = 0, ECX = 1, EDX = 2 };
+
+// movzx reg, byte [rdi + off]
+static void load_byte(Emitter *e, int reg, uint32_t off) {
+    emit8(e, 0x0F); emit8(e, 0xB6); emit8(e, MODRM_RDI_DISP32(reg)); emit32(e, off);
+}
+
+// mov byte [rdi + off], reg8
+static void store_byte(Emitter *e, int reg, uint32_t off) {
+    emit8(e, 0x88); emit8(e, MODRM_RDI_DISP32(reg)); emit32(e, off);
+}
+
+// mov byte [rdi + off], imm8
+static void store_byte_imm(Emitter *e, uint32_t off, uint8_t value) {
+    emit8(e, 0xC6); emit8(e, MODRM_RDI_DISP32(0)); emit32(e, off); emit8(e, value);
+}
+
+// movzx reg, word [rdi + off]
+static void load_word(Emitter *e, int reg, uint32_t off) {
+    emit8(e, 0x0F); emit8(e, 0xB7); emit8(e, MODRM_RDI_DISP32(reg)); emit32(e, off);
+}
+
+// mov word [rdi + off], reg16
+static void store_word(Emitter *e, int reg, uint32_t off) {
+    emit8(e, 0x66); emit8(e, 0x89); emit8(e, MODRM_RDI_DISP32(reg)); emit32(e, off);
+}
+
+// mov word [rdi + off], imm16
+static void store_word_imm(Emitter *e, uint32_t off, uint16_t value) {
+    emit8(e, 0x66); emit8(e, 0xC7); emit8(e, MODRM_RDI_DISP32(0)); emit32(e, off); emit16(e, value);
+}
+
+// add word [rdi + off], imm8
+static void add_word_imm(Emitter *e, uint32_t off, uint8_t value) {
+    emit8(e, 0x66); emit8(e, 0x83); emit8(e, MODRM_RDI_DISP32(0)); emit32(e, off); emit8(e, value);
+}
+
+// eax = the byte of memory at eax (any value; it wraps at 4KB like
+// chip8_mem_read). Clobbers edx.
+static void load_memory(Emitter *e) {
+    emit8(e, 0x25); emit32(e, 0xFFF);                           // and eax, 0xFFF
+    emit8(e, 0x89); emit8(e, 0xC2);                             // mov edx, eax
+    emit8(e, 0xC1); emit8(e, 0xEA); emit8(e, 8);                // shr edx, 8
+    // mov rdx, [rdi + rdx*8 + pages]
+    emit8(e, 0x48); emit8(e, 0x8B); emit8(e, 0x94); emit8(e, 0xD7); emit32(e, OFF_PAGES);
+    emit8(e, 0x0F); emit8(e, 0xB6); emit8(e, 0xC0);             // movzx eax, al
+    emit8(e, 0x0F); emit8(e, 0xB6); emit8(e, 0x04); emit8(e, 0x02);  // movzx eax, byte [rdx + rax]
+}
+
+// Return to the dispatcher with pc set and what's left of the budget
+static void emit_return(Emitter *e, uint16_t pc) {
+    store_word_imm(e, OFF_PC, pc);
+    emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xF0);             // mov rax, rsi
+    emit8(e, 0xC3);                                             // ret
+}
+
+// Take what ran on the way here out of the budget
+static void emit_charge(Emitter *e) {
+    if (e->count > 0) {
+        emit8(e, 0x48); emit8(e, 0x83); emit8(e, 0xEE); emit8(e, (uint8_t)e->count);  // sub rsi, count
+    }
+}
+
+// Return to the dispatcher at `pc` unless the budget covers the
+// instructions run so far and the next stretch of the block. Returns where
+// to patch in that stretch's length once it's known.
+static uint8_t *emit_budget_check(Emitter *e, uint16_t pc) {
+    emit8(e, 0x48); emit8(e, 0x83); emit8(e, 0xFE);             // cmp rsi, count + stretch
+    uint8_t *stretch_at = e->p;
+    emit8(e, (uint8_t)e->count);
+    emit8(e, 0x73);                                             // jae on
+    uint8_t *patch = e->p;
+    emit8(e, 0);
+    emit_charge(e);
+    emit_return(e, pc);
+    *patch = (uint8_t)(e->p - patch - 1);
+    return stretch_at;
+}
+
+// Carry on with the block at `pc`, or return there if there isn't one yet.
+// pc is only stored on the way back to C.
+static void emit_exit(Emitter *e, uint16_t pc) {
+    emit_charge(e);
+    if (pc == e->start) {
+        // Back to the top of this block, which checks the budget again
+        emit8(e, 0xE9); emit32(e, (uint32_t)(e->entry - (e->p + 4)));  // jmp entry
+        return;
+    }
+    if (pc < 4096) {
+        emit8(e, 0x48); emit8(e, 0xA1);                         // mov rax, [entries + pc]
+        emit64(e, (uint64_t)(uintptr_t)&e->jit->entries[pc]);
+        emit8(e, 0x48); emit8(e, 0x85); emit8(e, 0xC0);         // test rax, rax
+        emit8(e, 0x74); emit8(e, 0x02);                         // jz +2
+        emit8(e, 0xFF); emit8(e, 0xE0);                         // jmp rax
+    }
+    emit_return(e, pc);
+}
+
+// Carry on at ecx (which may be anywhere)
+static void emit_exit_ecx(Emitter *e) {
+    emit_charge(e);
+    emit8(e, 0x81); emit8(e, 0xF9); emit32(e, 4096);           // cmp ecx, 4096
+    emit8(e, 0x73); emit8(e, 21);                               // jae return
+    emit8(e, 0x48); emit8(e, 0xB8);                             // mov rax, entries
+    emit64(e, (uint64_t)(uintptr_t)e->jit->entries);
+    emit8(e, 0x48); emit8(e, 0x8B); emit8(e, 0x04); emit8(e, 0xC8);  // mov rax, [rax + rcx*8]
+    emit8(e, 0x48); emit8(e, 0x85); emit8(e, 0xC0);             // test rax, rax
+    emit8(e, 0x74); emit8(e, 0x02);                             // jz +2
+    emit8(e, 0xFF); emit8(e, 0xE0);                             // jmp rax
+    store_word(e, ECX, OFF_PC);                                 // return:
+    emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xF0);             // mov rax, rsi
+    emit8(e, 0xC3);                                             // ret
+}
+
+#define JE 0x74
+#define JNE 0x75
+
+// 3XNN, 4XNN, 5XY0, 9XY0, EX9E and EXA1
+static int is_skip(uint16_t opcode) {
+    switch (opcode >> 12) {
+        case 0x3:
+        case 0x4:
+            return 1;
+        case 0x5:
+        case 0x9:
+            return (opcode & 0xF) == 0;
+        case 0xE:
+            return (opcode & 0xFF) == 0x9E || (opcode & 0xFF) == 0xA1;
+        default:
+            return 0;
+    }
+}
+
+// Test a skip's condition. Returns the short conditional jump taken when
+// it skips.
+static uint8_t emit_skip_test(Emitter *e, uint16_t opcode) {
+    uint8_t x = (opcode & 0x0F00) >> 8;
+    uint8_t y = (opcode & 0x00F0) >> 4;
+    uint8_t nn = opcode & 0x00FF;
+
+    switch (opcode >> 12) {
+        case 0x3:
+        case 0x4:
+            // cmp byte [rdi + Vx], nn
+            emit8(e, 0x80); emit8(e, MODRM_RDI_DISP32(7)); emit32(e, OFF_V(x)); emit8(e, nn);
+            return (opcode >> 12) == 0x3 ? JE : JNE;
+        case 0x5:
+        case 0x9:
+            load_byte(e, EDX, OFF_V(x));
+            // cmp dl, byte [rdi + Vy]
+            emit8(e, 0x3A); emit8(e, MODRM_RDI_DISP32(EDX)); emit32(e, OFF_V(y));
+            return (opcode >> 12) == 0x5 ? JE : JNE;
+        default:
+            load_byte(e, EAX, OFF_V(x));
+            emit8(e, 0x83); emit8(e, 0xE0); emit8(e, 0x0F);                          // and eax, 15
+            // cmp byte [rdi + rax + keypad], 0
+            emit8(e, 0x80); emit8(e, 0xBC); emit8(e, 0x07); emit32(e, OFF_KEYPAD); emit8(e, 0);
+            return nn == 0x9E ? JNE : JE;
+    }
+}
+
+// A skip that ends the block: pc = condition ? next + 2 : next
+static void emit_skip_exit(Emitter *e, uint8_t jcc, uint16_t next) {
+    emit8(e, jcc);
+    uint8_t *patch = e->p;
+    emit8(e, 0);
+    emit_exit(e, next);
+    *patch = (uint8_t)(e->p - patch - 1);
+    emit_exit(e, (uint16_t)(next + 2));
+}
+
+// Call fn(chip8, jit, arg) from generated code
+static void emit_call(Emitter *e, void (*fn)(Chip8 *, Chip8Jit *, unsigned), unsigned arg) {
+    emit8(e, 0x57);                                             // push rdi
+    emit8(e, 0x56);                                             // push rsi
+    emit8(e, 0x48); emit8(e, 0x83); emit8(e, 0xEC); emit8(e, 8);    // sub rsp, 8 (keeps rsp 16-byte aligned)
+    emit8(e, 0x48); emit8(e, 0xBE);                             // mov rsi, jit
+    emit64(e, (uint64_t)(uintptr_t)e->jit);
+    emit8(e, 0xBA); emit32(e, arg);                             // mov edx, arg
+    emit8(e, 0x48); emit8(e, 0xB8);                             // mov rax, fn
+    emit64(e, (uint64_t)(uintptr_t)fn);
+    emit8(e, 0xFF); emit8(e, 0xD0);                             // call rax
+    emit8(e, 0x48); emit8(e, 0x83); emit8(e, 0xC4); emit8(e, 8);    // add rsp, 8
+    emit8(e, 0x5E);                                             // pop rsi
+    emit8(e, 0x5F);                                             // pop rdi
+}
+
+// FX33 and FX55, called from the block. The bytes go through
+// chip8_mem_write, and every block built from them is dropped; the block
+// doing the writing leaves right after, through the entry table.
+static void store_bcd(Chip8 *chip8, Chip8Jit *jit, unsigned x) {
+    uint8_t vx = chip8->V[x];
+    chip8_mem_write(chip8, chip8->I, vx / 100);
+    chip8_mem_write(chip8, chip8->I + 1, (vx / 10) % 10);
+    chip8_mem_write(chip8, chip8->I + 2, vx % 10);
+    chip8_jit_invalidate(jit, chip8->I, 3);
+}
+
+static void store_registers(Chip8 *chip8, Chip8Jit *jit, unsigned x) {
+    for (unsigned i = 0; i <= x; i++) {
+        chip8_mem_write(chip8, chip8->I + i, chip8->V[i]);
+    }
+    chip8_jit_invalidate(jit, chip8->I, x + 1);
+}
+
+// How far FX55/FX65 move I under the machine's quirks
+static void emit_memory_step(Emitter *e, uint8_t x) {
+    if (e->quirks->memory_step == 1) {
+        add_word_imm(e, OFF_I, x + 1);
+    }
+    else if (e->quirks->memory_step == 2 && x > 0) {
+        add_word_imm(e, OFF_I, x);
+    }
+}
+
+// 00E0
+static void emit_clear(Emitter *e) {
+    emit8(e, 0x0F); emit8(e, 0x57); emit8(e, 0xC0);             // xorps xmm0, xmm0
+    for (uint32_t off = 0; off < sizeof(((Chip8 *)0)->display); off += 16) {
+        // movups [rdi + display + off], xmm0
+        emit8(e, 0x0F); emit8(e, 0x11); emit8(e, MODRM_RDI_DISP32(0)); emit32(e, OFF_DISPLAY + off);
+    }
+    // mov dword [rdi + dirty_rows], CHIP8_ALL_ROWS_DIRTY
+    emit8(e, 0xC7); emit8(e, MODRM_RDI_DISP32(0)); emit32(e, OFF_DIRTY); emit32(e, CHIP8_ALL_ROWS_DIRTY);
+}
+
+// CXNN: chip8_random_byte, inline
+static void emit_random(Emitter *e, uint8_t x, uint8_t nn) {
+    emit8(e, 0x8B); emit8(e, MODRM_RDI_DISP32(EAX)); emit32(e, OFF_RNG);    // mov eax, [rng_state]
+    static const uint8_t shifts[3][2] = { { 0xE2, 13 }, { 0xEA, 17 }, { 0xE2, 5 } };  // shl, shr, shl
+    for (int i = 0; i < 3; i++) {
+        emit8(e, 0x89); emit8(e, 0xC2);                         // mov edx, eax
+        emit8(e, 0xC1); emit8(e, shifts[i][0]); emit8(e, shifts[i][1]);     // shl/shr edx, n
+        emit8(e, 0x31); emit8(e, 0xD0);                         // xor eax, edx
+    }
+    emit8(e, 0x89); emit8(e, MODRM_RDI_DISP32(EAX)); emit32(e, OFF_RNG);    // mov [rng_state], eax
+    emit8(e, 0xC1); emit8(e, 0xE8); emit8(e, 24);               // shr eax, 24
+    emit8(e, 0x24); emit8(e, nn);                               // and al, nn
+    store_byte(e, EAX, OFF_V(x));
+}
+
+// DXYN. Each sprite row goes to the top of rax and is rotated (or, when
+// clipping, shifted) right by x onto its screen row, like op_dxyn does.
+// ecx = x, r8d = screen row, r9d = I + row, r10 = pixels hit, r11d = rows
+// touched, esi = rows left, rbx = scratch (rsi and rbx are saved around
+// it). Collisions are collected without a branch: drawing and then erasing
+// a sprite makes them alternate.
+static void emit_draw(Emitter *e, uint8_t vx, uint8_t vy, uint8_t n) {
+    int clip = e->quirks->clip;
+    if (n == 0) {
+        store_byte_imm(e, OFF_V(0xF), 0);
+        return;
+    }
+    emit8(e, 0x56);                                             // push rsi
+    emit8(e, 0x53);                                             // push rbx
+    load_byte(e, ECX, OFF_V(vx));
+    emit8(e, 0x83); emit8(e, 0xE1); emit8(e, 63);               // and ecx, 63
+    emit8(e, 0x44); emit8(e, 0x0F); emit8(e, 0xB6); emit8(e, 0x87); emit32(e, OFF_V(vy));  // movzx r8d, byte [Vy]
+    if (clip) {
+        emit8(e, 0x41); emit8(e, 0x83); emit8(e, 0xE0); emit8(e, 31);   // and r8d, 31
+    }
+    emit8(e, 0x44); emit8(e, 0x0F); emit8(e, 0xB7); emit8(e, 0x8F); emit32(e, OFF_I);     // movzx r9d, word [I]
+    emit8(e, 0x45); emit8(e, 0x31); emit8(e, 0xD2);             // xor r10d, r10d
+    emit8(e, 0x45); emit8(e, 0x31); emit8(e, 0xDB);             // xor r11d, r11d
+    emit8(e, 0xBE); emit32(e, n);                               // mov esi, n
+
+    uint8_t *loop = e->p;
+    emit8(e, 0x44); emit8(e, 0x89); emit8(e, 0xC8);             // mov eax, r9d
+    load_memory(e);
+    emit8(e, 0x48); emit8(e, 0xC1); emit8(e, 0xE0); emit8(e, 56);   // shl rax, 56
+    emit8(e, 0x48); emit8(e, 0xD3); emit8(e, clip ? 0xE8 : 0xC8);   // shr/ror rax, cl
+    emit8(e, 0x44); emit8(e, 0x89); emit8(e, 0xC2);             // mov edx, r8d
+    uint8_t *clip_patch = NULL;
+    if (clip) {
+        emit8(e, 0x83); emit8(e, 0xFA); emit8(e, 32);           // cmp edx, 32
+        emit8(e, 0x73);                                         // jae done (off the bottom)
+        clip_patch = e->p;
+        emit8(e, 0);
+    }
+    else {
+        emit8(e, 0x83); emit8(e, 0xE2); emit8(e, 31);           // and edx, 31
+    }
+    emit8(e, 0x48); emit8(e, 0x85); emit8(e, 0xC0);             // test rax, rax
+    emit8(e, 0x74);                                             // jz next (nothing to draw)
+    uint8_t *empty_patch = e->p;
+    emit8(e, 0);
+    emit8(e, 0x41); emit8(e, 0x0F); emit8(e, 0xAB); emit8(e, 0xD3);     // bts r11d, edx
+    // mov rbx, [rdi + rdx*8 + display]
+    emit8(e, 0x48); emit8(e, 0x8B); emit8(e, 0x9C); emit8(e, 0xD7); emit32(e, OFF_DISPLAY);
+    emit8(e, 0x48); emit8(e, 0x21); emit8(e, 0xC3);             // and rbx, rax
+    emit8(e, 0x49); emit8(e, 0x09); emit8(e, 0xDA);             // or r10, rbx
+    // xor [rdi + rdx*8 + display], rax
+    emit8(e, 0x48); emit8(e, 0x31); emit8(e, 0x84); emit8(e, 0xD7); emit32(e, OFF_DISPLAY);
+    *empty_patch = (uint8_t)(e->p - empty_patch - 1);
+    emit8(e, 0x41); emit8(e, 0xFF); emit8(e, 0xC1);             // inc r9d
+    emit8(e, 0x41); emit8(e, 0xFF); emit8(e, 0xC0);             // inc r8d
+    emit8(e, 0xFF); emit8(e, 0xCE);                             // dec esi
+    emit8(e, 0x75); emit8(e, (uint8_t)(loop - (e->p + 1)));     // jnz loop
+    if (clip_patch) {
+        *clip_patch = (uint8_t)(e->p - clip_patch - 1);
+    }
+    emit8(e, 0x4D); emit8(e, 0x85); emit8(e, 0xD2);             // test r10, r10
+    emit8(e, 0x0F); emit8(e, 0x95); emit8(e, MODRM_RDI_DISP32(0)); emit32(e, OFF_V(0xF));  // setnz [VF]
+    emit8(e, 0x44); emit8(e, 0x09); emit8(e, 0x9F); emit32(e, OFF_DIRTY);     // or [dirty_rows], r11d
+    emit8(e, 0x5B);                                             // pop rbx
+    emit8(e, 0x5E);                                             // pop rsi
+}
+
+// FX65: V0..VX from memory at I
+static void emit_load_registers(Emitter *e, uint8_t x) {
+    emit8(e, 0x44); emit8(e, 0x0F); emit8(e, 0xB7); emit8(e, 0x8F); emit32(e, OFF_I);     // movzx r9d, word [I]
+    emit8(e, 0x45); emit8(e, 0x31); emit8(e, 0xC0);             // xor r8d, r8d
+    uint8_t *loop = e->p;
+    emit8(e, 0x43); emit8(e, 0x8D); emit8(e, 0x04); emit8(e, 0x01);     // lea eax, [r9 + r8]
+    load_memory(e);
+    // mov [rdi + r8 + V], al
+    emit8(e, 0x42); emit8(e, 0x88); emit8(e, 0x84); emit8(e, 0x07); emit32(e, OFF_V(0));
+    emit8(e, 0x41); emit8(e, 0xFF); emit8(e, 0xC0);             // inc r8d
+    emit8(e, 0x41); emit8(e, 0x83); emit8(e, 0xF8); emit8(e, x);    // cmp r8d, x
+    emit8(e, 0x76); emit8(e, (uint8_t)(loop - (e->p + 1)));     // jbe loop
+    emit_memory_step(e, x);
+}
+
+// FX0A: the lowest key held goes in VX; with none, stay on this
+// instruction (at `pc`)
+static void emit_wait_key(Emitter *e, uint8_t x, uint16_t pc) {
+    emit8(e, 0x48); emit8(e, 0x8B); emit8(e, MODRM_RDI_DISP32(EAX)); emit32(e, OFF_KEYPAD);     // mov rax, [keypad]
+    emit8(e, 0x48); emit8(e, 0x8B); emit8(e, MODRM_RDI_DISP32(EDX)); emit32(e, OFF_KEYPAD + 8); // mov rdx, [keypad + 8]
+    emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xC1);             // mov rcx, rax
+    emit8(e, 0x48); emit8(e, 0x09); emit8(e, 0xD1);             // or rcx, rdx
+    emit8(e, 0x75);                                             // jnz found
+    uint8_t *patch = e->p;
+    emit8(e, 0);
+    emit_exit(e, pc);
+    *patch = (uint8_t)(e->p - patch - 1);
+    emit8(e, 0x48); emit8(e, 0x0F); emit8(e, 0xBC); emit8(e, 0xCA);     // bsf rcx, rdx
+    emit8(e, 0x83); emit8(e, 0xC1); emit8(e, 64);               // add ecx, 64
+    emit8(e, 0x48); emit8(e, 0x0F); emit8(e, 0xBC); emit8(e, 0xC0);     // bsf rax, rax
+    emit8(e, 0x0F); emit8(e, 0x44); emit8(e, 0xC1);             // cmovz eax, ecx (no key in the low 8)
+    emit8(e, 0xC1); emit8(e, 0xE8); emit8(e, 3);                // shr eax, 3 (bit -> key)
+    store_byte(e, EAX, OFF_V(x));
+}
+
+// 8XYN. The default core reads VX and VY again after writing VF, so with
+// X or Y = F the flag leaks into the result; the quirk profiles' cores
+// read them first and write VF last.
+static void emit_arithmetic(Emitter *e, uint8_t x, uint8_t y, uint8_t n) {
+    const Chip8QuirkFlags *q = e->quirks;
+    uint8_t source = q->shift_vy ? y : x;
+
+    switch (n) {
+        case 0x0:
+            load_byte(e, EAX, OFF_V(y));
+            store_byte(e, EAX, OFF_V(x));
+            break;
+        case 0x1:
+        case 0x2:
+        case 0x3:
+            load_byte(e, EAX, OFF_V(x));
+            load_byte(e, ECX, OFF_V(y));
+            emit8(e, n == 1 ? 0x08 : n == 2 ? 0x20 : 0x30); emit8(e, 0xC8);  // or/and/xor al, cl
+            store_byte(e, EAX, OFF_V(x));
+            if (q->logic_resets_vf) {
+                store_byte_imm(e, OFF_V(0xF), 0);
+            }
+            break;
+        case 0x4:
+            load_byte(e, EAX, OFF_V(x));
+            load_byte(e, ECX, OFF_V(y));
+            emit8(e, 0x01); emit8(e, 0xC8);                     // add eax, ecx
+            emit8(e, 0x89); emit8(e, 0xC2);                     // mov edx, eax
+            emit8(e, 0xC1); emit8(e, 0xEA); emit8(e, 8);        // shr edx, 8 (carry)
+            if (q->is_default) {
+                store_byte(e, EDX, OFF_V(0xF));
+                store_byte(e, EAX, OFF_V(x));
+            }
+            else {
+                store_byte(e, EAX, OFF_V(x));
+                store_byte(e, EDX, OFF_V(0xF));
+            }
+            break;
+        case 0x5:
+        case 0x7:
+            // VX - VY (8XY5) or VY - VX (8XY7) in al, the no-borrow flag in dl
+            load_byte(e, EAX, OFF_V(n == 5 ? x : y));
+            load_byte(e, ECX, OFF_V(n == 5 ? y : x));
+            emit8(e, 0x38); emit8(e, 0xC8);                     // cmp al, cl
+            emit8(e, 0x0F); emit8(e, 0x93); emit8(e, 0xC2);     // setae dl
+            if (q->is_default) {
+                store_byte(e, EDX, OFF_V(0xF));
+                if (x == 0xF || y == 0xF) {
+                    load_byte(e, EAX, OFF_V(n == 5 ? x : y));
+                    load_byte(e, ECX, OFF_V(n == 5 ? y : x));
+                }
+                emit8(e, 0x28); emit8(e, 0xC8);                 // sub al, cl
+                store_byte(e, EAX, OFF_V(x));
+            }
+            else {
+                emit8(e, 0x28); emit8(e, 0xC8);                 // sub al, cl
+                store_byte(e, EAX, OFF_V(x));
+                store_byte(e, EDX, OFF_V(0xF));
+            }
+            break;
+        case 0x6:
+            load_byte(e, EAX, OFF_V(source));
+            emit8(e, 0x88); emit8(e, 0xC2);                     // mov dl, al
+            emit8(e, 0x80); emit8(e, 0xE2); emit8(e, 1);        // and dl, 1
+            if (q->is_default) {
+                store_byte(e, EDX, OFF_V(0xF));
+                if (x == 0xF) {
+                    load_byte(e, EAX, OFF_V(x));
+                }
+                emit8(e, 0xD0); emit8(e, 0xE8);                 // shr al, 1
+                store_byte(e, EAX, OFF_V(x));
+            }
+            else {
+                emit8(e, 0xD0); emit8(e, 0xE8);                 // shr al, 1
+                store_byte(e, EAX, OFF_V(x));
+                store_byte(e, EDX, OFF_V(0xF));
+            }
+            break;
+        case 0xE:
+            if (q->is_default) {
+                break;  // the default core ignores 8XYE
+            }
+            load_byte(e, EAX, OFF_V(source));
+            emit8(e, 0x88); emit8(e, 0xC2);                     // mov dl, al
+            emit8(e, 0xC0); emit8(e, 0xEA); emit8(e, 7);        // shr dl, 7
+            emit8(e, 0x00); emit8(e, 0xC0);                     // add al, al
+            store_byte(e, EAX, OFF_V(x));
+            store_byte(e, EDX, OFF_V(0xF));
+            break;
+        default:
+            break;  // 8XY8-8XYD and 8XYF do nothing
+    }
+}
+
+// Translate one instruction. `next` is the address after it. Returns 1 if
+// the block carries on after it, 2 if it ends the block.
+static int emit_instruction(Emitter *e, uint16_t opcode, uint16_t next) {
+    uint8_t x = (opcode & 0x0F00) >> 8;
+    uint8_t y = (opcode & 0x00F0) >> 4;
+    uint8_t n = opcode & 0x000F;
+    uint8_t nn = opcode & 0x00FF;
+    uint16_t nnn = opcode & 0x0FFF;
+
+    if (is_skip(opcode)) {
+        emit_skip_exit(e, emit_skip_test(e, opcode), next);
+        return 2;
+    }
+
+    switch (opcode >> 12) {
+        case 0x0:
+            if (opcode == 0x00EE) {
+                emit8(e, 0xFE); emit8(e, MODRM_RDI_DISP32(1)); emit32(e, OFF_SP);   // dec byte [sp]
+                load_byte(e, EAX, OFF_SP);
+                emit8(e, 0x83); emit8(e, 0xE0); emit8(e, 0x0F);                      // and eax, 15
+                // movzx ecx, word [rdi + rax*2 + stack]
+                emit8(e, 0x0F); emit8(e, 0xB7); emit8(e, 0x8C); emit8(e, 0x47); emit32(e, OFF_STACK);
+                emit_exit_ecx(e);
+                return 2;
+            }
+            if (opcode == 0x00E0) {
+                emit_clear(e);
+            }
+            return 1;  // the rest of 0NNN is ignored
+
+        case 0x1:
+            emit_exit(e, nnn);
+            return 2;
+
+        case 0x2:
+            load_byte(e, EAX, OFF_SP);
+            emit8(e, 0x83); emit8(e, 0xE0); emit8(e, 0x0F);                          // and eax, 15
+            // mov word [rdi + rax*2 + stack], next
+            emit8(e, 0x66); emit8(e, 0xC7); emit8(e, 0x84); emit8(e, 0x47); emit32(e, OFF_STACK); emit16(e, next);
+            emit8(e, 0xFE); emit8(e, MODRM_RDI_DISP32(0)); emit32(e, OFF_SP);       // inc byte [sp]
+            emit_exit(e, nnn);
+            return 2;
+
+        case 0x6:
+            store_byte_imm(e, OFF_V(x), nn);
+            return 1;
+
+        case 0x7:
+            // add byte [rdi + Vx], nn
+            emit8(e, 0x80); emit8(e, MODRM_RDI_DISP32(0)); emit32(e, OFF_V(x)); emit8(e, nn);
+            return 1;
+
+        case 0x8:
+            emit_arithmetic(e, x, y, n);
+            return 1;
+
+        case 0xA:
+            store_word_imm(e, OFF_I, nnn);
+            return 1;
+
+        case 0xB:
+            load_byte(e, ECX, OFF_V(e->quirks->jump_vx ? x : 0));
+            emit8(e, 0x81); emit8(e, 0xC1); emit32(e, nnn);           // add ecx, nnn
+            emit_exit_ecx(e);
+            return 2;
+
+        case 0xC:
+            emit_random(e, x, nn);
+            return 1;
+
+        case 0xD:
+            emit_draw(e, x, y, n);
+            return 1;
+
+        case 0xF:
+            switch (nn) {
+                case 0x07:
+                    load_byte(e, EAX, OFF_DELAY);
+                    store_byte(e, EAX, OFF_V(x));
+                    return 1;
+                case 0x0A:
+                    emit_wait_key(e, x, (uint16_t)(next - 2));
+                    return 1;
+                case 0x15:
+                case 0x18:
+                    load_byte(e, EAX, OFF_V(x));
+                    store_byte(e, EAX, nn == 0x15 ? OFF_DELAY : OFF_SOUND);
+                    return 1;
+                case 0x1E:
+                    load_word(e, EAX, OFF_I);
+                    load_byte(e, ECX, OFF_V(x));
+                    emit8(e, 0x01); emit8(e, 0xC8);                 // add eax, ecx
+                    store_word(e, EAX, OFF_I);
+                    return 1;
+                case 0x29:
+                    load_byte(e, EAX, OFF_V(x));
+                    if (!e->quirks->is_default) {
+                        emit8(e, 0x83); emit8(e, 0xE0); emit8(e, 0x0F);     // and eax, 15
+                    }
+                    emit8(e, 0x8D); emit8(e, 0x04); emit8(e, 0x80); // lea eax, [rax + rax*4]
+                    store_word(e, EAX, OFF_I);
+                    return 1;
+                case 0x33:
+                    emit_call(e, store_bcd, x);
+                    emit_exit(e, next);
+                    return 2;
+                case 0x55:
+                    emit_call(e, store_registers, x);
+                    emit_memory_step(e, x);
+                    emit_exit(e, next);
+                    return 2;
+                case 0x65:
+                    emit_load_registers(e, x);
+                    return 1;
+                default:
+                    return 1;  // not an instruction - ignored
+            }
+
+        default:
+            return 1;  // 5XYN/9XYN with N != 0, and EXNN other than the key skips
+    }
+}
+
+// Drop every compiled block and all generated code
+static void flush_all(Chip8Jit *jit) {
+    memset(jit->blocks, 0, sizeof(jit->blocks));
+    memset(jit->entries, 0, sizeof(jit->entries));
+    jit->blocks_used = 0;
+    jit->code_used = 0;
+    jit->stats.flushes++;
+}
+
+static Block *compile_block(Chip8Jit *jit, const Chip8 *chip8, uint16_t start) {
+    if (jit->blocks_used == POOL_SIZE ||
+        jit->code_used + MAX_BLOCK_CODE > CODE_BUFFER_SIZE) {
+        flush_all(jit);
+    }
+
+    Block *block = &jit->block_pool[jit->blocks_used++];
+    block->fn = NULL;
+    block->length = 0;
+    block->end = start + 2;
+
+    // Only the pages this block can land on are made writable
+    uint8_t *entry = jit->code + jit->code_used;
+    uint8_t *first_page = jit->code + (jit->code_used & ~(jit->page_size - 1));
+    size_t writable = entry + MAX_BLOCK_CODE - first_page;
+    if (mprotect(first_page, writable, PROT_READ | PROT_WRITE) != 0) {
+        jit->blocks[start] = block;
+        return block;
+    }
+
+    // The budget is checked every few instructions rather than once for
+    // the whole block, so that when it's nearly gone (the run stops at the
+    // next key event or frame) as little as possible is left to the
+    // interpreter
+    Emitter e = { entry, jit, chip8_quirk_flags((Chip8Quirks)jit->quirks), entry, start, 0 };
+    uint8_t *stretch_at = emit_budget_check(&e, start);
+    int stretch_start = 0;
+
+    uint16_t addr = start;
+    int result = 1;
+
+    // Stop before running off the end of memory, where fetch wraps around
+    // to address 0
+    while (block->length < MAX_BLOCK_INSTRUCTIONS && addr + 1 < 4096) {
+        if (block->length - stretch_start >= BUDGET_CHECK_INTERVAL) {
+            *stretch_at += (uint8_t)(block->length - stretch_start);
+            stretch_at = emit_budget_check(&e, addr);
+            stretch_start = block->length;
+        }
+
+        uint16_t opcode = chip8_mem_read(chip8, addr) << 8 | chip8_mem_read(chip8, addr + 1);
+        uint16_t next = addr + 2;
+        block->length++;
+        e.count++;
+
+        // A skip with room after it: the instruction it skips goes behind
+        // a branch, and the block carries on after that. If it runs, it
+        // takes itself out of the budget.
+        if (is_skip(opcode) && block->length < MAX_BLOCK_INSTRUCTIONS && next + 1 < 4096) {
+            uint16_t skipped = chip8_mem_read(chip8, next) << 8 | chip8_mem_read(chip8, next + 1);
+            if (!is_skip(skipped)) {
+                uint8_t jcc = emit_skip_test(&e, opcode);
+                emit8(&e, 0x0F); emit8(&e, jcc + 0x10);         // jcc near over it
+                uint8_t *patch = e.p;
+                emit32(&e, 0);
+                block->length++;
+                e.count++;
+                if (emit_instruction(&e, skipped, next + 2) == 1) {
+                    emit8(&e, 0x48); emit8(&e, 0xFF); emit8(&e, 0xCE);  // dec rsi
+                }
+                e.count--;
+                uint32_t over = (uint32_t)(e.p - (patch + 4));
+                memcpy(patch, &over, 4);
+                addr = next + 2;
+                continue;
+            }
+        }
+
+        result = emit_instruction(&e, opcode, next);
+        addr = next;
+        if (result == 2) {
+            break;
+        }
+    }
+
+    // Nothing fits at the very top of memory: interpret it
+    if (block->length > 0) {
+        if (result != 2) {
+            emit_exit(&e, addr);  // fell off the end - carry on at the next instruction
+        }
+        *stretch_at += (uint8_t)(block->length - stretch_start);
+        block->fn = (BlockFn)(void *)entry;
+        block->end = addr;
+        jit->code_used += e.p - entry;
+        jit->stats.blocks_compiled++;
+    }
+
+    mprotect(first_page, writable, PROT_READ | PROT_EXEC);
+    jit->blocks[start] = block;
+    jit->entries[start] = block->fn ? entry : NULL;
+    return block;
+}
+
+int chip8_jit_available(void) {
+    return 1;
+}
+
+Chip8Jit *chip8_jit_create(void) {
+    Chip8Jit *jit = calloc(1, sizeof(Chip8Jit));
+    if (!jit) {
+        return NULL;
+    }
+    jit->block_pool = malloc(POOL_SIZE * sizeof(Block));
+    jit->page_size = (size_t)sysconf(_SC_PAGESIZE);
+    jit->code = mmap(NULL, CODE_BUFFER_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (!jit->block_pool || jit->code == MAP_FAILED) {
+        if (jit->code != MAP_FAILED) {
+            munmap(jit->code, CODE_BUFFER_SIZE);
+        }
+        free(jit->block_pool);
+        free(jit);
+        return NULL;
+    }
+    return jit;
+}
+
+void chip8_jit_destroy(Chip8Jit *jit) {
+    if (jit) {
+        munmap(jit->code, CODE_BUFFER_SIZE);
+        free(jit->block_pool);
+        free(jit);
+    }
+}
+
+// Forget every block that was built from any byte in [addr, addr + size).
+// Addresses wrap at 4KB, as they do for chip8_mem_write.
+void chip8_jit_invalidate(Chip8Jit *jit, uint16_t addr, uint16_t size) {
+    addr &= 4095;
+    int first = addr - MAX_BLOCK_BYTES;
+    int last = addr + size;  // exclusive
+    if (first < 0) {
+        first = 0;
+    }
+    if (last > 4096) {
+        // The write wrapped around to the bottom of memory
+        chip8_jit_invalidate(jit, 0, last - 4096);
+        last = 4096;
+    }
+    for (int start = first; start < last; start++) {
+        Block *block = jit->blocks[start];
+        if (block && block->end > addr) {
+            jit->blocks[start] = NULL;
+            jit->entries[start] = NULL;
+            jit->stats.invalidations++;
+        }
+    }
+}
+
+void chip8_jit_invalidate_all(Chip8Jit *jit) {
+    flush_all(jit);
+}
+
+// Run exactly `cycles` cycles. Whole blocks run natively, chaining from one
+// to the next, as long as they fit in what's left; the rest is interpreted
+// one instruction at a time, on the machine's own core if it has a quirk
+// profile.
+uint64_t chip8_jit_run(void *context, Chip8 *chip8, uint64_t cycles) {
+    Chip8Jit *jit = context;
+    Chip8RunFn interpret = chip8_machine_engine(chip8);
+    uint64_t done = 0;
+
+    if (chip8->quirks != jit->quirks) {
+        if (jit->blocks_used > 0) {
+            flush_all(jit);
+        }
+        jit->quirks = chip8->quirks;
+    }
+
+    while (done < cycles) {
+        uint16_t pc = chip8->pc;
+        Block *block = NULL;
+        if (pc < 4096) {
+            block = jit->blocks[pc];
+            if (!block) {
+                block = compile_block(jit, chip8, pc);
+            }
+        }
+
+        if (block && block->fn) {
+            uint64_t budget = cycles - done;
+            uint64_t ran = budget - block->fn(chip8, budget);
+            if (ran > 0) {
+                done += ran;
+                jit->stats.native_cycles += ran;
+                continue;
+            }
+        }
+
+        // Interpret one instruction, and see whether it writes memory. The
+        // opcode is read just as fetch() reads it, wrapping at 4KB, so an
+        // FX33 or FX55 at the very top of memory is caught too.
+        uint16_t opcode = chip8_mem_read(chip8, pc) << 8 | chip8_mem_read(chip8, pc + 1);
+        uint16_t write_addr = chip8->I;
+        if (interpret) {
+            interpret(NULL, chip8, 1);
+        }
+        else {
+            chip8_cycle(chip8);
+        }
+        done++;
+        jit->stats.interpreted_cycles++;
+
+        if ((opcode & 0xF0FF) == 0xF033) {
+            chip8_jit_invalidate(jit, write_addr, 3);
+        }
+        else if ((opcode & 0xF0FF) == 0xF055) {
+            chip8_jit_invalidate(jit, write_addr, ((opcode & 0x0F00) >> 8) + 1);
+        }
+    }
+    return done;
+}
+
+#else
+
+// No JIT on this platform
+
+int chip8_jit_available(void) {
+    return 0;
+}
+
+Chip8Jit *chip8_jit_create(void) {
+    return NULL;
+}
+
+void chip8_jit_destroy(Chip8Jit *jit) {
+    free(jit);
+}
+
+void chip8_jit_invalidate(Chip8Jit *jit, uint16_t addr, uint16_t size) {
+    (void)jit;
+    (void)addr;
+    (void)size;
+}
+
+void chip8_jit_invalidate_all(Chip8Jit *jit) {
+    (void)jit;
+}
+
+uint64_t chip8_jit_run(void *context, Chip8 *chip8, uint64_t cycles) {
+    (void)context;
+    Chip8RunFn interpret = chip8_machine_engine(chip8);
+    if (interpret) {
+        return interpret(NULL, chip8, cycles);
+    }
+    for (uint64_t i = 0; i < cycles; i++) {
+        chip8_cycle(chip8);
+    }
+    return cycles;
+}
+
+#endif
+
+void chip8_jit_get_stats(const Chip8Jit *jit, Chip8JitStats *stats) {
+    if (jit) {
+        *stats = jit->stats;
+    }
+    else {
+        memset(stats, 0, sizeof(*stats));
+    }
+}
@@ -0,0 +1,372 @@
+// Paged memory
+// The 4KB address space is 16 pages of 256 bytes, and a Chip8 only holds
+// pointers to them. Pages are shared copy-on-write: chip8_fork gives the
+// child the parent's pages and bumps their reference counts, and the first
+// write to a shared page (FX33/FX55, or loading something) gives the writer
+// a private copy. Forking a machine costs a struct copy of a few hundred
+// bytes instead of 4KB, and forks only pay for the pages they change.
+//
+// XO-CHIP machines have 240 more pages past 4KB, in their Chip8Ext, and
+// they are shared the same way.
+//
+// Every fresh machine starts on two static pages that are never freed or
+// counted: the font page (0x000-0x0FF) and the zero page, which stands in
+// for every other empty page. Leaving them out of the counting keeps
+// threads that run unrelated machines from fighting over one counter.
+//
+// Each page also carries a hash of its contents: the sum of every byte
+// times a random odd key for its offset, so zero bytes add nothing and a
+// write adds (new - old) times its offset's key. The hash stays current
+// for one multiply per byte written, and a shared page's hash is shared
+// with it. chip8_mem_hash puts the pages' hashes together without
+// reading memory.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "chip8.h"
+
+typedef struct {
+    atomic_int refs;                // machines using this page; unused for static pages
+    int is_static;
+    uint64_t hash;                  // of `data` (see hash_delta)
+    uint8_t data[CHIP8_PAGE_SIZE];
+} Page;
+
+// Font set - each character is 5 bytes
+// These are the built-in sprites for hexadecimal digits 0-F
+#define FONT \
+    0xF0, 0x90, 0x90, 0x90, 0xF0, /* 0 */ \
+    0x20, 0x60, 0x20, 0x20, 0x70, /* 1 */ \
+    0xF0, 0x10, 0xF0, 0x80, 0xF0, /* 2 */ \
+    0xF0, 0x10, 0xF0, 0x10, 0xF0, /* 3 */ \
+    0x90, 0x90, 0xF0, 0x10, 0x10, /* 4 */ \
+    0xF0, 0x80, 0xF0, 0x10, 0xF0, /* 5 */ \
+    0xF0, 0x80, 0xF0, 0x90, 0xF0, /* 6 */ \
+    0xF0, 0x10, 0x20, 0x40, 0x40, /* 7 */ \
+    0xF0, 0x90, 0xF0, 0x90, 0xF0, /* 8 */ \
+    0xF0, 0x90, 0xF0, 0x10, 0xF0, /* 9 */ \
+    0xF0, 0x90, 0xF0, 0x90, 0x90, /* A */ \
+    0xE0, 0x90, 0xE0, 0x90, 0xE0, /* B */ \
+    0xF0, 0x80, 0x80, 0x80, 0xF0, /* C */ \
+    0xE0, 0x90, 0x90, 0x90, 0xE0, /* D */ \
+    0xF0, 0x80, 0xF0, 0x80, 0xF0, /* E */ \
+    0xF0, 0x80, 0xF0, 0x80, 0x80  /* F */
+
+// SUPER-CHIP's big digits for FX30, 10 bytes each. The original only had
+// 0-9; A-F are XO-CHIP's.
+#define BIG_FONT \
+    0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, /* 0 */ \
+    0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, /* 1 */ \
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, /* 2 */ \
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, /* 3 */ \
+    0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, /* 4 */ \
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, /* 5 */ \
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, /* 6 */ \
+    0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, /* 7 */ \
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, /* 8 */ \
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, /* 9 */ \
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, /* A */ \
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, /* B */ \
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, /* C */ \
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, /* D */ \
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, /* E */ \
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  /* F */
+
+static Page font_page = { .is_static = 1, .data = { FONT } };
+
+// The first page of SUPER-CHIP and XO-CHIP machines: both fonts
+static Page big_font_page = { .is_static = 1, .data = { FONT, BIG_FONT } };
+
+static Page zero_page = { .is_static = 1 };
+
+// splitmix64's finisher: a bijection, so different inputs never collide
+static inline uint64_t mix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static uint64_t offset_keys[CHIP8_PAGE_SIZE];
+
+// What changing `size` bytes at `offset` from `old` to `data` adds to
+// their page's hash
+static uint64_t hash_delta(const uint8_t *old, const uint8_t *data, size_t offset, size_t size) {
+    uint64_t delta = 0;
+    for (size_t i = 0; i < size; i++) {
+        // Most of a block written over a page is usually what was there
+        while (size - i >= 8 && memcmp(old + i, data + i, 8) == 0) {
+            i += 8;
+        }
+        if (i < size) {
+            delta += (data[i] - (uint64_t)old[i]) * offset_keys[offset + i];
+        }
+    }
+    return delta;
+}
+
+// The keys and the font pages' hashes are worked out once, by whichever
+// thread gets here first (the zero page's hash is 0)
+static pthread_once_t hashing_once = PTHREAD_ONCE_INIT;
+
+static void init_hashing(void) {
+    for (int i = 0; i < CHIP8_PAGE_SIZE; i++) {
+        offset_keys[i] = mix64(i + 1) | 1;
+    }
+    font_page.hash = hash_delta(zero_page.data, font_page.data, 0, CHIP8_PAGE_SIZE);
+    big_font_page.hash = hash_delta(zero_page.data, big_font_page.data, 0, CHIP8_PAGE_SIZE);
+}
+
+static Page *page_of(const uint8_t *data) {
+    return (Page *)(data - offsetof(Page, data));
+}
+
+static void page_retain(const uint8_t *data) {
+    Page *page = page_of(data);
+    if (!page->is_static) {
+        atomic_fetch_add_explicit(&page->refs, 1, memory_order_relaxed);
+    }
+}
+
+static void page_release(const uint8_t *data) {
+    Page *page = page_of(data);
+    if (!page->is_static && atomic_fetch_sub_explicit(&page->refs, 1, memory_order_acq_rel) == 1) {
+        free(page);
+    }
+}
+
+// Point every page at the shared font and zero pages
+void chip8_mem_init(Chip8 *chip8) {
+    pthread_once(&hashing_once, init_hashing);
+    chip8->pages[0] = font_page.data;
+    for (int p = 1; p < CHIP8_PAGE_COUNT; p++) {
+        chip8->pages[p] = zero_page.data;
+    }
+}
+
+// Make the page in `slot` private to this machine, copying it if it is
+// shared, and return it for writing
+static uint8_t *page_for_write(const uint8_t **slot) {
+    Page *page = page_of(*slot);
+    if (!page->is_static && atomic_load_explicit(&page->refs, memory_order_acquire) == 1) {
+        return page->data;
+    }
+
+    Page *copy = malloc(sizeof(Page));
+    if (!copy) {
+        printf("Error: Out of memory copying a memory page\n");
+        abort();
+    }
+    atomic_init(&copy->refs, 1);
+    copy->is_static = 0;
+    copy->hash = page->hash;
+    memcpy(copy->data, page->data, CHIP8_PAGE_SIZE);
+    *slot = copy->data;
+    page_release(page->data);
+    return copy->data;
+}
+
+// Copy `size` bytes into the page in `slot` at `offset` (all within the
+// page), unless they are already there, keeping its hash up to date
+static void page_store(const uint8_t **slot, size_t offset, const uint8_t *data, size_t size) {
+    if (memcmp(*slot + offset, data, size) == 0) {
+        return;
+    }
+    uint8_t *dest = page_for_write(slot);
+    page_of(dest)->hash += hash_delta(dest + offset, data, offset, size);
+    memcpy(dest + offset, data, size);
+}
+
+void chip8_mem_write(Chip8 *chip8, uint16_t addr, uint8_t value) {
+    int p = (addr >> 8) & (CHIP8_PAGE_COUNT - 1);
+    size_t offset = addr & 0xFF;
+    uint8_t old = chip8->pages[p][offset];
+    if (old != value) {
+        uint8_t *dest = page_for_write(&chip8->pages[p]);
+        page_of(dest)->hash += (uint64_t)((int)value - (int)old) * offset_keys[offset];
+        dest[offset] = value;
+    }
+}
+
+// Write `size` bytes at `addr` (wrapping at 4KB). Pages whose contents
+// wouldn't change are left alone - and stay shared.
+void chip8_mem_write_block(Chip8 *chip8, uint16_t addr, const uint8_t *data, size_t size) {
+    while (size > 0) {
+        int p = (addr >> 8) & (CHIP8_PAGE_COUNT - 1);
+        size_t offset = addr & 0xFF;
+        size_t chunk = CHIP8_PAGE_SIZE - offset;
+        if (chunk > size) {
+            chunk = size;
+        }
+        page_store(&chip8->pages[p], offset, data, chunk);
+        addr = (uint16_t)(addr + chunk);
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+// Copy `size` bytes starting at `addr` (wrapping at 4KB) out to `out`
+void chip8_mem_read_block(const Chip8 *chip8, uint16_t addr, uint8_t *out, size_t size) {
+    while (size > 0) {
+        int p = (addr >> 8) & (CHIP8_PAGE_COUNT - 1);
+        size_t offset = addr & 0xFF;
+        size_t chunk = CHIP8_PAGE_SIZE - offset;
+        if (chunk > size) {
+            chunk = size;
+        }
+        memcpy(out, chip8->pages[p] + offset, chunk);
+        addr = (uint16_t)(addr + chunk);
+        out += chunk;
+        size -= chunk;
+    }
+}
+
+// The slot holding the page for `addr` on a machine with more than 4KB
+static const uint8_t **xmem_slot(Chip8 *chip8, uint16_t addr) {
+    int p = addr >> 8;
+    return p < CHIP8_PAGE_COUNT ? &chip8->pages[p] : &chip8->ext->high_pages[p - CHIP8_PAGE_COUNT];
+}
+
+// chip8_mem_write for XO-CHIP machines: addresses go up to 64KB
+void chip8_xmem_write(Chip8 *chip8, uint16_t addr, uint8_t value) {
+    page_store(xmem_slot(chip8, addr), addr & 0xFF, &value, 1);
+}
+
+// And chip8_mem_write_block, wrapping at 64KB
+void chip8_xmem_write_block(Chip8 *chip8, uint16_t addr, const uint8_t *data, size_t size) {
+    while (size > 0) {
+        const uint8_t **slot = xmem_slot(chip8, addr);
+        size_t offset = addr & 0xFF;
+        size_t chunk = CHIP8_PAGE_SIZE - offset;
+        if (chunk > size) {
+            chunk = size;
+        }
+        page_store(slot, offset, data, chunk);
+        addr = (uint16_t)(addr + chunk);
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+// Bytes of memory the machine has: 4KB, or 64KB for XO-CHIP
+size_t chip8_mem_size(const Chip8 *chip8) {
+    return CHIP8_MEMORY_SIZE + (chip8->ext ? (size_t)chip8->ext->high_page_count * CHIP8_PAGE_SIZE : 0);
+}
+
+// Where the high page table goes in a Chip8Ext block: after the screen
+static const uint8_t **ext_high_pages(Chip8Ext *ext) {
+    return (const uint8_t **)&ext->screen[ext->plane_count];
+}
+
+// Give a fresh machine the extra state SUPER-CHIP and XO-CHIP need: a
+// 128x64 screen of `plane_count` planes, memory up to `memory_size` (more
+// empty pages past 4KB) and the big font. Returns 0 if out of memory.
+int chip8_mem_extend(Chip8 *chip8, int plane_count, size_t memory_size) {
+    int high_page_count = memory_size > CHIP8_MEMORY_SIZE ? (int)((memory_size - CHIP8_MEMORY_SIZE) / CHIP8_PAGE_SIZE) : 0;
+    size_t size = sizeof(Chip8Ext) + plane_count * sizeof(chip8->ext->screen[0]) +
+                  high_page_count * sizeof(const uint8_t *);
+    Chip8Ext *ext = calloc(1, size);
+    if (!ext) {
+        printf("Error: Out of memory for the extended machine\n");
+        return 0;
+    }
+    ext->size = size;
+    ext->plane_count = plane_count;
+    ext->high_page_count = high_page_count;
+    ext->high_pages = ext_high_pages(ext);
+    for (int p = 0; p < high_page_count; p++) {
+        ext->high_pages[p] = zero_page.data;
+    }
+    chip8->ext = ext;
+
+    // Share the static page with both fonts if nothing has been written to
+    // page 0 yet
+    if (chip8->pages[0] == font_page.data) {
+        chip8->pages[0] = big_font_page.data;
+    }
+    else {
+        chip8_mem_write_block(chip8, CHIP8_BIG_FONT_ADDR, big_font_page.data + CHIP8_BIG_FONT_ADDR,
+                              16 * 10);
+    }
+    return 1;
+}
+
+// Make `child` a copy of `parent` that shares all of its memory pages.
+// `child` must not be holding pages of its own (free it first). Copying
+// a SUPER-CHIP or XO-CHIP machine also copies its Chip8Ext; if that runs
+// out of memory we give up, like a page copy does.
+void chip8_fork(Chip8 *child, const Chip8 *parent) {
+    *child = *parent;
+    for (int p = 0; p < CHIP8_PAGE_COUNT; p++) {
+        page_retain(child->pages[p]);
+    }
+    if (parent->ext) {
+        child->ext = malloc(parent->ext->size);
+        if (!child->ext) {
+            printf("Error: Out of memory copying a machine\n");
+            abort();
+        }
+        memcpy(child->ext, parent->ext, parent->ext->size);
+        child->ext->high_pages = ext_high_pages(child->ext);
+        for (int p = 0; p < child->ext->high_page_count; p++) {
+            page_retain(child->ext->high_pages[p]);
+        }
+    }
+}
+
+// Give back this machine's pages. It is left pointing at the empty font
+// and zero pages, as a plain CHIP-8, so freeing twice is harmless.
+void chip8_free(Chip8 *chip8) {
+    for (int p = 0; p < CHIP8_PAGE_COUNT; p++) {
+        if (chip8->pages[p]) {
+            page_release(chip8->pages[p]);
+        }
+    }
+    if (chip8->ext) {
+        for (int p = 0; p < chip8->ext->high_page_count; p++) {
+            page_release(chip8->ext->high_pages[p]);
+        }
+        free(chip8->ext);
+        chip8->ext = NULL;
+    }
+    chip8->variant = CHIP8_VARIANT_CHIP8;
+    chip8->quirks = CHIP8_QUIRKS_DEFAULT;
+    chip8_mem_init(chip8);
+}
+
+static int page_is_private(const uint8_t *data) {
+    Page *page = page_of(data);
+    return !page->is_static && atomic_load_explicit(&page->refs, memory_order_relaxed) == 1;
+}
+
+// Pages this machine has its own copy of (the rest are shared)
+int chip8_mem_private_pages(const Chip8 *chip8) {
+    int count = 0;
+    for (int p = 0; p < CHIP8_PAGE_COUNT; p++) {
+        count += page_is_private(chip8->pages[p]);
+    }
+    for (int p = 0; chip8->ext && p < chip8->ext->high_page_count; p++) {
+        count += page_is_private(chip8->ext->high_pages[p]);
+    }
+    return count;
+}
+
+// Hash of all of the machine's memory, from the pages' own hashes: 16
+// mixes for CHIP-8 (256 for XO-CHIP's 64KB) whatever is in them. Which
+// slot a page is in goes into the mix, as the same page (the zero page,
+// say) can be in several.
+uint64_t chip8_mem_hash(const Chip8 *chip8) {
+    uint64_t hash = 0;
+    for (int p = 0; p < CHIP8_PAGE_COUNT; p++) {
+        hash ^= mix64(page_of(chip8->pages[p])->hash + (uint64_t)(p + 1) * 0x9E3779B97F4A7C15ULL);
+    }
+    for (int p = 0; chip8->ext && p < chip8->ext->high_page_count; p++) {
+        const Page *page = page_of(chip8->ext->high_pages[p]);
+        hash ^= mix64(page->hash + (uint64_t)(CHIP8_PAGE_COUNT + p + 1) * 0x9E3779B97F4A7C15ULL);
+    }
+    return hash;
+}
@@ -0,0 +1,56 @@
+// chip8-pack - bundle ROMs into one pack file for the ROM library
+//
+// Usage: chip8-pack <pack file> <rom, directory or pack>...
+//        chip8-pack --list <pack file>
+//
+// Every .ch8, .sc8 and .xo8 file in a directory goes in under its file
+// name; single files go in under the path as given. A pack opens with one
+// mmap (chip8_library_open, or chip8-batch --library) and keeps each
+// distinct ROM once.
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "chip8.h"
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s <pack file> <rom, directory or pack>...\n", prog);
+    printf("       %s --list <pack file>\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 3 && strcmp(argv[1], "--list") == 0) {
+        Chip8RomLibrary *library = chip8_library_open(argv[2]);
+        if (!library) {
+            return 1;
+        }
+        for (int i = 0; i < chip8_library_count(library); i++) {
+            const Chip8Rom *rom = chip8_library_rom(library, i);
+            printf("%016" PRIx64 " %6zu %-7s %s\n", rom->hash, rom->size, chip8_variant_name(rom->variant),
+                   rom->name);
+        }
+        chip8_library_close(library);
+        return 0;
+    }
+    if (argc < 3 || argv[1][0] == '-') {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    Chip8RomLibrary *library = chip8_library_create();
+    if (!library) {
+        return 1;
+    }
+    for (int i = 2; i < argc; i++) {
+        if (!chip8_library_add(library, argv[i])) {
+            chip8_library_close(library);
+            return 1;
+        }
+    }
+    int ok = chip8_library_write_pack(library, argv[1]);
+    if (ok) {
+        printf("Wrote %d ROMs to %s\n", chip8_library_count(library), argv[1]);
+    }
+    chip8_library_close(library);
+    return ok ? 0 : 1;
+}
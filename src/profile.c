@@ -0,0 +1,82 @@
+// Performance counters
+// The counting itself is the CHIP8_PROFILE_ADD hooks in the core and the
+// frontends, which only exist in a CHIP8_PROFILE build. This file turns a
+// Chip8Profile into JSON.
+#include <stdio.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+static const char *op_names[CHIP8_OP_COUNT] = {
+    [CHIP8_OP_NOP] = "NOP",
+    [CHIP8_OP_00E0] = "00E0", [CHIP8_OP_00EE] = "00EE", [CHIP8_OP_1NNN] = "1NNN",
+    [CHIP8_OP_2NNN] = "2NNN", [CHIP8_OP_3XNN] = "3XNN", [CHIP8_OP_4XNN] = "4XNN",
+    [CHIP8_OP_5XY0] = "5XY0", [CHIP8_OP_6XNN] = "6XNN", [CHIP8_OP_7XNN] = "7XNN",
+    [CHIP8_OP_8XY0] = "8XY0", [CHIP8_OP_8XY1] = "8XY1", [CHIP8_OP_8XY2] = "8XY2",
+    [CHIP8_OP_8XY3] = "8XY3", [CHIP8_OP_8XY4] = "8XY4", [CHIP8_OP_8XY5] = "8XY5",
+    [CHIP8_OP_8XY6] = "8XY6", [CHIP8_OP_8XY7] = "8XY7", [CHIP8_OP_9XY0] = "9XY0",
+    [CHIP8_OP_ANNN] = "ANNN", [CHIP8_OP_BNNN] = "BNNN", [CHIP8_OP_CXNN] = "CXNN",
+    [CHIP8_OP_DXYN] = "DXYN", [CHIP8_OP_EX9E] = "EX9E", [CHIP8_OP_EXA1] = "EXA1",
+    [CHIP8_OP_FX07] = "FX07", [CHIP8_OP_FX0A] = "FX0A", [CHIP8_OP_FX15] = "FX15",
+    [CHIP8_OP_FX18] = "FX18", [CHIP8_OP_FX1E] = "FX1E", [CHIP8_OP_FX29] = "FX29",
+    [CHIP8_OP_FX33] = "FX33", [CHIP8_OP_FX55] = "FX55", [CHIP8_OP_FX65] = "FX65"
+};
+
+// 1 if the core was built with CHIP8_PROFILE, so the counters fill in
+int chip8_profile_available(void) {
+#ifdef CHIP8_PROFILE
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+// Write the counters as one JSON object, with the `hot_addresses` most
+// executed addresses, busiest first. Returns 0 if writing failed.
+int chip8_profile_write_json(const Chip8Profile *profile, FILE *out, int hot_addresses) {
+    uint64_t instructions = 0;
+    for (int op = 0; op < CHIP8_OP_COUNT; op++) {
+        instructions += profile->op_counts[op];
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"instructions\": %llu,\n", (unsigned long long)instructions);
+    fprintf(out, "  \"ops\": {");
+    for (int op = 0; op < CHIP8_OP_COUNT; op++) {
+        fprintf(out, "%s\n    \"%s\": %llu", op ? "," : "", op_names[op],
+                (unsigned long long)profile->op_counts[op]);
+    }
+    fprintf(out, "\n  },\n");
+
+    // Pick the busiest addresses by repeated selection: there are only
+    // 4096 of them and the list is short
+    uint8_t taken[CHIP8_MEMORY_SIZE] = { 0 };
+    fprintf(out, "  \"hot_addresses\": [");
+    for (int rank = 0; rank < hot_addresses; rank++) {
+        int best = -1;
+        for (int pc = 0; pc < CHIP8_MEMORY_SIZE; pc++) {
+            if (!taken[pc] && profile->pc_counts[pc] &&
+                (best < 0 || profile->pc_counts[pc] > profile->pc_counts[best])) {
+                best = pc;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        taken[best] = 1;
+        fprintf(out, "%s\n    { \"pc\": \"0x%03X\", \"count\": %llu }", rank ? "," : "", best,
+                (unsigned long long)profile->pc_counts[best]);
+    }
+    fprintf(out, "\n  ],\n");
+
+    fprintf(out, "  \"sprites_drawn\": %llu,\n", (unsigned long long)profile->sprites_drawn);
+    fprintf(out, "  \"sprite_collisions\": %llu,\n", (unsigned long long)profile->sprite_collisions);
+    fprintf(out, "  \"frames_rendered\": %llu,\n", (unsigned long long)profile->frames_rendered);
+    fprintf(out, "  \"frames_skipped\": %llu,\n", (unsigned long long)profile->frames_skipped);
+    fprintf(out, "  \"idle_cycles\": %llu,\n", (unsigned long long)profile->idle_cycles);
+    fprintf(out, "  \"host_ns\": { \"emulate\": %llu, \"render\": %llu, \"delay\": %llu }\n",
+            (unsigned long long)profile->emulate_ns, (unsigned long long)profile->render_ns,
+            (unsigned long long)profile->delay_ns);
+    fprintf(out, "}\n");
+    return !ferror(out);
+}
@@ -0,0 +1,171 @@
+// Quirk profiles
+// CHIP-8 interpreters never agreed on a few instructions, and programs are
+// written against whichever one their author had. A CHIP-8 machine carries
+// the profile it follows; every profile but the default has its own core
+// built from src/core_template.h (src/core_quirks_*.c), so the quirks are
+// settled at compile time rather than checked per instruction.
+//
+//              8XY6/8XYE  FX55/FX65   BNNN      DXYN   8XY1-3
+//   default    VX         I kept      NNN + V0  wrap   VF kept
+//   vip        VY         I += X + 1  NNN + V0  clip   VF = 0
+//   chip48     VX         I += X      XNN + VX  clip   VF kept
+//   schip      VX         I kept      XNN + VX  clip   VF kept
+//   modern     VY         I += X + 1  NNN + V0  wrap   VF kept
+//
+// The default core (src/chip8.c) also ignores 8XYE, as it always has; the
+// other profiles run it.
+#define _POSIX_C_SOURCE 200809L  // strcasecmp
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include "chip8.h"
+
+// The flags must match the CORE_ switches in src/core_quirks_*.c
+static const struct {
+    const char *name;
+    Chip8RunFn run;
+    Chip8QuirkFlags flags;
+} profiles[CHIP8_QUIRKS_COUNT] = {
+    [CHIP8_QUIRKS_DEFAULT] = { "default", NULL, { .is_default = 1 } },
+    [CHIP8_QUIRKS_VIP] = { "vip", chip8_quirks_vip_run,
+                           { .shift_vy = 1, .memory_step = 1, .clip = 1, .logic_resets_vf = 1 } },
+    [CHIP8_QUIRKS_CHIP48] = { "chip48", chip8_quirks_chip48_run, { .memory_step = 2, .jump_vx = 1, .clip = 1 } },
+    [CHIP8_QUIRKS_SCHIP] = { "schip", chip8_quirks_schip_run, { .jump_vx = 1, .clip = 1 } },
+    [CHIP8_QUIRKS_MODERN] = { "modern", chip8_quirks_modern_run, { .shift_vy = 1, .memory_step = 1 } },
+};
+
+// Programs known to need a profile, by chip8_rom_hash. Anything not in
+// here gets the default.
+static const struct {
+    uint64_t hash;
+    uint8_t quirks;
+    const char *title;
+} rom_database[] = {
+    { 0x289CE14A5119DDBFULL, CHIP8_QUIRKS_VIP, "Nim [Carmelo Cortez, 1978]" },
+    { 0x624B3EED64313F42ULL, CHIP8_QUIRKS_CHIP48, "Pong [Paul Vervalin, 1990]" },
+    { 0x04EB2109DC29B1ABULL, CHIP8_QUIRKS_CHIP48, "Tetris [Fran Dachille, 1991]" },
+    { 0x8E547EBB12C026B4ULL, CHIP8_QUIRKS_SCHIP, "Space Invaders [David Winter] (alt)" },
+};
+
+// Make a freshly chip8_init-ed CHIP-8 machine follow `quirks`. Returns 0
+// for a SUPER-CHIP or XO-CHIP machine, which has its own quirks, unless
+// `quirks` is the default.
+int chip8_set_quirks(Chip8 *chip8, Chip8Quirks quirks) {
+    if (chip8->variant != CHIP8_VARIANT_CHIP8) {
+        return quirks == CHIP8_QUIRKS_DEFAULT;
+    }
+    chip8->quirks = (uint8_t)quirks;
+    return 1;
+}
+
+// The core for a CHIP-8 machine with `quirks`, or NULL for the default
+Chip8RunFn chip8_quirks_engine(Chip8Quirks quirks) {
+    return profiles[quirks].run;
+}
+
+const Chip8QuirkFlags *chip8_quirk_flags(Chip8Quirks quirks) {
+    return &profiles[quirks].flags;
+}
+
+// 1 if `opcode` may do something different under `quirks` than on the
+// default core. The decode cache and the JIT run a machine with any
+// profile on the default core's code, apart from these, which go to the
+// profile's own core.
+int chip8_quirks_differ(Chip8Quirks quirks, uint16_t opcode) {
+    const Chip8QuirkFlags *q = &profiles[quirks].flags;
+    uint8_t x = (opcode >> 8) & 0xF;
+    uint8_t y = (opcode >> 4) & 0xF;
+    uint8_t n = opcode & 0xF;
+
+    if (q->is_default) {
+        return 0;
+    }
+    switch (opcode >> 12) {
+        case 0x8:
+            switch (n) {
+                case 0x1:
+                case 0x2:
+                case 0x3:
+                    return q->logic_resets_vf;
+                // The profile cores write VF last, which only shows when X
+                // or Y is F
+                case 0x4:
+                case 0x5:
+                case 0x7:
+                    return x == 0xF || y == 0xF;
+                case 0x6:
+                    return q->shift_vy || x == 0xF;
+                case 0xE:
+                    return 1;  // ignored by the default core
+                default:
+                    return 0;
+            }
+        case 0xB:
+            return q->jump_vx;
+        case 0xD:
+            return q->clip;
+        case 0xF:
+            if ((opcode & 0xFF) == 0x29) {
+                return 1;  // the profile cores mask the digit
+            }
+            if ((opcode & 0xFF) == 0x55 || (opcode & 0xFF) == 0x65) {
+                return q->memory_step != 0;
+            }
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+const char *chip8_quirks_name(Chip8Quirks quirks) {
+    return profiles[quirks].name;
+}
+
+// The profile called `name` ("default", "vip", "chip48", "schip" or
+// "modern"), or -1
+int chip8_quirks_from_name(const char *name) {
+    for (int q = 0; q < CHIP8_QUIRKS_COUNT; q++) {
+        if (strcasecmp(name, profiles[q].name) == 0) {
+            return q;
+        }
+    }
+    return -1;
+}
+
+// 64-bit FNV-1a over a ROM image, the key of the ROM database
+uint64_t chip8_rom_hash(const uint8_t *data, size_t size) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// The profile the ROM database has for this ROM, or -1 if it isn't in it
+int chip8_quirks_for_rom(const uint8_t *data, size_t size) {
+    uint64_t hash = chip8_rom_hash(data, size);
+    for (size_t i = 0; i < sizeof(rom_database) / sizeof(rom_database[0]); i++) {
+        if (rom_database[i].hash == hash) {
+            return rom_database[i].quirks;
+        }
+    }
+    return -1;
+}
+
+// chip8_quirks_for_rom on a ROM file; -1 if it can't be read either
+int chip8_quirks_for_file(const char *filename) {
+    uint8_t data[CHIP8_MAX_ROM_SIZE + 1];
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        return -1;
+    }
+    size_t size = fread(data, 1, sizeof(data), file);
+    fclose(file);
+    if (size > CHIP8_MAX_ROM_SIZE) {
+        return -1;
+    }
+    return chip8_quirks_for_rom(data, size);
+}
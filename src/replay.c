@@ -0,0 +1,242 @@
+// Input replays
+// A replay is everything that isn't in the ROM: the keypad over time, the
+// CPU speed, and a hash of the machine at the start (which covers the ROM,
+// the CXNN seed and any loaded state). Keypad changes are stamped with the
+// cycle they happen before, not with host time, so playing a replay back
+// gives exactly the same machine at any host speed - flat out headless, or
+// in real time in the window.
+//
+// Layout (version 2, little-endian):
+//   "C8RP" magic, u16 version, u8 variant (Chip8Variant; 0 in replays
+//   from before SUPER-CHIP), u8 quirks (Chip8Quirks; 0 in replays from
+//   before quirk profiles), u32 CXNN generator state,
+//   u64 cpu_hz, u64 start hash, u64 cycles, u64 end hash
+//   then one record per keypad change: the cycles since the previous
+//   record as a LEB128 varint, and the new keypad as a u16 bit mask
+//   (bit N = key N held)
+//
+// `cycles` and the end hash are filled in when the recording is finished,
+// so playback can tell whether it ended up in the same place.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "chip8.h"
+
+#define HEADER_SIZE 44
+#define HEADER_CYCLES_OFFSET 28  // where `cycles` and the end hash go
+
+static const uint8_t replay_magic[4] = { 'C', '8', 'R', 'P' };
+
+static void put_u64(uint8_t *out, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint64_t get_u64(const uint8_t *in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value |= (uint64_t)in[i] << (8 * i);
+    }
+    return value;
+}
+
+static uint16_t keypad_mask(const Chip8 *chip8) {
+    uint16_t mask = 0;
+    for (int key = 0; key < 16; key++) {
+        if (chip8->keypad[key]) {
+            mask |= 1 << key;
+        }
+    }
+    return mask;
+}
+
+// Start recording `chip8` as it is now, before its first cycle
+int chip8_record_begin(Chip8Recorder *recorder, const char *filename, const Chip8 *chip8, uint64_t cpu_hz) {
+    uint8_t header[HEADER_SIZE] = { 0 };
+    memcpy(header, replay_magic, 4);
+    header[4] = CHIP8_REPLAY_VERSION & 0xFF;
+    header[5] = CHIP8_REPLAY_VERSION >> 8;
+    header[6] = chip8->variant;
+    header[7] = chip8->quirks;
+    for (int i = 0; i < 4; i++) {
+        header[8 + i] = (uint8_t)(chip8->rng_state >> (8 * i));
+    }
+    put_u64(header + 12, cpu_hz);
+    put_u64(header + 20, chip8_state_hash(chip8));
+
+    recorder->file = fopen(filename, "wb");
+    if (!recorder->file) {
+        printf("Error: Could not open %s for writing\n", filename);
+        return 0;
+    }
+    if (fwrite(header, 1, sizeof(header), recorder->file) != sizeof(header)) {
+        printf("Error: Could not write replay to %s\n", filename);
+        fclose(recorder->file);
+        recorder->file = NULL;
+        return 0;
+    }
+    recorder->last_cycle = 0;
+    recorder->keys = 0;
+    recorder->records = 0;
+    chip8_record_keys(recorder, chip8, 0);
+    return 1;
+}
+
+// Note the keypad before cycle `cycle` runs. Only writes anything if it
+// changed since last time, so call it as often as you like.
+void chip8_record_keys(Chip8Recorder *recorder, const Chip8 *chip8, uint64_t cycle) {
+    uint16_t keys = keypad_mask(chip8);
+    if (!recorder->file || keys == recorder->keys) {
+        return;
+    }
+
+    uint8_t record[12];
+    int size = 0;
+    uint64_t delta = cycle - recorder->last_cycle;
+    do {
+        record[size] = delta & 0x7F;
+        delta >>= 7;
+        record[size++] |= delta ? 0x80 : 0;
+    } while (delta);
+    record[size++] = keys & 0xFF;
+    record[size++] = keys >> 8;
+    fwrite(record, 1, size, recorder->file);
+
+    recorder->last_cycle = cycle;
+    recorder->keys = keys;
+    recorder->records++;
+}
+
+// Finish a recording that ran for `cycles` cycles and ended with `chip8`
+int chip8_record_end(Chip8Recorder *recorder, const Chip8 *chip8, uint64_t cycles) {
+    if (!recorder->file) {
+        return 0;
+    }
+    uint8_t tail[16];
+    put_u64(tail, cycles);
+    put_u64(tail + 8, chip8_state_hash(chip8));
+
+    int ok = fseek(recorder->file, HEADER_CYCLES_OFFSET, SEEK_SET) == 0 &&
+             fwrite(tail, 1, sizeof(tail), recorder->file) == sizeof(tail);
+    ok = fclose(recorder->file) == 0 && ok;
+    recorder->file = NULL;
+    if (!ok) {
+        printf("Error: Could not finish writing replay\n");
+    }
+    return ok;
+}
+
+// Read a replay and turn its keypad masks into a script of key events
+int chip8_load_replay(Chip8Replay *replay, const char *filename) {
+    memset(replay, 0, sizeof(*replay));
+
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        printf("Error: Could not open replay %s\n", filename);
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = size > 0 ? malloc(size) : NULL;
+    if (!data || fread(data, 1, size, file) != (size_t)size) {
+        printf("Error: Could not read replay %s\n", filename);
+        free(data);
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+
+    if (size < HEADER_SIZE || memcmp(data, replay_magic, 4) != 0 ||
+        (data[4] | data[5] << 8) != CHIP8_REPLAY_VERSION) {
+        printf("Error: %s is not a version %d replay\n", filename, CHIP8_REPLAY_VERSION);
+        free(data);
+        return 0;
+    }
+    replay->variant = data[6];
+    replay->quirks = data[7];
+    replay->rng_state = data[8] | data[9] << 8 | data[10] << 16 | (uint32_t)data[11] << 24;
+    replay->cpu_hz = get_u64(data + 12);
+    replay->start_hash = get_u64(data + 20);
+    replay->cycles = get_u64(data + 28);
+    replay->end_hash = get_u64(data + 36);
+
+    // Every record is at least 3 bytes and changes at most 16 keys
+    Chip8InputEvent *events = malloc(((size - HEADER_SIZE) / 3 * 16 + 1) * sizeof(Chip8InputEvent));
+    if (!events) {
+        printf("Error: Out of memory reading %s\n", filename);
+        free(data);
+        return 0;
+    }
+
+    const uint8_t *in = data + HEADER_SIZE;
+    const uint8_t *end = data + size;
+    uint64_t cycle = 0;
+    uint16_t keys = 0;
+    int count = 0;
+    while (in < end) {
+        uint64_t delta = 0;
+        int shift = 0;
+        while (in < end && shift < 64) {
+            delta |= (uint64_t)(*in & 0x7F) << shift;
+            shift += 7;
+            if (!(*in++ & 0x80)) {
+                break;
+            }
+        }
+        if (end - in < 2) {
+            printf("Error: %s is cut short\n", filename);
+            free(events);
+            free(data);
+            return 0;
+        }
+        cycle += delta;
+        uint16_t next = in[0] | in[1] << 8;
+        in += 2;
+
+        for (int key = 0; key < 16; key++) {
+            if ((keys ^ next) & (1 << key)) {
+                events[count].cycle = (long)cycle;
+                events[count].key = key;
+                events[count].pressed = (next >> key) & 1;
+                count++;
+            }
+        }
+        keys = next;
+    }
+    free(data);
+
+    replay->script.events = events;
+    replay->script.count = count;
+    return 1;
+}
+
+void chip8_free_replay(Chip8Replay *replay) {
+    chip8_free_input_script(&replay->script);
+}
+
+// Put `chip8`'s generator where the recording's was and check it starts
+// where the recording did (same ROM, same loaded state)
+int chip8_replay_prepare(const Chip8Replay *replay, Chip8 *chip8) {
+    if (replay->variant != chip8->variant) {
+        printf("Error: Replay was recorded on a %s machine, not %s\n",
+               replay->variant < CHIP8_VARIANT_COUNT ? chip8_variant_name(replay->variant) : "newer",
+               chip8_variant_name(chip8->variant));
+        return 0;
+    }
+    if (replay->quirks != chip8->quirks) {
+        printf("Error: Replay was recorded with the %s quirks, not %s\n",
+               replay->quirks < CHIP8_QUIRKS_COUNT ? chip8_quirks_name(replay->quirks) : "newer",
+               chip8_quirks_name(chip8->quirks));
+        return 0;
+    }
+    chip8->rng_state = replay->rng_state;
+    if (chip8_state_hash(chip8) != replay->start_hash) {
+        printf("Error: Replay was recorded from a different ROM or starting state\n");
+        return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,491 @@
+// ROM library
+// Loading a ROM the usual way (chip8_load_rom) opens and reads the file and
+// writes it into a fresh machine's memory, every time. The library does
+// the file part once: ROMs are memory-mapped when they are added, checked
+// against the size their variant allows, hashed, and loaded into a start
+// machine of their own. After that, chip8_rom_start is a chip8_fork of the
+// start machine - the ROM's pages are shared copy-on-write, so the copy
+// costs a few hundred bytes however big the ROM is.
+//
+// A library comes from a directory (every .ch8, .sc8 and .xo8 file in it,
+// in name order), a pack archive, or files added one at a time. ROMs are
+// indexed by name and by content hash in two small open-addressing tables.
+//
+// Pack layout (version 1, little-endian):
+//   "C8PK" magic, u16 version, u16 reserved (0), u32 ROM count
+//   per ROM: u64 content hash (chip8_rom_hash), u32 data offset,
+//            u32 size, u32 name offset, u32 name length
+//   then the names, then the ROM data
+// Offsets are from the start of the file. ROMs with the same contents
+// share one copy of the data. The whole pack is one mapping, and every
+// offset and hash is checked when it is opened.
+#define _POSIX_C_SOURCE 200809L  // strcasecmp, strdup
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "chip8.h"
+
+static const uint8_t pack_magic[4] = { 'C', '8', 'P', 'K' };
+
+#define PACK_HEADER_SIZE 12
+#define PACK_ENTRY_SIZE 24
+
+typedef struct {
+    void *base;
+    size_t size;
+} Mapping;
+
+struct Chip8RomLibrary {
+    Chip8Rom **roms;                // by index; each allocated on its own so pointers stay put
+    int count;
+    int capacity;
+    Mapping *mappings;              // to unmap on close
+    int mapping_count;
+    int *by_name;                   // index + 1 of a ROM, or 0 for an empty slot
+    int *by_hash;                   // the first ROM with each content hash
+    size_t index_size;              // slots in each table, a power of two
+};
+
+static void put_uint(uint8_t *out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint64_t get_uint(const uint8_t *in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint64_t)in[i] << (8 * i);
+    }
+    return value;
+}
+
+static int is_rom_name(const char *name) {
+    const char *dot = strrchr(name, '.');
+    return dot && (strcasecmp(dot, ".ch8") == 0 || strcasecmp(dot, ".sc8") == 0 || strcasecmp(dot, ".xo8") == 0);
+}
+
+static uint64_t name_hash(const char *name) {
+    return chip8_rom_hash((const uint8_t *)name, strlen(name));
+}
+
+// Put ROM `index` in the name table, and in the hash table unless an
+// earlier ROM has the same contents
+static void index_rom(Chip8RomLibrary *library, int index) {
+    const Chip8Rom *rom = library->roms[index];
+    size_t mask = library->index_size - 1;
+    size_t slot = name_hash(rom->name) & mask;
+    while (library->by_name[slot]) {
+        if (strcmp(library->roms[library->by_name[slot] - 1]->name, rom->name) == 0) {
+            break;  // same name as an earlier ROM; that one keeps it
+        }
+        slot = (slot + 1) & mask;
+    }
+    if (!library->by_name[slot]) {
+        library->by_name[slot] = index + 1;
+    }
+
+    slot = rom->hash & mask;
+    while (library->by_hash[slot] && library->roms[library->by_hash[slot] - 1]->hash != rom->hash) {
+        slot = (slot + 1) & mask;
+    }
+    if (!library->by_hash[slot]) {
+        library->by_hash[slot] = index + 1;
+    }
+}
+
+// Make room for one more ROM, growing the array and the index tables
+static int reserve(Chip8RomLibrary *library) {
+    if (library->count == library->capacity) {
+        int capacity = library->capacity ? library->capacity * 2 : 64;
+        Chip8Rom **roms = realloc(library->roms, capacity * sizeof(Chip8Rom *));
+        if (!roms) {
+            return 0;
+        }
+        library->roms = roms;
+        library->capacity = capacity;
+    }
+    // The tables stay at most half full
+    if ((size_t)(library->count + 1) * 2 > library->index_size) {
+        size_t size = library->index_size ? library->index_size * 2 : 128;
+        int *by_name = calloc(size, sizeof(int));
+        int *by_hash = calloc(size, sizeof(int));
+        if (!by_name || !by_hash) {
+            free(by_name);
+            free(by_hash);
+            return 0;
+        }
+        free(library->by_name);
+        free(library->by_hash);
+        library->by_name = by_name;
+        library->by_hash = by_hash;
+        library->index_size = size;
+        for (int i = 0; i < library->count; i++) {
+            index_rom(library, i);
+        }
+    }
+    return 1;
+}
+
+// Add the ROM `data` (which stays where it is) under `name`. Returns NULL
+// if it is too big for its variant or we run out of memory.
+static const Chip8Rom *add_rom(Chip8RomLibrary *library, const char *name, const uint8_t *data, size_t size) {
+    Chip8Variant variant = chip8_variant_for_file(name);
+    size_t max_size = variant == CHIP8_VARIANT_XOCHIP ? CHIP8_XO_MAX_ROM_SIZE : CHIP8_MAX_ROM_SIZE;
+    if (size > max_size) {
+        printf("Error: ROM too large: %s\n", name);
+        return NULL;
+    }
+
+    Chip8Rom *rom = malloc(sizeof(Chip8Rom));
+    if (!rom || !reserve(library) || !(rom->name = strdup(name))) {
+        printf("Error: Out of memory adding %s\n", name);
+        free(rom);
+        return NULL;
+    }
+    rom->data = data;
+    rom->size = size;
+    rom->hash = chip8_rom_hash(data, size);
+    rom->variant = variant;
+    rom->quirks = variant == CHIP8_VARIANT_CHIP8 ? chip8_quirks_for_rom(data, size) : -1;
+    chip8_init(&rom->start);
+    if (!chip8_set_variant(&rom->start, variant)) {
+        chip8_free(&rom->start);
+        free(rom->name);
+        free(rom);
+        return NULL;
+    }
+    chip8_load_rom_buffer(&rom->start, data, size);
+
+    library->roms[library->count] = rom;
+    index_rom(library, library->count);
+    return library->roms[library->count++];
+}
+
+// Map a whole file read-only and remember to unmap it. Returns NULL on
+// failure; an empty file maps to a pointer to nothing.
+static const uint8_t *map_file(Chip8RomLibrary *library, const char *path, size_t *size) {
+    static const uint8_t empty[1];
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("Error: Could not open file %s\n", path);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        printf("Error: %s is not a file\n", path);
+        close(fd);
+        return NULL;
+    }
+    *size = (size_t)st.st_size;
+    if (*size == 0) {
+        close(fd);
+        return empty;
+    }
+
+    Mapping *grown = realloc(library->mappings, (library->mapping_count + 1) * sizeof(Mapping));
+    if (!grown) {
+        printf("Error: Out of memory mapping %s\n", path);
+        close(fd);
+        return NULL;
+    }
+    library->mappings = grown;
+    void *base = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // the mapping keeps the file
+    if (base == MAP_FAILED) {
+        printf("Error: Could not map %s\n", path);
+        return NULL;
+    }
+    library->mappings[library->mapping_count].base = base;
+    library->mappings[library->mapping_count].size = *size;
+    library->mapping_count++;
+    return base;
+}
+
+// An empty library, to add files to. Returns NULL if out of memory.
+Chip8RomLibrary *chip8_library_create(void) {
+    Chip8RomLibrary *library = calloc(1, sizeof(Chip8RomLibrary));
+    if (!library) {
+        printf("Error: Out of memory for the ROM library\n");
+    }
+    return library;
+}
+
+void chip8_library_close(Chip8RomLibrary *library) {
+    if (!library) {
+        return;
+    }
+    for (int i = 0; i < library->count; i++) {
+        chip8_free(&library->roms[i]->start);
+        free(library->roms[i]->name);
+        free(library->roms[i]);
+    }
+    for (int i = 0; i < library->mapping_count; i++) {
+        munmap(library->mappings[i].base, library->mappings[i].size);
+    }
+    free(library->roms);
+    free(library->mappings);
+    free(library->by_name);
+    free(library->by_hash);
+    free(library);
+}
+
+// Add one ROM file, named by `path` as given. Returns NULL (and adds
+// nothing) if it can't be read or is too big.
+const Chip8Rom *chip8_library_add_file(Chip8RomLibrary *library, const char *path) {
+    size_t size;
+    const uint8_t *data = map_file(library, path, &size);
+    return data ? add_rom(library, path, data, size) : NULL;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Add every ROM in `path`, by file name. ROMs that can't be added are
+// reported and skipped.
+static int add_directory(Chip8RomLibrary *library, const char *path) {
+    DIR *dir = opendir(path);
+    if (!dir) {
+        printf("Error: Could not open directory %s\n", path);
+        return 0;
+    }
+    char **names = NULL;
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (!is_rom_name(entry->d_name)) {
+            continue;
+        }
+        char **grown = realloc(names, (count + 1) * sizeof(char *));
+        if (!grown || !(grown[count] = strdup(entry->d_name))) {
+            printf("Error: Out of memory reading %s\n", path);
+            names = grown ? grown : names;
+            break;
+        }
+        names = grown;
+        count++;
+    }
+    closedir(dir);
+
+    // Name order, so ROM indexes don't depend on the file system
+    qsort(names, count, sizeof(char *), compare_names);
+    for (int i = 0; i < count; i++) {
+        char *full = malloc(strlen(path) + strlen(names[i]) + 2);
+        size_t size;
+        const uint8_t *data = NULL;
+        if (full) {
+            sprintf(full, "%s/%s", path, names[i]);
+            data = map_file(library, full, &size);
+        }
+        if (data) {
+            add_rom(library, names[i], data, size);
+        }
+        free(full);
+        free(names[i]);
+    }
+    free(names);
+    return 1;
+}
+
+// Add every ROM in a pack that is mapped at `pack`. Returns 0 if any part
+// of it is out of bounds or doesn't match its hash.
+static int add_pack(Chip8RomLibrary *library, const char *path, const uint8_t *pack, size_t size) {
+    uint16_t version = (uint16_t)get_uint(pack + 4, 2);
+    uint32_t count = (uint32_t)get_uint(pack + 8, 4);
+    if (version != CHIP8_PACK_VERSION) {
+        printf("Error: %s is a version %u pack; this build reads version %d\n", path, version, CHIP8_PACK_VERSION);
+        return 0;
+    }
+    if ((uint64_t)count * PACK_ENTRY_SIZE > size - PACK_HEADER_SIZE) {
+        printf("Error: %s is cut short\n", path);
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *entry = pack + PACK_HEADER_SIZE + (size_t)i * PACK_ENTRY_SIZE;
+        uint64_t hash = get_uint(entry, 8);
+        uint64_t data_offset = get_uint(entry + 8, 4);
+        uint64_t data_size = get_uint(entry + 12, 4);
+        uint64_t name_offset = get_uint(entry + 16, 4);
+        uint64_t name_length = get_uint(entry + 20, 4);
+        if (data_offset + data_size > size || name_offset + name_length > size || name_length == 0 ||
+            memchr(pack + name_offset, '\0', name_length)) {
+            printf("Error: %s: entry %u is corrupt\n", path, i);
+            return 0;
+        }
+        if (chip8_rom_hash(pack + data_offset, data_size) != hash) {
+            printf("Error: %s: entry %u doesn't match its hash\n", path, i);
+            return 0;
+        }
+
+        char *name = malloc(name_length + 1);
+        if (!name) {
+            printf("Error: Out of memory reading %s\n", path);
+            return 0;
+        }
+        memcpy(name, pack + name_offset, name_length);
+        name[name_length] = '\0';
+        const Chip8Rom *rom = add_rom(library, name, pack + data_offset, data_size);
+        free(name);
+        if (!rom) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Add everything at `path`: a directory of ROMs, a pack, or a single ROM
+// file. Returns 0 if it can't be read (a pack that fails its checks may
+// have been added in part).
+int chip8_library_add(Chip8RomLibrary *library, const char *path) {
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+        return add_directory(library, path);
+    }
+    size_t size;
+    const uint8_t *data = map_file(library, path, &size);
+    if (data && size >= PACK_HEADER_SIZE && memcmp(data, pack_magic, 4) == 0) {
+        return add_pack(library, path, data, size);
+    }
+    return data && add_rom(library, path, data, size);
+}
+
+// A library of everything at `path` (see chip8_library_add), or NULL
+Chip8RomLibrary *chip8_library_open(const char *path) {
+    Chip8RomLibrary *library = chip8_library_create();
+    if (library && !chip8_library_add(library, path)) {
+        chip8_library_close(library);
+        return NULL;
+    }
+    return library;
+}
+
+int chip8_library_count(const Chip8RomLibrary *library) {
+    return library->count;
+}
+
+const Chip8Rom *chip8_library_rom(const Chip8RomLibrary *library, int index) {
+    return index >= 0 && index < library->count ? library->roms[index] : NULL;
+}
+
+// The ROM called `name`, or NULL
+const Chip8Rom *chip8_library_find(const Chip8RomLibrary *library, const char *name) {
+    if (!library->index_size) {
+        return NULL;
+    }
+    size_t mask = library->index_size - 1;
+    for (size_t slot = name_hash(name) & mask; library->by_name[slot]; slot = (slot + 1) & mask) {
+        const Chip8Rom *rom = library->roms[library->by_name[slot] - 1];
+        if (strcmp(rom->name, name) == 0) {
+            return rom;
+        }
+    }
+    return NULL;
+}
+
+// The first ROM added whose contents hash to `hash`, or NULL
+const Chip8Rom *chip8_library_find_hash(const Chip8RomLibrary *library, uint64_t hash) {
+    if (!library->index_size) {
+        return NULL;
+    }
+    size_t mask = library->index_size - 1;
+    for (size_t slot = hash & mask; library->by_hash[slot]; slot = (slot + 1) & mask) {
+        const Chip8Rom *rom = library->roms[library->by_hash[slot] - 1];
+        if (rom->hash == hash) {
+            return rom;
+        }
+    }
+    return NULL;
+}
+
+// Write every ROM in the library to a pack, each distinct ROM once.
+// Returns 0 on failure.
+int chip8_library_write_pack(const Chip8RomLibrary *library, const char *filename) {
+    size_t table_size = PACK_HEADER_SIZE + (size_t)library->count * PACK_ENTRY_SIZE;
+    uint8_t *table = calloc(1, table_size);
+    const Chip8Rom **written = malloc((library->count ? library->count : 1) * sizeof(Chip8Rom *));
+    uint64_t *data_offsets = malloc((library->count ? library->count : 1) * sizeof(uint64_t));
+    if (!table || !written || !data_offsets) {
+        printf("Error: Out of memory writing %s\n", filename);
+        free(table);
+        free(written);
+        free(data_offsets);
+        return 0;
+    }
+
+    memcpy(table, pack_magic, 4);
+    put_uint(table + 4, CHIP8_PACK_VERSION, 2);
+    put_uint(table + 8, (uint64_t)library->count, 4);
+    uint64_t offset = table_size;
+    for (int i = 0; i < library->count; i++) {
+        uint8_t *entry = table + PACK_HEADER_SIZE + (size_t)i * PACK_ENTRY_SIZE;
+        size_t name_length = strlen(library->roms[i]->name);
+        put_uint(entry + 16, offset, 4);
+        put_uint(entry + 20, name_length, 4);
+        offset += name_length;
+    }
+    // Then the data, skipping ROMs whose contents are already in
+    int written_count = 0;
+    for (int i = 0; i < library->count; i++) {
+        const Chip8Rom *rom = library->roms[i];
+        uint8_t *entry = table + PACK_HEADER_SIZE + (size_t)i * PACK_ENTRY_SIZE;
+        int same = -1;
+        for (int w = 0; w < written_count && same < 0; w++) {
+            if (written[w]->hash == rom->hash && written[w]->size == rom->size &&
+                memcmp(written[w]->data, rom->data, rom->size) == 0) {
+                same = w;
+            }
+        }
+        if (same < 0) {
+            same = written_count;
+            written[written_count] = rom;
+            data_offsets[written_count++] = offset;
+            offset += rom->size;
+        }
+        put_uint(entry, rom->hash, 8);
+        put_uint(entry + 8, data_offsets[same], 4);
+        put_uint(entry + 12, rom->size, 4);
+    }
+
+    int ok = 0;
+    FILE *file = NULL;
+    if (offset > UINT32_MAX) {
+        printf("Error: %s would be over 4GB\n", filename);
+    }
+    else if (!(file = fopen(filename, "wb"))) {
+        printf("Error: Could not open %s for writing\n", filename);
+    }
+    else {
+        ok = fwrite(table, 1, table_size, file) == table_size;
+        for (int i = 0; ok && i < library->count; i++) {
+            ok = fputs(library->roms[i]->name, file) != EOF;
+        }
+        for (int w = 0; ok && w < written_count; w++) {
+            ok = fwrite(written[w]->data, 1, written[w]->size, file) == written[w]->size;
+        }
+        if (fclose(file) != 0 || !ok) {
+            printf("Error: Could not write %s\n", filename);
+            ok = 0;
+        }
+    }
+    free(table);
+    free(written);
+    free(data_offsets);
+    return ok;
+}
+
+// Make `chip8` a fresh machine with `rom` loaded: a fork of the ROM's
+// start machine. `chip8` must not be holding pages of its own (free it
+// first). Seed it, and set its quirks if they aren't the default.
+void chip8_rom_start(const Chip8Rom *rom, Chip8 *chip8) {
+    chip8_fork(chip8, &rom->start);
+}
@@ -0,0 +1,271 @@
+// Save states
+// A save state is a small header followed by every field of the machine in
+// a fixed order, so files stay readable across compilers and struct
+// changes. Numbers are little-endian; on little-endian hosts every field is
+// a straight memcpy out of the struct, with no allocation.
+//
+// Layout (version 3, chip8_state_size bytes):
+//   "C8ST" magic, u16 version, u8 variant (Chip8Variant),
+//   u8 quirks (Chip8Quirks; 0 in states from before quirk profiles)
+//   memory[4096], display[32] (u64), V[16], I (u16), pc (u16),
+//   stack[16] (u16), sp, delay_timer, sound_timer, keypad[16],
+//   rng_state (u32)
+// and then, for SUPER-CHIP and XO-CHIP machines only:
+//   hires, plane_mask, pitch, flags[16], pattern[16],
+//   screen[planes][64][2] (u64), memory from 0x1000 up
+// A CHIP-8 state is CHIP8_STATE_SIZE bytes.
+//
+// Version 2 is the same, but the variant field was reserved (0), so every
+// version 2 state is a CHIP-8 one. Version 1 is version 2 with a rand_r
+// seed as the last field. Both still load; a version 1 seed is used to
+// seed the xorshift generator. A state only loads into a machine of its
+// own variant and quirk profile (any CHIP-8 one, for versions 1 and 2).
+//
+// dirty_rows isn't saved: it describes what the frontend has drawn, not
+// the machine, and every row is marked dirty after a load.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "chip8.h"
+
+static const uint8_t state_magic[4] = { 'C', '8', 'S', 'T' };
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define HOST_LITTLE_ENDIAN 0
+#else
+#define HOST_LITTLE_ENDIAN 1
+#endif
+
+// Copy `count` values of `width` bytes out to little-endian
+static uint8_t *put(uint8_t *out, const void *values, size_t width, size_t count) {
+    if (HOST_LITTLE_ENDIAN || width == 1) {
+        memcpy(out, values, width * count);
+        return out + width * count;
+    }
+    const uint8_t *bytes = values;
+    for (size_t i = 0; i < count; i++) {
+        for (size_t b = 0; b < width; b++) {
+            *out++ = bytes[i * width + width - 1 - b];
+        }
+    }
+    return out;
+}
+
+// And back in from little-endian
+static const uint8_t *get(const uint8_t *in, void *values, size_t width, size_t count) {
+    if (HOST_LITTLE_ENDIAN || width == 1) {
+        memcpy(values, in, width * count);
+        return in + width * count;
+    }
+    uint8_t *bytes = values;
+    for (size_t i = 0; i < count; i++) {
+        for (size_t b = 0; b < width; b++) {
+            bytes[i * width + width - 1 - b] = *in++;
+        }
+    }
+    return in;
+}
+
+// Bytes a save state of `chip8` takes
+size_t chip8_state_size(const Chip8 *chip8) {
+    if (!chip8->ext) {
+        return CHIP8_STATE_SIZE;
+    }
+    return CHIP8_STATE_SIZE + CHIP8_STATE_EXT_SIZE(chip8->ext->plane_count, chip8_mem_size(chip8));
+}
+
+// Write the machine into `buffer`. Returns the number of bytes written
+// (chip8_state_size), or 0 if `size` is too small.
+size_t chip8_save_state(const Chip8 *chip8, uint8_t *buffer, size_t size) {
+    if (size < chip8_state_size(chip8)) {
+        return 0;
+    }
+    uint16_t version = CHIP8_STATE_VERSION;
+    uint16_t variant = chip8->variant | chip8->quirks << 8;
+    uint8_t *out = buffer;
+
+    out = put(out, state_magic, 1, 4);
+    out = put(out, &version, 2, 1);
+    out = put(out, &variant, 2, 1);
+    for (int p = 0; p < CHIP8_PAGE_COUNT; p++) {
+        out = put(out, chip8->pages[p], 1, CHIP8_PAGE_SIZE);
+    }
+    out = put(out, chip8->display, 8, CHIP8_DISPLAY_HEIGHT);
+    out = put(out, chip8->V, 1, 16);
+    out = put(out, &chip8->I, 2, 1);
+    out = put(out, &chip8->pc, 2, 1);
+    out = put(out, chip8->stack, 2, 16);
+    out = put(out, &chip8->sp, 1, 1);
+    out = put(out, &chip8->delay_timer, 1, 1);
+    out = put(out, &chip8->sound_timer, 1, 1);
+    out = put(out, chip8->keypad, 1, 16);
+    out = put(out, &chip8->rng_state, 4, 1);
+    if (chip8->ext) {
+        const Chip8Ext *ext = chip8->ext;
+        out = put(out, &ext->hires, 1, 1);
+        out = put(out, &ext->plane_mask, 1, 1);
+        out = put(out, &ext->pitch, 1, 1);
+        out = put(out, ext->flags, 1, 16);
+        out = put(out, ext->pattern, 1, 16);
+        out = put(out, ext->screen, 8, ext->plane_count * CHIP8_HIRES_HEIGHT * CHIP8_HIRES_WORDS);
+        for (int p = 0; p < ext->high_page_count; p++) {
+            out = put(out, ext->high_pages[p], 1, CHIP8_PAGE_SIZE);
+        }
+    }
+    return out - buffer;
+}
+
+// Restore the machine from `buffer`. Returns 0 (and leaves `chip8` alone)
+// if it isn't a save state this version understands.
+int chip8_load_state(Chip8 *chip8, const uint8_t *buffer, size_t size) {
+    uint16_t version, variant;
+    if (size < chip8_state_size(chip8) || memcmp(buffer, state_magic, 4) != 0) {
+        return 0;
+    }
+    get(buffer + 4, &version, 2, 1);
+    get(buffer + 6, &variant, 2, 1);
+    if (version < 1 || version > CHIP8_STATE_VERSION) {
+        return 0;
+    }
+    // Older states don't say which quirks they ran with, so any CHIP-8 will do
+    if (version < 3 ? chip8->variant != CHIP8_VARIANT_CHIP8 : variant != (chip8->variant | chip8->quirks << 8)) {
+        return 0;
+    }
+
+    const uint8_t *in = buffer + 8;
+    // Pages that already hold the right bytes stay shared
+    chip8_mem_write_block(chip8, 0, in, CHIP8_MEMORY_SIZE);
+    in += CHIP8_MEMORY_SIZE;
+    in = get(in, chip8->display, 8, CHIP8_DISPLAY_HEIGHT);
+    in = get(in, chip8->V, 1, 16);
+    in = get(in, &chip8->I, 2, 1);
+    in = get(in, &chip8->pc, 2, 1);
+    in = get(in, chip8->stack, 2, 16);
+    in = get(in, &chip8->sp, 1, 1);
+    in = get(in, &chip8->delay_timer, 1, 1);
+    in = get(in, &chip8->sound_timer, 1, 1);
+    in = get(in, chip8->keypad, 1, 16);
+    in = get(in, &chip8->rng_state, 4, 1);
+    if (chip8->ext) {
+        Chip8Ext *ext = chip8->ext;
+        in = get(in, &ext->hires, 1, 1);
+        in = get(in, &ext->plane_mask, 1, 1);
+        in = get(in, &ext->pitch, 1, 1);
+        in = get(in, ext->flags, 1, 16);
+        in = get(in, ext->pattern, 1, 16);
+        in = get(in, ext->screen, 8, ext->plane_count * CHIP8_HIRES_HEIGHT * CHIP8_HIRES_WORDS);
+        chip8_xmem_write_block(chip8, CHIP8_MEMORY_SIZE, in, (size_t)ext->high_page_count * CHIP8_PAGE_SIZE);
+    }
+    if (version == 1) {
+        chip8_seed(chip8, chip8->rng_state);
+    }
+    chip8->dirty_rows = CHIP8_ALL_ROWS_DIRTY;
+    return 1;
+}
+
+// The file functions need a buffer of up to CHIP8_STATE_MAX_SIZE, which is
+// too much for the stack once XO-CHIP's 64KB is in it
+int chip8_save_state_file(const Chip8 *chip8, const char *filename) {
+    size_t capacity = chip8_state_size(chip8);
+    uint8_t *buffer = malloc(capacity);
+    if (!buffer) {
+        printf("Error: Out of memory saving state\n");
+        return 0;
+    }
+    size_t size = chip8_save_state(chip8, buffer, capacity);
+
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        printf("Error: Could not open %s for writing\n", filename);
+        free(buffer);
+        return 0;
+    }
+    int ok = fwrite(buffer, 1, size, file) == size;
+    ok = fclose(file) == 0 && ok;
+    free(buffer);
+    if (!ok) {
+        printf("Error: Could not write save state to %s\n", filename);
+    }
+    return ok;
+}
+
+int chip8_load_state_file(Chip8 *chip8, const char *filename) {
+    size_t capacity = chip8_state_size(chip8);
+    uint8_t *buffer = malloc(capacity);
+    if (!buffer) {
+        printf("Error: Out of memory loading state\n");
+        return 0;
+    }
+
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        printf("Error: Could not open save state %s\n", filename);
+        free(buffer);
+        return 0;
+    }
+    size_t size = fread(buffer, 1, capacity, file);
+    fclose(file);
+
+    int ok = chip8_load_state(chip8, buffer, size);
+    free(buffer);
+    if (!ok) {
+        printf("Error: %s is not a version %d or older %s save state with the %s quirks\n", filename,
+               CHIP8_STATE_VERSION, chip8_variant_name(chip8->variant), chip8_quirks_name(chip8->quirks));
+    }
+    return ok;
+}
+
+// Rewind
+// A ring of the last `capacity` machines. Each snapshot is a fork, so it
+// shares memory pages with the machine and with the snapshots around it,
+// and taking one or stepping back is a struct copy.
+
+int chip8_rewind_init(Chip8Rewind *rewind, int capacity) {
+    rewind->snapshots = malloc((capacity > 0 ? capacity : 1) * sizeof(Chip8));
+    rewind->capacity = capacity > 0 ? capacity : 1;
+    rewind->count = 0;
+    rewind->newest = -1;
+    if (!rewind->snapshots) {
+        printf("Error: Out of memory for %d rewind snapshots\n", capacity);
+        return 0;
+    }
+    return 1;
+}
+
+void chip8_rewind_free(Chip8Rewind *rewind) {
+    for (int i = 0; i < rewind->count; i++) {
+        chip8_free(&rewind->snapshots[(rewind->newest + rewind->capacity - i) % rewind->capacity]);
+    }
+    free(rewind->snapshots);
+    rewind->snapshots = NULL;
+    rewind->count = 0;
+}
+
+// Remember the machine as it is now, dropping the oldest snapshot if the
+// ring is full
+void chip8_rewind_push(Chip8Rewind *rewind, const Chip8 *chip8) {
+    rewind->newest = (rewind->newest + 1) % rewind->capacity;
+    if (rewind->count < rewind->capacity) {
+        rewind->count++;
+    }
+    else {
+        chip8_free(&rewind->snapshots[rewind->newest]);  // the oldest one
+    }
+    chip8_fork(&rewind->snapshots[rewind->newest], chip8);
+}
+
+// Go back to the newest snapshot and forget it. Returns 0 if there is
+// nothing left to rewind to.
+int chip8_rewind_pop(Chip8Rewind *rewind, Chip8 *chip8) {
+    if (rewind->count == 0) {
+        return 0;
+    }
+    chip8_free(chip8);
+    *chip8 = rewind->snapshots[rewind->newest];  // the snapshot's pages move over
+    chip8->dirty_rows = CHIP8_ALL_ROWS_DIRTY;
+    rewind->newest = (rewind->newest + rewind->capacity - 1) % rewind->capacity;
+    rewind->count--;
+    return 1;
+}
@@ -0,0 +1,182 @@
+// Scheduler
+// Keeps the CPU clock and the 60 Hz timers apart. The CPU runs at cpu_hz
+// instructions per second; the delay and sound timers tick once every
+// cpu_hz / 60 instructions. Timer ticks are placed by counting emulated
+// cycles, not by reading the host clock, so a run gives the same result
+// at any host speed. The host clock only decides how many cycles are due.
+//
+// A machine that is only waiting (see src/idle.c) doesn't get run at all:
+// the cycles are counted off and the timers ticked, which leaves it just
+// as running them would have.
+#define _POSIX_C_SOURCE 200809L  // clock_gettime
+#include <stdint.h>
+#include <time.h>
+
+#include "chip8.h"
+
+#define NS_PER_SECOND 1000000000ULL
+
+// Cycle count at which timer tick number `tick` happens (ticks count from 1)
+static uint64_t tick_cycle(uint64_t cpu_hz, uint64_t tick) {
+    return (tick * cpu_hz + CHIP8_TIMER_HZ - 1) / CHIP8_TIMER_HZ;
+}
+
+void chip8_sched_init(Chip8Scheduler *sched, uint64_t cpu_hz) {
+    if (cpu_hz < CHIP8_TIMER_HZ) {
+        cpu_hz = CHIP8_TIMER_HZ;
+    }
+    sched->cpu_hz = cpu_hz;
+    sched->cycles = 0;
+    sched->timer_ticks = 0;
+    sched->next_tick_cycle = tick_cycle(cpu_hz, 1);
+    sched->owed = 0;
+    sched->max_catchup_ns = CHIP8_DEFAULT_MAX_CATCHUP_NS;
+    sched->dropped_ns = 0;
+    sched->run = NULL;
+    sched->run_context = NULL;
+}
+
+// Run cycles through `run` (e.g. chip8_jit_run) instead of chip8_cycle
+void chip8_sched_set_engine(Chip8Scheduler *sched, Chip8RunFn run, void *context) {
+    sched->run = run;
+    sched->run_context = context;
+}
+
+// Count the delay and sound timers down by one (a 60 Hz tick)
+void chip8_tick_timers(Chip8 *chip8) {
+    if (chip8->delay_timer > 0) {
+        chip8->delay_timer--;
+    }
+    
+    if (chip8->sound_timer > 0) {
+        chip8->sound_timer--;
+    }
+}
+
+// Cycles left before the next timer tick
+uint64_t chip8_sched_cycles_to_tick(const Chip8Scheduler *sched) {
+    return sched->next_tick_cycle - sched->cycles;
+}
+
+// Cycles from a fresh start up to and including timer tick `frames`
+uint64_t chip8_sched_cycles_for_frames(uint64_t cpu_hz, uint64_t frames) {
+    if (cpu_hz < CHIP8_TIMER_HZ) {
+        cpu_hz = CHIP8_TIMER_HZ;
+    }
+    return tick_cycle(cpu_hz, frames);
+}
+
+// Let `cycles` go by without running anything, ticking the timers as many
+// times as they would have ticked
+static void skip_cycles(Chip8Scheduler *sched, Chip8 *chip8, uint64_t cycles) {
+    sched->cycles += cycles;
+    uint64_t ticks = sched->cycles * CHIP8_TIMER_HZ / sched->cpu_hz - sched->timer_ticks;
+    chip8->delay_timer = chip8->delay_timer > ticks ? chip8->delay_timer - ticks : 0;
+    chip8->sound_timer = chip8->sound_timer > ticks ? chip8->sound_timer - ticks : 0;
+    sched->timer_ticks += ticks;
+    sched->next_tick_cycle = tick_cycle(sched->cpu_hz, sched->timer_ticks + 1);
+    CHIP8_PROFILE_ADD(chip8, idle_cycles, cycles);
+}
+
+// Run exactly `cycles` CPU cycles, ticking the timers at their place in
+// between. Runs straight through in chunks between ticks, so there is no
+// per-instruction timer check.
+void chip8_sched_run_cycles(Chip8Scheduler *sched, Chip8 *chip8, uint64_t cycles) {
+    while (cycles > 0) {
+        uint64_t chunk = sched->next_tick_cycle - sched->cycles;
+        if (chunk > cycles) {
+            chunk = cycles;
+        }
+
+        // Only FX0A and the instructions of an idle loop (FX07, 3XNN, 1NNN)
+        // can start a wait. Turning the rest away here, without the call,
+        // keeps the check off the profile at low clock speeds where the
+        // chunks are only a few cycles long.
+        Chip8Idle idle;
+        uint8_t family = chip8_mem_read(chip8, chip8->pc) >> 4;
+        Chip8IdleKind kind = CHIP8_IDLE_NONE;
+        if (family == 0xF || family == 0x3 || family == 0x1) {
+            kind = chip8_idle_check(chip8, &idle);
+        }
+        switch (kind) {
+            case CHIP8_IDLE_KEY:
+            case CHIP8_IDLE_HALT:
+                // Nothing happens until the keypad changes, and it can't
+                // change in here
+                skip_cycles(sched, chip8, cycles);
+                return;
+            case CHIP8_IDLE_TIMER:
+                if (chip8->pc == idle.head) {
+                    // Every trip round the loop before the next tick reads
+                    // the same timer value
+                    uint64_t trips = chunk / 3;
+                    if (trips > 0) {
+                        chip8->V[idle.x] = chip8->delay_timer;
+                        skip_cycles(sched, chip8, trips * 3);
+                        cycles -= trips * 3;
+                        continue;
+                    }
+                }
+                else {
+                    // Run to the top of the loop first
+                    uint64_t to_head = (uint16_t)(idle.head + 6 - chip8->pc) / 2;
+                    if (chunk > to_head) {
+                        chunk = to_head;
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+
+        if (sched->run) {
+            sched->run(sched->run_context, chip8, chunk);
+        }
+        else {
+            for (uint64_t i = 0; i < chunk; i++) {
+                chip8_cycle(chip8);
+            }
+        }
+        sched->cycles += chunk;
+        cycles -= chunk;
+
+        if (sched->cycles == sched->next_tick_cycle) {
+            chip8_tick_timers(chip8);
+            sched->timer_ticks++;
+            sched->next_tick_cycle = tick_cycle(sched->cpu_hz, sched->timer_ticks + 1);
+        }
+    }
+}
+
+// How many cycles `elapsed_ns` of host time is worth. Fractions of a cycle
+// carry over to the next call. If the host fell further behind than
+// max_catchup_ns, the extra time is dropped (and added to dropped_ns)
+// rather than run as one huge burst. The caller has to run them - see
+// chip8_sched_advance.
+uint64_t chip8_sched_cycles_due(Chip8Scheduler *sched, uint64_t elapsed_ns) {
+    if (elapsed_ns > sched->max_catchup_ns) {
+        sched->dropped_ns += elapsed_ns - sched->max_catchup_ns;
+        elapsed_ns = sched->max_catchup_ns;
+    }
+
+    // `owed` is in units of 1/NS_PER_SECOND cycles
+    sched->owed += elapsed_ns * sched->cpu_hz;
+    uint64_t cycles = sched->owed / NS_PER_SECOND;
+    sched->owed %= NS_PER_SECOND;
+    return cycles;
+}
+
+// Run however many cycles `elapsed_ns` of host time is worth. Returns the
+// number of cycles run.
+uint64_t chip8_sched_advance(Chip8Scheduler *sched, Chip8 *chip8, uint64_t elapsed_ns) {
+    uint64_t cycles = chip8_sched_cycles_due(sched, elapsed_ns);
+    chip8_sched_run_cycles(sched, chip8, cycles);
+    return cycles;
+}
+
+// Monotonic host clock in nanoseconds
+uint64_t chip8_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NS_PER_SECOND + ts.tv_nsec;
+}
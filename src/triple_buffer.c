@@ -0,0 +1,60 @@
+// Frame triple buffer
+// Hands finished frames from the thread running a machine to the thread
+// drawing it, without either ever waiting on the other. There are three
+// frames: the writer fills `back`, the reader draws `front`, and the third
+// is parked in `middle`. Publishing swaps back and middle; taking swaps
+// middle and front. The swaps are single atomic exchanges on `middle`, so
+// the writer never blocks on a slow present and the reader always gets
+// the newest frame (frames it was too slow for are simply skipped).
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "chip8.h"
+
+#define FRESH 4  // bit in `middle`: published since the reader last took
+
+struct Chip8TripleBuffer {
+    Chip8Frame frames[3];
+    unsigned back;                  // writer's frame
+    _Atomic unsigned middle;        // the parked frame, | FRESH
+    unsigned front;                 // reader's frame
+};
+
+// All three frames start out blank. Returns NULL if out of memory.
+Chip8TripleBuffer *chip8_triple_create(void) {
+    Chip8TripleBuffer *buffer = calloc(1, sizeof(*buffer));
+    if (!buffer) {
+        printf("Error: Out of memory for the frame buffers\n");
+        return NULL;
+    }
+    buffer->back = 0;
+    atomic_init(&buffer->middle, 1);
+    buffer->front = 2;
+    return buffer;
+}
+
+void chip8_triple_destroy(Chip8TripleBuffer *buffer) {
+    free(buffer);
+}
+
+// The frame to fill in next (writer only)
+Chip8Frame *chip8_triple_back(Chip8TripleBuffer *buffer) {
+    return &buffer->frames[buffer->back];
+}
+
+// Hand the back frame over to the reader (writer only)
+void chip8_triple_publish(Chip8TripleBuffer *buffer) {
+    unsigned old = atomic_exchange_explicit(&buffer->middle, buffer->back | FRESH, memory_order_acq_rel);
+    buffer->back = old & ~FRESH;
+}
+
+// The newest published frame, or NULL if nothing was published since the
+// last call (reader only). It stays valid until the next call.
+const Chip8Frame *chip8_triple_take(Chip8TripleBuffer *buffer) {
+    if (!(atomic_load_explicit(&buffer->middle, memory_order_relaxed) & FRESH)) {
+        return NULL;
+    }
+    unsigned old = atomic_exchange_explicit(&buffer->middle, buffer->front, memory_order_acq_rel);
+    buffer->front = old & ~FRESH;
+    return &buffer->frames[buffer->front];
+}
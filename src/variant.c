@@ -0,0 +1,81 @@
+// Variants
+// SUPER-CHIP and XO-CHIP machines are a Chip8 plus a Chip8Ext (the 128x64
+// screen, XO-CHIP's memory past 4KB, and a few registers), run by a core
+// of their own built from src/core_template.h. A plain CHIP-8 has no
+// Chip8Ext and runs exactly as before.
+#define _POSIX_C_SOURCE 200809L  // strcasecmp
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include "chip8.h"
+
+static const struct {
+    const char *name;
+    const char *extension;          // ROM file extension that picks it
+    int plane_count;
+    size_t memory_size;
+    Chip8RunFn run;
+} variants[CHIP8_VARIANT_COUNT] = {
+    [CHIP8_VARIANT_CHIP8] = { "chip8", ".ch8", 0, CHIP8_MEMORY_SIZE, NULL },
+    [CHIP8_VARIANT_SCHIP] = { "schip", ".sc8", 1, CHIP8_MEMORY_SIZE, chip8_schip_run },
+    [CHIP8_VARIANT_XOCHIP] = { "xochip", ".xo8", 2, CHIP8_XO_MEMORY_SIZE, chip8_xochip_run },
+};
+
+// Make a freshly chip8_init-ed machine a `variant` machine. Returns 0 if
+// out of memory (the machine stays a CHIP-8).
+int chip8_set_variant(Chip8 *chip8, Chip8Variant variant) {
+    if (variant == CHIP8_VARIANT_CHIP8 || chip8->ext) {
+        return chip8->variant == variant;
+    }
+    if (!chip8_mem_extend(chip8, variants[variant].plane_count, variants[variant].memory_size)) {
+        return 0;
+    }
+    chip8->variant = (uint8_t)variant;
+    chip8->ext->plane_mask = 1;
+    chip8->dirty_rows = CHIP8_ALL_ROWS_DIRTY;
+    return 1;
+}
+
+// The engine that runs `variant` machines, or NULL for CHIP-8 (which can
+// use chip8_cycle, the decode cache or the JIT)
+Chip8RunFn chip8_variant_engine(Chip8Variant variant) {
+    return variants[variant].run;
+}
+
+// The engine `chip8` has to run on: its variant's core, or its quirk
+// profile's. NULL for a CHIP-8 with the default quirks, which can use
+// chip8_cycle, the decode cache or the JIT.
+Chip8RunFn chip8_machine_engine(const Chip8 *chip8) {
+    if (chip8->variant != CHIP8_VARIANT_CHIP8) {
+        return variants[chip8->variant].run;
+    }
+    return chip8_quirks_engine((Chip8Quirks)chip8->quirks);
+}
+
+const char *chip8_variant_name(Chip8Variant variant) {
+    return variants[variant].name;
+}
+
+// The variant called `name` ("chip8", "schip" or "xochip"), or -1
+int chip8_variant_from_name(const char *name) {
+    for (int v = 0; v < CHIP8_VARIANT_COUNT; v++) {
+        if (strcasecmp(name, variants[v].name) == 0) {
+            return v;
+        }
+    }
+    return -1;
+}
+
+// Guess the variant from a ROM's file extension (.sc8, .xo8); CHIP-8
+// unless it says otherwise
+Chip8Variant chip8_variant_for_file(const char *filename) {
+    const char *dot = strrchr(filename, '.');
+    for (int v = 0; dot && v < CHIP8_VARIANT_COUNT; v++) {
+        if (strcasecmp(dot, variants[v].extension) == 0) {
+            return (Chip8Variant)v;
+        }
+    }
+    return CHIP8_VARIANT_CHIP8;
+}
@@ -0,0 +1,98 @@
+// Visited-state set
+// Open addressing over one array of 64-bit keys, with linear probing and
+// no locks: a key goes into the first empty slot from its home slot on,
+// claimed with a compare-and-swap. A thread that loses the race to a slot
+// looks at what won it - the same key means someone else got there first,
+// anything else means keep probing. Keys are never removed, so a slot
+// that holds a key holds it for good and lookups need no more than a load.
+//
+// Slot value 0 means empty, so key 0 lives in a flag of its own. The table
+// is twice the capacity asked for (rounded up to a power of two) to keep
+// probes short; it never grows.
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "chip8.h"
+
+struct Chip8VisitedSet {
+    size_t mask;                    // slots - 1
+    _Atomic int has_zero;           // key 0 is in the set
+    _Atomic uint64_t slots[];
+};
+
+// A set for about `capacity` keys. Returns NULL if out of memory.
+Chip8VisitedSet *chip8_visited_create(size_t capacity) {
+    size_t slots = 16;
+    while (slots < capacity * 2) {
+        slots *= 2;
+    }
+    Chip8VisitedSet *set = calloc(1, sizeof(*set) + slots * sizeof(set->slots[0]));
+    if (!set) {
+        printf("Error: Out of memory for a visited set of %zu states\n", capacity);
+        return NULL;
+    }
+    set->mask = slots - 1;
+    atomic_init(&set->has_zero, 0);
+    for (size_t i = 0; i < slots; i++) {
+        atomic_init(&set->slots[i], 0);
+    }
+    return set;
+}
+
+void chip8_visited_destroy(Chip8VisitedSet *set) {
+    free(set);
+}
+
+// Add `key`. Returns 1 if it is new, 0 if it was already there and -1 if
+// the set is full. When several threads add the same key at once, exactly
+// one of them gets 1.
+int chip8_visited_insert(Chip8VisitedSet *set, uint64_t key) {
+    if (key == 0) {
+        return !atomic_exchange_explicit(&set->has_zero, 1, memory_order_acq_rel);
+    }
+    size_t i = key & set->mask;
+    for (size_t probes = 0; probes <= set->mask; probes++) {
+        uint64_t seen = atomic_load_explicit(&set->slots[i], memory_order_acquire);
+        if (seen == 0) {
+            if (atomic_compare_exchange_strong_explicit(&set->slots[i], &seen, key, memory_order_acq_rel,
+                                                        memory_order_acquire)) {
+                return 1;
+            }
+            // Someone else took the slot; `seen` is now what they put there
+        }
+        if (seen == key) {
+            return 0;
+        }
+        i = (i + 1) & set->mask;
+    }
+    return -1;
+}
+
+int chip8_visited_contains(const Chip8VisitedSet *set, uint64_t key) {
+    if (key == 0) {
+        return atomic_load_explicit(&set->has_zero, memory_order_acquire);
+    }
+    size_t i = key & set->mask;
+    for (size_t probes = 0; probes <= set->mask; probes++) {
+        uint64_t seen = atomic_load_explicit(&set->slots[i], memory_order_acquire);
+        if (seen == key) {
+            return 1;
+        }
+        if (seen == 0) {
+            return 0;
+        }
+        i = (i + 1) & set->mask;
+    }
+    return 0;
+}
+
+// Keys in the set. Goes over the whole table, so call it once the
+// threads adding to it are done.
+size_t chip8_visited_count(const Chip8VisitedSet *set) {
+    size_t count = atomic_load_explicit(&set->has_zero, memory_order_relaxed);
+    for (size_t i = 0; i <= set->mask; i++) {
+        count += atomic_load_explicit(&set->slots[i], memory_order_relaxed) != 0;
+    }
+    return count;
+}